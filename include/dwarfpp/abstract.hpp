@@ -83,6 +83,13 @@ namespace dwarf
 				typedef encap::attribute_map super;
 			private:
 				void update_cache_on_insert(iterator inserted);
+				void update_cache_on_erase(key_type k, const mapped_type& erased);
+				void invalidate_owner_caches();
+				friend struct root_die;
+				/* For root_die::make_new_synthetic(), whose DIEs are new, so
+				 * that the hooks would have nothing to do. */
+				void insert_unhooked(const super& attrs)
+				{ this->super::insert(attrs.begin(), attrs.end()); }
 			public:
 				std::pair<iterator, bool> insert(const value_type& val)
 				{
@@ -114,6 +121,35 @@ namespace dwarf
 					if (size() > size_before) update_cache_on_insert(ret);
 					return ret;
 				}
+				size_type erase(const key_type& k)
+				{
+					auto found = find(k);
+					if (found == end()) return 0;
+					mapped_type erased = found->second;
+					this->super::erase(found);
+					update_cache_on_erase(k, erased);
+					return 1;
+				}
+				iterator erase(const_iterator position)
+				{
+					key_type k = position->first;
+					mapped_type erased = position->second;
+					auto ret = this->super::erase(position);
+					update_cache_on_erase(k, erased);
+					return ret;
+				}
+				/* Assigning through operator[] would bypass the hooks above,
+				 * so we hide it; this replaces any existing value, as an
+				 * erase followed by an insert. */
+				iterator set(key_type k, const mapped_type& val)
+				{
+					auto found = find(k);
+					if (found != end()) erase(found);
+					return insert(value_type(k, val)).first;
+				}
+			private:
+				using super::operator[];
+				using super::at;
 			} m_attrs;
 			
 			Dwarf_Off get_offset() const { return m_offset; }
@@ -126,7 +162,8 @@ namespace dwarf
 			{ return m_attrs.find(attr) != m_attrs.end(); }
 			encap::attribute_map copy_attrs() const
 			{ return m_attrs; }
-			encap::attribute_map& attrs() 
+			// not encap::attribute_map&, so that edits go through our hooks
+			attribute_map& attrs() 
 			{ return m_attrs; }
 			inline spec& get_spec(root_die& r) const;
 			root_die& get_root() const
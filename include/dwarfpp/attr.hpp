@@ -150,6 +150,7 @@ namespace dwarf
 			attribute_value(const char *s)        : orig_form(DW_FORM_string),   f(STRING),   v_string(new std::string(s)) {}
 			attribute_value(const std::string& s) : orig_form(DW_FORM_string),   f(STRING),   v_string(new std::string(s)) {}
 			attribute_value(const weak_ref& r)    : orig_form(DW_FORM_ref_addr), f(REF),      v_ref(r.clone()) {}
+			explicit attribute_value(const loclist& l); // for in-memory DIEs' locations
 			
 		public:
 			bool is_flag() const { return f == FLAG; }
@@ -258,13 +258,15 @@ struct type_edge_compare : std::function<bool(const type_edge&, const type_edge&
 struct type_scc_t : public set<type_edge, type_edge_compare>
 {
 	using set::set;
-	// FIXME: we could try to maintain this on inserts.
-	// if we remove an edge, we have to invalidate it and recompute.
+	// kept up to date on in-memory edits by root_die::type_graph_edge_{added,removed}
 	summary_code_word<uint32_t> edges_summary;
 };
 bool types_abstractly_equal(iterator_df<type_die> t1, iterator_df<type_die> t2);
 std::ostream& print_type_abstract_name(std::ostream& s, iterator_df<type_die> t);
 string abstract_name_for_type(iterator_df<type_die> t);
+/* Like abstract_name_for_type, but returns the root's interned copy, which
+ * lives as long as the root_die does. */
+const string& interned_abstract_name_for_type(iterator_df<type_die> t);
 opt<uint32_t> summary_code_for_type(iterator_df<type_die> t);
 opt<uint16_t> containment_summary_code_for_type(iterator_df<type_die> t);
 opt<uint16_t> traversal_summary_code_for_type(iterator_df<type_die> t);
@@ -287,6 +289,13 @@ begin_class(type, base_initializations(initialize_base(program_element)), declar
 		// virtual bool is_rep_compatible(iterator_df<type_die> arg) const;
 		virtual iterator_df<type_die> get_concrete_type() const;
 		virtual iterator_df<type_die> get_unqualified_type() const;
+	protected:
+		/* These consult the root's precomputed type facts, if any; 
+		 * they return false if there's nothing precomputed for us. */
+		bool lookup_precomputed_byte_size(opt<Dwarf_Unsigned> *out) const;
+		bool lookup_precomputed_concrete_type(iterator_df<type_die> *out) const;
+		bool lookup_precomputed_unqualified_type(iterator_df<type_die> *out) const;
+	public:
 		virtual bool abstractly_equals(core::iterator_df<core::type_die> t) const;
 		virtual std::ostream& print_abstract_name(std::ostream& s) const ;
 		virtual opt<type_scc_t> get_scc() const;
@@ -667,6 +676,146 @@ void walk_type(core::iterator_df<core::type_die> t,
 	const std::function<void(core::iterator_df<core::type_die>, core::iterator_df<core::program_element_die>)>& post_f
 	 = std::function<void(core::iterator_df<core::type_die>, core::iterator_df<core::program_element_die>)>(),
 	const dieloc_set& currently_walking = dieloc_set());
+/* An allocation-free walk_type. It visits the same (type, reason) sequence
+ * as walk_type, but instead of recursing with a fresh dieloc_set per level
+ * and calling through std::function, it keeps an explicit stack of frames
+ * and a stack of pending edges, and records "currently walking" (grey)
+ * offsets in a bitmap covering the start type's CU. All of these are
+ * owned by the walker and are retained between walks, so if you keep one
+ * type_walker around and reuse it, steady-state walks allocate nothing
+ * in our code. (Getting at the edges of a type still goes through
+ * find_type() and friends, which may ask libdwarf for handles.)
+ * Iterators are only ever moved between the edge stack and the callbacks'
+ * arguments, never copied, so we don't re-acquire handles along the way.
+ *
+ * If "visit_once" is set, we also blacken finished nodes and never
+ * re-enter them, i.e. we visit each reachable type once rather than once
+ * per acyclic path. This is what most "for each reachable type" clients
+ * actually want, and is much cheaper on highly shared type graphs. */
+struct type_walker
+{
+	typedef pair<iterator_df<type_die>, iterator_df<program_element_die> > edge_t;
+protected:
+	struct frame
+	{
+		unsigned edge_idx;    // in m_edges: the edge we entered this node by
+		unsigned first_edge;  // in m_edges: our first outgoing edge
+		unsigned next_edge;   // in m_edges: next outgoing edge to follow
+		unsigned end_edge;    // in m_edges: one past our last outgoing edge
+		Dwarf_Off off;        // raw offset of the node; 0 means void
+	};
+	vector<frame> m_stack;
+	vector<edge_t> m_edges;
+	/* Offsets in [m_lo, m_lo + 64 * m_grey_bits.size()) are coloured in the
+	 * bitmaps; anything else (e.g. a DIE in the synthetic CU, or a
+	 * cross-CU reference) goes in the overflow vectors, which are tiny.
+	 * Invariant: between walks, every bit is clear and the overflows are empty. */
+	Dwarf_Off m_lo;
+	vector<uint64_t> m_grey_bits;
+	vector<uint64_t> m_black_bits;
+	vector<Dwarf_Off> m_grey_overflow;
+	vector<Dwarf_Off> m_black_overflow;
+	vector<Dwarf_Off> m_blackened; // so we can clear m_black_bits cheaply
+	bool m_visit_once;
+
+	bool in_bitmap(Dwarf_Off off) const
+	{ return off >= m_lo && (off - m_lo) / 64 < m_grey_bits.size(); }
+	static bool test_bit(const vector<uint64_t>& bits, Dwarf_Off rel)
+	{ return bits[rel / 64] & (1ull << (rel % 64)); }
+	static void set_bit(vector<uint64_t>& bits, Dwarf_Off rel)
+	{ bits[rel / 64] |= (1ull << (rel % 64)); }
+	static void clear_bit(vector<uint64_t>& bits, Dwarf_Off rel)
+	{ bits[rel / 64] &= ~(1ull << (rel % 64)); }
+
+	bool is_grey(Dwarf_Off off) const
+	{
+		if (in_bitmap(off)) return test_bit(m_grey_bits, off - m_lo);
+		return std::find(m_grey_overflow.begin(), m_grey_overflow.end(), off)
+			!= m_grey_overflow.end();
+	}
+	bool is_black(Dwarf_Off off) const
+	{
+		if (in_bitmap(off)) return test_bit(m_black_bits, off - m_lo);
+		return std::find(m_black_overflow.begin(), m_black_overflow.end(), off)
+			!= m_black_overflow.end();
+	}
+	void set_grey(Dwarf_Off off)
+	{
+		if (in_bitmap(off)) set_bit(m_grey_bits, off - m_lo);
+		else m_grey_overflow.push_back(off);
+	}
+	void clear_grey(Dwarf_Off off)
+	{
+		if (in_bitmap(off)) clear_bit(m_grey_bits, off - m_lo);
+		else m_grey_overflow.erase(
+			std::find(m_grey_overflow.begin(), m_grey_overflow.end(), off));
+	}
+	void set_black(Dwarf_Off off)
+	{
+		if (in_bitmap(off)) { set_bit(m_black_bits, off - m_lo); m_blackened.push_back(off); }
+		else m_black_overflow.push_back(off);
+	}
+
+	/* Size the bitmaps for t's CU and restore the between-walks invariant,
+	 * in case a previous walk was abandoned by an exception. */
+	void reset_for(const iterator_df<type_die>& t);
+	/* Append t's outgoing edges to m_edges, in the order walk_type visits them. */
+	void push_outgoing_edges(const iterator_df<type_die>& t);
+
+	template <typename Pre>
+	void enter(unsigned edge_idx, Pre& pre_f)
+	{
+		const edge_t& e = m_edges[edge_idx];
+		Dwarf_Off off = e.first ? e.first.offset_here() : 0;
+		// void is a leaf, so it never needs colouring
+		if (off != 0 && (is_grey(off) || (m_visit_once && is_black(off)))) return;
+		bool continue_recursing = pre_f(e.first, e.second);
+		if (off != 0) set_grey(off);
+		// NOTE: don't use e after here; pushing edges may reallocate
+		unsigned first_edge = m_edges.size();
+		if (continue_recursing && off != 0) push_outgoing_edges(m_edges[edge_idx].first);
+		m_stack.push_back(frame{ edge_idx, first_edge, first_edge, (unsigned) m_edges.size(), off });
+	}
+public:
+	type_walker(bool visit_once = false) : m_lo(0), m_visit_once(visit_once) {}
+
+	template <typename Pre, typename Post>
+	void walk(iterator_df<type_die> t, iterator_df<program_element_die> reason,
+		Pre&& pre_f, Post&& post_f)
+	{
+		reset_for(t);
+		m_edges.emplace_back(std::move(t), std::move(reason));
+		enter(0, pre_f);
+		while (!m_stack.empty())
+		{
+			unsigned i = m_stack.size() - 1;
+			if (m_stack[i].next_edge < m_stack[i].end_edge)
+			{
+				// enter() may grow m_stack, so don't hold a reference across it
+				enter(m_stack[i].next_edge++, pre_f);
+				continue;
+			}
+			frame done = m_stack.back();
+			const edge_t& e = m_edges[done.edge_idx];
+			post_f(e.first, e.second);
+			if (done.off != 0)
+			{
+				clear_grey(done.off);
+				if (m_visit_once) set_black(done.off);
+			}
+			// our outgoing edges are always at the top of the edge stack
+			m_edges.erase(m_edges.begin() + done.first_edge, m_edges.end());
+			m_stack.pop_back();
+		}
+		m_edges.clear();
+	}
+	template <typename Pre>
+	void walk(iterator_df<type_die> t, iterator_df<program_element_die> reason, Pre&& pre_f)
+	{
+		walk(std::move(t), std::move(reason), std::forward<Pre>(pre_f),
+			[](const iterator_df<type_die>&, const iterator_df<program_element_die>&) {});
+	}
+};
 /* with_type_describing_layout_die */
 	struct with_type_describing_layout_die : public virtual program_element_die
 	{
@@ -703,28 +852,39 @@ void walk_type(core::iterator_df<core::type_die> t,
 		virtual iterator_df<program_element_die> 
 		get_instantiating_definition() const;
 
+		/* p_mem is needed only if the location reads memory (DW_OP_deref). */
 		virtual Dwarf_Addr calculate_addr(
 			Dwarf_Addr instantiating_instance_location,
 			root_die& r,
 			Dwarf_Off dieset_relative_ip,
-			dwarf::expr::regs *p_regs = 0) const = 0;
+			dwarf::expr::regs *p_regs = 0,
+			dwarf::expr::memory *p_mem = 0) const = 0;
 
 		/** This gets a location list describing the location of the thing, 
 			assuming that the instantiating_instance_location has been pushed
 			onto the operand stack. */
 		virtual encap::loclist get_dynamic_location() const = 0;
+		/* The same, compiled, and cached in the root since we evaluate these
+		 * a lot. In-memory DIEs drop the cache whenever their attributes
+		 * change. */
+		shared_ptr<const expr::compiled_loclist> get_compiled_dynamic_location() const;
+		/* Our DW_AT_location as calculate_addr_on_stack() uses it: rewritten
+		 * in terms of the CFA, compiled, and cached like the above. */
+		shared_ptr<const expr::compiled_loclist> get_compiled_stack_location() const;
 	protected:
 		/* ditto */
 		virtual Dwarf_Addr calculate_addr_on_stack(
 			Dwarf_Addr instantiating_instance_location,
 			root_die& r,
 			Dwarf_Off dieset_relative_ip,
-			dwarf::expr::regs *p_regs = 0) const;
+			dwarf::expr::regs *p_regs = 0,
+			dwarf::expr::memory *p_mem = 0) const;
 		virtual Dwarf_Addr calculate_addr_in_object(
 			Dwarf_Addr instantiating_instance_location,
 			root_die& r, 
 			Dwarf_Off dieset_relative_ip,
-			dwarf::expr::regs *p_regs = 0) const;
+			dwarf::expr::regs *p_regs = 0,
+			dwarf::expr::memory *p_mem = 0) const;
 	public:
 		virtual bool location_requires_object_base() const = 0; 
 
@@ -746,8 +906,9 @@ void walk_type(core::iterator_df<core::type_die> t,
 				Dwarf_Addr fb, \
 				root_die& r, \
 				Dwarf_Off dr_ip, \
-				dwarf::expr::regs *p_regs = 0) const \
-				{ return calculate_addr_on_stack(fb, r, dr_ip, p_regs); } \
+				dwarf::expr::regs *p_regs = 0, \
+				dwarf::expr::memory *p_mem = 0) const \
+				{ return calculate_addr_on_stack(fb, r, dr_ip, p_regs, p_mem); } \
 	encap::loclist get_dynamic_location() const;
 #define has_object_based_location \
 	bool location_requires_object_base() const { return true; } \
@@ -762,8 +923,9 @@ void walk_type(core::iterator_df<core::type_die> t,
 				Dwarf_Addr io, \
 				root_die& r, \
 				Dwarf_Off dr_ip, \
-				dwarf::expr::regs *p_regs = 0) const \
-				{ return calculate_addr_in_object(io, r, dr_ip, p_regs); } \
+				dwarf::expr::regs *p_regs = 0, \
+				dwarf::expr::memory *p_mem = 0) const \
+				{ return calculate_addr_in_object(io, r, dr_ip, p_regs, p_mem); } \
 	encap::loclist get_dynamic_location() const;
 /* data_member_die */
 begin_class(data_member, base_initializations(initialize_base(with_dynamic_location)), declare_base(with_dynamic_location))
@@ -803,19 +965,106 @@ end_class(type_chain)
 begin_class(qualified_type, base_initializations(initialize_base(type_chain)), declare_base(type_chain))
 		iterator_df<type_die> get_unqualified_type() const;
 end_class(qualified_type)
+/* A flattened layout table for a with_data_members type. There is one
+ * entry per data member, including the members of members (recursively,
+ * through by-value struct/union/class members, but not through arrays),
+ * in preorder. Offsets are relative to the start of the outermost type,
+ * so answering "which field is at offset X?" needs no expression
+ * evaluation, just a binary search. We build these lazily, once per type,
+ * and keep them in the root until an in-memory edit; see
+ * with_data_members_die::layout_table(). */
+struct member_layout_entry
+{
+	Dwarf_Unsigned byte_offset;    // from the start of the outermost type
+	opt<Dwarf_Unsigned> byte_size; // of the member's type, if known
+	Dwarf_Unsigned bit_size;       // 0 if not a bitfield
+	Dwarf_Unsigned bit_offset;     // from byte_offset (or raw DW_AT_bit_offset, pre-DWARF4)
+	bool data_bit_offset;          // bit_offset is of the DWARF4 kind
+	unsigned short nesting;        // 0 for members of the outermost type
+	int parent_idx;                // enclosing entry in the table, or -1
+	Dwarf_Off member_off;          // the data_member_die
+	Dwarf_Off type_off;            // its type (0 if none)
+	/* How many bytes from byte_offset are ours. A DWARF4-style bitfield's
+	 * byte_size is its whole storage type, which it shares with its
+	 * neighbours, so use the bytes its bits touch. Older bitfields count
+	 * from the far end of the storage unit, so we give them all of it. */
+	Dwarf_Unsigned covered_size() const
+	{
+		if (bit_size && data_bit_offset) return (bit_offset + bit_size + 7) / 8;
+		return byte_size ? *byte_size : 0;
+	}
+	bool covers(Dwarf_Unsigned off) const
+	{ return off >= byte_offset && off < byte_offset + covered_size(); }
+};
+struct member_layout_table : public vector<member_layout_entry>
+{
+	/* We keep the entries sorted by byte offset, outermost first for equal
+	 * offsets. max_end[i] is the greatest end offset among entries 0..i;
+	 * it lets lookups stop scanning backwards as soon as nothing earlier
+	 * can reach the queried offset (overlaps only come from nesting,
+	 * unions and bitfields, so this is normally a very short scan). */
+	vector<Dwarf_Unsigned> max_end;
+	/* The deepest entry covering the offset, or null if it's padding
+	 * (or beyond the end). Among equally deep overlapping entries
+	 * (union alternatives, bitfields) we return the first declared. */
+	const member_layout_entry *innermost_at(Dwarf_Unsigned byte_offset) const;
+	/* The first entry starting exactly at the offset, outermost first. */
+	const_iterator first_starting_at(Dwarf_Unsigned byte_offset) const;
+};
 /* with_data_members_die */
 begin_class(with_data_members, base_initializations(initialize_base(type)), declare_base(type))
 		child_tag(member)
 protected:
 		mutable optional< iterator_df<> > maybe_cached_definition; 
 		// really use boost::optional, to distinguish "cached END" from "no cache"
+		void add_to_layout_table(member_layout_table& table,
+			Dwarf_Unsigned base_offset, unsigned short nesting, int parent_idx) const;
 public:
 		iterator_base find_definition() const; // for turning declarations into defns
+		shared_ptr<const member_layout_table> layout_table() const;
 		bool may_equal(core::iterator_df<core::type_die> t, const std::set< std::pair< core::iterator_df<core::type_die>, core::iterator_df<core::type_die> > >& assuming_equal) const; 
 		bool abstractly_equals(iterator_df<type_die> t) const;
 		std::ostream& print_abstract_name(std::ostream& s) const;
 end_class(with_data_members)
 
+/* A precomputed layout of a subprogram's stack-located locals and
+ * parameters. Most of these are located by a lone DW_OP_fbreg, so for
+ * any PC their extent relative to the frame base is fixed, and "which
+ * local is at this stack address?" is just a lookup once we know the
+ * frame base. We split the subprogram's CU-relative vaddrs into
+ * sub-ranges within which the set of such locals doesn't change, and
+ * keep each sub-range's entries sorted by offset. Locals with any other
+ * kind of location (register-relative, static, optimised into pieces...)
+ * or with no known size are listed separately, to be evaluated the slow
+ * way. We build these lazily, once per subprogram, and keep them in the
+ * root until an in-memory edit; see subprogram_die::get_frame_layout(). */
+struct frame_layout_entry
+{
+	Dwarf_Signed fb_offset;        // start of the object, relative to the frame base
+	Dwarf_Unsigned byte_size;
+	unsigned ordinal;              // position in the breadth-first walk of the subprogram
+	Dwarf_Off die_off;             // the with_dynamic_location_die
+	unsigned short die_depth;
+	bool covers(Dwarf_Signed off) const
+	{ return off >= fb_offset && off < fb_offset + (Dwarf_Signed) byte_size; }
+};
+struct frame_layout_range : public vector<frame_layout_entry>
+{
+	Dwarf_Addr lopc;               // CU-relative, as for loclists
+	Dwarf_Addr hipc;
+	/* As in member_layout_table: entries are sorted by fb_offset, and
+	 * max_end[i] is the greatest end offset among entries 0..i. */
+	vector<Dwarf_Signed> max_end;
+	/* Among the entries covering the offset, the first one the
+	 * breadth-first walk would have found, or null. */
+	const frame_layout_entry *first_covering(Dwarf_Signed fb_offset) const;
+};
+struct frame_layout
+{
+	vector<frame_layout_range> ranges;           // sorted and disjoint
+	vector<frame_layout_entry> others; // need evaluating; only ordinal and DIE are valid
+	const frame_layout_range *range_for_vaddr(Dwarf_Addr vaddr) const;
+};
 #define extra_decls_subprogram \
 		opt< std::pair<Dwarf_Off, iterator_df<with_dynamic_location_die> > > \
 		spans_addr_in_frame_locals_or_args( \
@@ -824,7 +1073,9 @@ end_class(with_data_members)
 					Dwarf_Off dieset_relative_ip, \
 					Dwarf_Signed *out_frame_base, \
 					dwarf::expr::regs *p_regs = 0) const; \
-		iterator_df<type_die> get_return_type() const;
+		iterator_df<type_die> get_return_type() const; \
+		shared_ptr<const frame_layout> get_frame_layout() const; \
+		shared_ptr<const expr::compiled_loclist> get_compiled_frame_base() const;
 #define extra_decls_variable \
 		bool has_static_storage() const; \
 		has_stack_based_location
@@ -10,8 +10,11 @@
 #define DWARFPP_EXPR_HPP_
 
 #include <vector>
+#include <limits>
 #include <stack>
+#include <initializer_list>
 #include <boost/icl/interval_map.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 #include <strings.h> // for bzero
 #include "spec.hpp"
 #include "libdwarf.hpp"
@@ -45,6 +48,27 @@ namespace dwarf
 			virtual lib::Dwarf_Signed get(int regnum) = 0;
 			virtual void set(int regnum, lib::Dwarf_Signed val) 
 			{ throw Not_supported("writing registers"); }
+			/* For DW_OP_entry_value: the register's value on entry to the
+			 * current function, which only a debugger-like client can know. */
+			virtual lib::Dwarf_Signed get_at_entry(int regnum)
+			{ throw lib::No_entry(); }
+		};
+		/* Target memory, for DW_OP_deref and friends. As with regs, the
+		 * client supplies this (from a live process, a core file, ...).
+		 * Reads throw No_entry if the memory isn't available. */
+		class memory
+		{
+		public:
+			virtual lib::Dwarf_Unsigned read(lib::Dwarf_Addr addr, unsigned nbytes) = 0;
+			virtual unsigned address_size() const { return sizeof (lib::Dwarf_Addr); }
+			/* For DW_OP_xderef*. Most targets have only one address space. */
+			virtual lib::Dwarf_Unsigned read_in_space(lib::Dwarf_Unsigned space,
+				lib::Dwarf_Addr addr, unsigned nbytes)
+			{ throw Not_supported("multiple address spaces"); }
+			/* For DW_OP_form_tls_address: the address of the given offset
+			 * in the current thread's TLS block for this object. */
+			virtual lib::Dwarf_Addr tls_address(lib::Dwarf_Unsigned offset)
+			{ throw Not_supported("thread-local storage"); }
 		};
 	}
 	
@@ -274,6 +298,44 @@ namespace dwarf
 		};
 		std::ostream& operator<<(std::ostream& s, const frame_instr& arg);
 		
+		/* Decodes CFA instructions one at a time, straight out of the
+		 * instruction bytes, so an interpreter can consume them without first
+		 * building a frame_instrlist (and can stop part-way through).
+		 * The end iterator is any one positioned at the limit. */
+		struct frame_instr_iterator
+		 : public boost::iterator_facade<
+				frame_instr_iterator
+				, const frame_instr
+				, boost::forward_traversal_tag
+			>
+		{
+			frame_instr_iterator()
+			 : p_cie(nullptr), addrlen(0), use_host_byte_order(true),
+			   start(nullptr), pos(nullptr), next(nullptr), limit(nullptr),
+			   cur(nullptr, Dwarf_Frame_Op3()) {}
+			frame_instr_iterator(const core::Cie& cie, int addrlen,
+				const unsigned char *start, const unsigned char *pos,
+				const unsigned char *limit, bool use_host_byte_order = true)
+			 : p_cie(&cie), addrlen(addrlen), use_host_byte_order(use_host_byte_order),
+			   start(start), pos(pos), next(pos), limit(limit),
+			   cur(nullptr, Dwarf_Frame_Op3())
+			{ if (pos < limit) decode_here(); }
+		private:
+			friend class boost::iterator_core_access;
+			const core::Cie *p_cie;
+			int addrlen;
+			bool use_host_byte_order;
+			const unsigned char *start; // for fp_instr_offset
+			const unsigned char *pos;
+			const unsigned char *next;  // just past the instruction at pos
+			const unsigned char *limit;
+			frame_instr cur;
+			void decode_here(); // in frame.cpp
+			void increment() { pos = next; if (pos < limit) decode_here(); }
+			bool equal(const frame_instr_iterator& arg) const { return pos == arg.pos; }
+			const frame_instr& dereference() const { return cur; }
+		};
+		
 		struct frame_instrlist : public vector<frame_instr>
 		{
 			using vector::vector;
@@ -307,36 +369,179 @@ namespace dwarf
 		using dwarf::spec::opt;
 		using std::stack;
 		using std::ostream;
+		/* The evaluator's operand stack. It's fixed-capacity and kept inline,
+		 * so that evaluating an expression needs no heap allocation. DWARF
+		 * doesn't bound the stack depth, but real expressions use a handful
+		 * of slots; we give up on any that need more. */
+		struct operand_stack
+		{
+			static const unsigned CAPACITY = 64;
+			operand_stack() : n(0) {}
+			explicit operand_stack(std::initializer_list<Dwarf_Unsigned> init) : n(0)
+			{ for (auto i = init.begin(); i != init.end(); ++i) push(*i); }
+			explicit operand_stack(stack<Dwarf_Unsigned> init) : n(0)
+			{
+				if (init.size() > CAPACITY) throw Not_supported("operand stack overflow");
+				n = init.size();
+				for (unsigned k = n; k > 0; --k) { slots[k - 1] = init.top(); init.pop(); }
+			}
+			void push(Dwarf_Unsigned v)
+			{
+				if (n == CAPACITY) throw Not_supported("operand stack overflow");
+				slots[n++] = v;
+			}
+			Dwarf_Unsigned top() const
+			{
+				if (n == 0) throw Not_supported("operand stack underflow");
+				return slots[n - 1];
+			}
+			void pop()
+			{
+				if (n == 0) throw Not_supported("operand stack underflow");
+				--n;
+			}
+			bool empty() const { return n == 0; }
+			unsigned size() const { return n; }
+			/* For DW_OP_pick and friends: 0 is the top. */
+			Dwarf_Unsigned at_depth(unsigned k) const
+			{
+				if (k >= n) throw Not_supported("operand stack underflow");
+				return slots[n - 1 - k];
+			}
+		private:
+			Dwarf_Unsigned slots[CAPACITY];
+			unsigned n;
+		};
+		/* One piece of an object's location, as delimited by DW_OP_piece or
+		 * DW_OP_bit_piece. An expression without pieces gives one piece
+		 * covering the whole object, with bit_size 0. */
+		struct location_piece
+		{
+			enum kind_t
+			{
+				ADDRESS,           // in memory at value
+				REGISTER,          // in register number value
+				VALUE,             // not stored anywhere, but this is its value
+				IMPLICIT_POINTER,  // a pointer to the DIE at offset value, plus pointer_offset
+				EMPTY              // optimized out
+			} kind;
+			Dwarf_Unsigned bit_size;
+			Dwarf_Unsigned bit_offset; // only nonzero for DW_OP_bit_piece
+			Dwarf_Unsigned value;
+			Dwarf_Signed pointer_offset;
+			/* Bit pieces need not start or end on a byte boundary; only when
+			 * they do do the byte_ helpers below say the whole truth. */
+			bool is_byte_aligned() const { return bit_size % 8 == 0 && bit_offset % 8 == 0; }
+			Dwarf_Unsigned byte_size() const { return bit_size / 8; }
+			Dwarf_Unsigned byte_offset() const { return bit_offset / 8; }
+		};
+		typedef vector<location_piece> composite_location;
+		class evaluator;
+		composite_location eval_pieces(const Dwarf_Loc *first, const Dwarf_Loc *last,
+			const ::dwarf::spec::abstract_def& spec,
+			regs *p_regs,
+			opt<Dwarf_Signed> frame_base,
+			memory *p_mem,
+			opt<Dwarf_Addr> object_address,
+			const operand_stack& initial_stack);
 		class evaluator {
-			std::stack<Dwarf_Unsigned> m_stack;
+			operand_stack m_stack;
+			operand_stack m_initial_stack; // for pieces(), which starts again
+			/* Either we own a copy of the expression, or we borrow the caller's.
+			 * Copying is what the vector- and loclist-taking constructors do, to
+			 * keep the old behaviour; only the [first, last) one borrows, so
+			 * must not outlive the range if you're going to call finished(),
+			 * current() or pieces(). */
+			bool owned;
 			vector<Dwarf_Loc> expr;
+			const Dwarf_Loc *borrowed_begin;
+			const Dwarf_Loc *borrowed_end;
+			const Dwarf_Loc *code_begin() const { return owned ? expr.data() : borrowed_begin; }
+			const Dwarf_Loc *code_end() const { return owned ? expr.data() + expr.size() : borrowed_end; }
 			const ::dwarf::spec::abstract_def& spec;
 			regs *p_regs; // optional set of register values, for DW_OP_breg*
 			bool tos_is_value; // whether we saw a DW_OP_stack_value hence have calculated a value not an addr
 			opt<Dwarf_Signed> frame_base;
-			vector<Dwarf_Loc>::iterator i;
+			unsigned pos; // index of the next instruction in the expression
+			memory *p_mem; // optional, for DW_OP_deref*
+			opt<Dwarf_Addr> object_address; // for DW_OP_push_object_address
+			opt< pair<Dwarf_Off, Dwarf_Signed> > implicit_pointer_target;
+			unsigned jump_target(const Dwarf_Loc *begin, const Dwarf_Loc *end, const Dwarf_Loc *i) const;
 			void eval();
+			void copy_from_loclist(const encap::loclist& loclist, Dwarf_Addr vaddr);
+			void copy_expr(const vector<Dwarf_Loc>& loc_desc)
+			{ owned = true; expr = loc_desc; pos = 0; p_mem = 0; }
+			/* For eval_pieces(), to start its first piece from our initial stack. */
+			evaluator(const Dwarf_Loc *first, const Dwarf_Loc *last,
+				const ::dwarf::spec::abstract_def& spec,
+				regs *p_regs,
+				opt<Dwarf_Signed> frame_base,
+				const operand_stack& initial_stack,
+				memory *p_mem,
+				opt<Dwarf_Addr> object_address)
+			 : m_stack(initial_stack), m_initial_stack(initial_stack), owned(false),
+			   borrowed_begin(first), borrowed_end(last),
+			   spec(spec), p_regs(p_regs), tos_is_value(false), frame_base(frame_base), pos(0),
+			   p_mem(p_mem), object_address(object_address)
+			{ eval(); }
+			friend composite_location eval_pieces(const Dwarf_Loc *first, const Dwarf_Loc *last,
+				const ::dwarf::spec::abstract_def& spec,
+				regs *p_regs,
+				opt<Dwarf_Signed> frame_base,
+				memory *p_mem,
+				opt<Dwarf_Addr> object_address,
+				const operand_stack& initial_stack);
 		public:
 			evaluator(const vector<unsigned char> expr, 
-				const ::dwarf::spec::abstract_def& spec) : spec(spec), p_regs(0), tos_is_value(false)
+				const ::dwarf::spec::abstract_def& spec)
+			 : owned(true), spec(spec), p_regs(0), tos_is_value(false), pos(0), p_mem(0)
 			{
 				//i = expr.begin();
 				assert(false);
 			}
+			/* These two pick the loclist element covering vaddr, and copy it. */
 			evaluator(const encap::loclist& loclist,
 				Dwarf_Addr vaddr,
 				const ::dwarf::spec::abstract_def& spec = spec::DEFAULT_DWARF_SPEC,
 				regs *p_regs = 0,
 				opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>(),
-				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>());
+				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>())
+			 : m_stack(initial_stack), m_initial_stack(initial_stack), owned(true), spec(spec), p_regs(p_regs),
+			   tos_is_value(false), frame_base(frame_base), pos(0), p_mem(0)
+			{ copy_from_loclist(loclist, vaddr); eval(); }
+			evaluator(const encap::loclist& loclist,
+				Dwarf_Addr vaddr,
+				const ::dwarf::spec::abstract_def& spec,
+				regs *p_regs,
+				opt<Dwarf_Signed> frame_base,
+				std::initializer_list<Dwarf_Unsigned> initial_stack,
+				memory *p_mem = 0,
+				opt<Dwarf_Addr> object_address = opt<Dwarf_Addr>())
+			 : m_stack(initial_stack), m_initial_stack(initial_stack), owned(true), spec(spec), p_regs(p_regs),
+			   tos_is_value(false), frame_base(frame_base), pos(0), p_mem(p_mem),
+			   object_address(object_address)
+			{ copy_from_loclist(loclist, vaddr); eval(); }
+			
+			/* The allocation-free way in: evaluate [first, last) in place. */
+			evaluator(const Dwarf_Loc *first, const Dwarf_Loc *last,
+				const ::dwarf::spec::abstract_def& spec,
+				regs *p_regs = 0,
+				opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>(),
+				std::initializer_list<Dwarf_Unsigned> initial_stack = {},
+				memory *p_mem = 0,
+				opt<Dwarf_Addr> object_address = opt<Dwarf_Addr>())
+			 : m_stack(initial_stack), m_initial_stack(initial_stack), owned(false),
+			   borrowed_begin(first), borrowed_end(last),
+			   spec(spec), p_regs(p_regs), tos_is_value(false), frame_base(frame_base), pos(0),
+			   p_mem(p_mem), object_address(object_address)
+			{ eval(); }
 			
 			evaluator(const vector<Dwarf_Loc>& loc_desc,
 				const ::dwarf::spec::abstract_def& spec,
 				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>())
-				: m_stack(initial_stack), spec(spec), p_regs(0), tos_is_value(false)
+				: m_stack(initial_stack), m_initial_stack(initial_stack), spec(spec), p_regs(0), tos_is_value(false)
 			{
-				expr = loc_desc;
-				i = expr.begin();
+				copy_expr(loc_desc);
 				eval();
 			}
 			evaluator(const vector<Dwarf_Loc>& loc_desc,
@@ -344,10 +549,9 @@ namespace dwarf
 				regs& regs,
 				Dwarf_Signed frame_base,
 				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>()) 
-				: m_stack(initial_stack), spec(spec), p_regs(&regs), tos_is_value(false)
+				: m_stack(initial_stack), m_initial_stack(initial_stack), spec(spec), p_regs(&regs), tos_is_value(false)
 			{
-				expr = loc_desc;
-				i = expr.begin();
+				copy_expr(loc_desc);
 				this->frame_base = frame_base;
 				eval();
 			}
@@ -356,13 +560,12 @@ namespace dwarf
 				const ::dwarf::spec::abstract_def& spec,
 				Dwarf_Signed frame_base,
 				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>()) 
-				: m_stack(initial_stack), spec(spec), p_regs(0), tos_is_value(false)
+				: m_stack(initial_stack), m_initial_stack(initial_stack), spec(spec), p_regs(0), tos_is_value(false)
 			{
 				//if (av.get_form() != dwarf::encap::attribute_value::LOCLIST) throw "not a DWARF expression";
 				//if (av.get_loclist().size() != 1) throw "only support singleton loclists for now";
 				//expr = *(av.get_loclist().begin());
-				expr = loc_desc;
-				i = expr.begin();
+				copy_expr(loc_desc);
 				this->frame_base = frame_base;
 				eval();
 			}
@@ -373,15 +576,148 @@ namespace dwarf
 				if (!tos_is_value && !may_be_value) return m_stack.top();
 				throw No_entry();
 			}
-			bool finished() const { return i == expr.end(); }
-			Dwarf_Loc current() const { return *i; }
+			/* If the expression was a DW_OP_implicit_pointer, the object has no
+			 * address, but is a pointer to (offset bytes into) the value of this DIE. */
+			opt< pair<Dwarf_Off, Dwarf_Signed> > implicit_pointer() const
+			{ return implicit_pointer_target; }
+			/* Whether the expression computed the object's value (say by
+			 * DW_OP_stack_value), rather than its address. */
+			bool computed_value() const { return tos_is_value; }
+			bool finished() const { return code_begin() + pos == code_end(); }
+			Dwarf_Loc current() const { return code_begin()[pos]; }
+			/* The whole location, all pieces at once. This evaluates the
+			 * expression again from the start, one piece at a time, starting
+			 * from the same initial stack as we did. */
+			composite_location pieces() const;
 		};
+		/* The same, without first constructing an evaluator (which would
+		 * evaluate up to the first piece). Pieces that are constant are
+		 * worked out symbolically; the rest are evaluated, and may throw as
+		 * the evaluator does. As in the evaluator, the first piece starts
+		 * from the initial stack and the rest from an empty one. */
+		composite_location eval_pieces(const Dwarf_Loc *first, const Dwarf_Loc *last,
+			const ::dwarf::spec::abstract_def& spec,
+			regs *p_regs = 0,
+			opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>(),
+			memory *p_mem = 0,
+			opt<Dwarf_Addr> object_address = opt<Dwarf_Addr>(),
+			const operand_stack& initial_stack = operand_stack());
 		Dwarf_Unsigned eval(const encap::loclist& loclist,
 			Dwarf_Addr vaddr,
 			Dwarf_Signed frame_base,
 			opt<regs&> rs,
 			const ::dwarf::spec::abstract_def& spec,
 			const stack<Dwarf_Unsigned>& initial_stack);
+
+		/* Register values for many frames at once, for batch evaluation.
+		 * They are stored by column: columns[r] points to register r's value
+		 * in each frame, or is null if we don't have that register. */
+		struct regs_columns
+		{
+			const Dwarf_Signed *const *columns;
+			unsigned ncolumns;
+			const Dwarf_Signed *column(int regnum) const
+			{
+				return (regnum >= 0 && (unsigned) regnum < ncolumns) ? columns[regnum] : nullptr;
+			}
+		};
+		/* What an expression computes, worked out without running it:
+		 * some base plus a constant offset, where the base is known only
+		 * symbolically. Anything we can't put in this form is DYNAMIC,
+		 * e.g. if it reads memory, branches or multiplies a register. */
+		struct closed_form
+		{
+			enum kind_t
+			{
+				CONSTANT,             // offset
+				OBJECT_RELATIVE,      // object_base + offset
+				FRAME_BASE_RELATIVE,  // frame_base + offset
+				REGISTER_RELATIVE,    // register regnum + offset
+				CFA_RELATIVE,         // CFA + offset
+				DYNAMIC               // anything else
+			} kind;
+			int regnum;
+			Dwarf_Signed offset;
+			bool is_value;            // computes a value (DW_OP_stack_value), not an address
+		};
+		/* If object_pushed, the expression expects the object's address on
+		 * the initial stack, as DW_AT_data_member_location does. */
+		closed_form symbolic_eval(const Dwarf_Loc *first, const Dwarf_Loc *last,
+			bool object_pushed = false);
+		inline closed_form symbolic_eval(const encap::loc_expr& e, bool object_pushed = false)
+		{ return symbolic_eval(e.data(), e.data() + e.size(), object_pushed); }
+
+		/* A location expression compiled for repeated evaluation. Nearly all
+		 * the expressions we see have a closed form, so we find it up front;
+		 * evaluating them is then a switch and an add. Anything else keeps
+		 * its (already decoded) instructions and goes to a borrowing
+		 * evaluator, so still doesn't allocate. As in the evaluator,
+		 * DW_OP_call_frame_cfa takes the CFA from the frame_base argument. */
+		struct compiled_expr : public closed_form
+		{
+			const ::dwarf::spec::abstract_def *p_spec;
+			vector<Dwarf_Loc> code;   // DYNAMIC only
+
+			explicit compiled_expr(const encap::loc_expr& e);
+			Dwarf_Unsigned eval(regs *p_regs = 0,
+				opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>(),
+				opt<Dwarf_Unsigned> object_base = opt<Dwarf_Unsigned>(),
+				memory *p_mem = 0) const;
+			/* Evaluate in n frames at once, writing n results to out. The
+			 * inputs are arrays of n (or null if not needed). Closed forms
+			 * and straight-line arithmetic are done one op at a time across
+			 * all frames, in loops the compiler can vectorise; anything else
+			 * falls back to eval() per frame. Throws as eval() does. */
+			void eval_batch(size_t n, Dwarf_Unsigned *out,
+				const regs_columns *p_regs = 0,
+				const Dwarf_Signed *frame_bases = 0,
+				const Dwarf_Unsigned *object_bases = 0,
+				memory *p_mem = 0) const;
+		private:
+			bool eval_batch_arith(size_t n, Dwarf_Unsigned *out,
+				const regs_columns *p_regs,
+				const Dwarf_Signed *frame_bases,
+				const Dwarf_Unsigned *object_bases) const;
+		};
+		/* Similarly for a whole loclist. We resolve base address selection
+		 * entries as we compile, then sort the entries by lopc so that
+		 * finding the one for a vaddr is a binary search. Entries shouldn't
+		 * overlap, but if they do, the evaluator gives the one that came
+		 * first in the loclist; so we cut later entries down to the parts
+		 * no earlier one covers, leaving our entries disjoint. */
+		struct compiled_loclist
+		{
+			struct entry
+			{
+				Dwarf_Addr lopc;  // entries for all vaddrs are 0..max
+				Dwarf_Addr hipc;
+				unsigned order;   // position in the original loclist
+				compiled_expr e;
+				bool covers(Dwarf_Addr vaddr) const
+				{
+					return vaddr >= lopc && (vaddr < hipc
+						|| hipc == std::numeric_limits<Dwarf_Addr>::max());
+				}
+			};
+			vector<entry> entries;            // sorted and disjoint
+
+			explicit compiled_loclist(const encap::loclist& l);
+			/* The first entry covering vaddr, or null. */
+			const compiled_expr *expr_for_vaddr(Dwarf_Addr vaddr) const;
+			/* The same for many vaddrs at once, writing n results to out.
+			 * This is quickest if the vaddrs are sorted. */
+			void exprs_for_vaddrs(const Dwarf_Addr *vaddrs, size_t n,
+				const compiled_expr **out) const;
+		private:
+			const entry *entry_for_vaddr(Dwarf_Addr vaddr) const;
+		public:
+			/* Throws No_entry if no entry covers vaddr. */
+			Dwarf_Unsigned eval(Dwarf_Addr vaddr,
+				regs *p_regs = 0,
+				opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>(),
+				opt<Dwarf_Unsigned> object_base = opt<Dwarf_Unsigned>(),
+				memory *p_mem = 0) const;
+		};
 	} // end namespace expr
 }
 
@@ -13,6 +13,12 @@
 #include <stack>
 #include <vector>
 #include <queue>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include <cassert>
 #include <elf.h>
 #include <boost/optional.hpp>
@@ -24,6 +30,7 @@
 #include "attr.hpp" // includes forward decls for iterator_df!
 #include "lib.hpp"
 #include "expr.hpp"
+#include "regs.hpp"
 
 namespace dwarf
 {
@@ -52,6 +59,24 @@ namespace dwarf
 			
 			map<lib::Dwarf_Off, set<lib::Dwarf_Off> > fde_offsets_by_cie_offset;
 			map<int, int> cie_offsets_by_index;
+			/* Sorted indexes, built at construction, so that PC->FDE and
+			 * Dwarf_Cie->index lookups are binary searches rather than
+			 * walks over fde_data/cie_data. */
+			struct fde_pc_range
+			{
+				Dwarf_Addr lopc;
+				Dwarf_Addr hipc;
+				Dwarf_Signed fde_idx;
+			};
+			std::vector<fde_pc_range> fde_ranges_by_pc;  // sorted by lopc
+			std::vector<pair<Dwarf_Cie, Dwarf_Signed> > cie_indices_by_handle; // sorted by handle
+			inline Dwarf_Signed index_of_cie(Dwarf_Cie cie) const; // -1 if not ours
+		private:
+			/* Fills fde_ranges_by_pc, fde_offsets_by_cie_offset and
+			 * cie_offsets_by_index (and is_64bit) in one pass over the FDEs,
+			 * asking libdwarf only for each one's range. */
+			void index_entries();
+		public:
 			/* Our iterators transform from Dwarf_Fde to Fde and Dwarf_Cie to Cie. */
 			struct fde_transformer_t
 			{
@@ -77,6 +102,12 @@ namespace dwarf
 			const Debug& get_dbg() const { return dbg; }
 			::Elf *get_elf() const; // don't rely on these!
 			int get_elf_machine() const;
+			/* The register table for our ELF machine, or nullptr if unknown. */
+			const lib::dwarf_reg_arch *get_reg_arch() const
+			{ return lib::dwarf_reg_arch_for_elf_machine(get_elf_machine()); }
+		private:
+			mutable int cached_elf_machine;
+		public:
 			
 			inline fde_iterator fde_begin() const;
 			inline fde_iterator fde_end() const;
@@ -98,7 +129,7 @@ namespace dwarf
 		private:
 			// don't copy FrameSections
 			inline FrameSection(const FrameSection& arg)
-			: dbg(arg.dbg), fde_transformer(*this), cie_transformer(*this)
+			: dbg(arg.dbg), fde_transformer(*this), cie_transformer(*this), cached_elf_machine(-1)
 			{ assert(false); }
 		public:
 			
@@ -129,6 +160,10 @@ namespace dwarf
 			 */	
 			
 			inline fde_iterator find_fde_for_pc(Dwarf_Addr pc) const;
+			/* How to recover one register, or the CFA. This is 16 bytes on LP64:
+			 * the kind, plus a union of the per-kind payloads. Expressions are
+			 * interned by content (see intern_expr()), so the many identical
+			 * ones are stored once, and are equal iff their pointers are. */
 			struct register_def
 			{
 				enum kind 
@@ -142,16 +177,26 @@ namespace dwarf
 					SAVED_AT_EXPR,
 					VAL_OF_EXPR
 				} k;
-				/*union*/ struct value_t // union makes us non-POD, so avoid the boilerplate operator{=,==,...} for now
+				/* A pair<int, int> that is happy to live in a union. */
+				struct reg_off
+				{
+					int first;
+					int second;
+					reg_off& operator=(const pair<int, int>& p)
+					{ first = p.first; second = p.second; return *this; }
+				};
+				union value_t
 				{
 					int m_undefined; // unused
 					int m_same_value; // unused
 					int m_saved_at_offset_from_cfa;
 					int m_val_is_offset_from_cfa;
-					pair<int, int> m_register_plus_offset; // "second" a.k.a. offset is only used for CFA-defining rules
-					encap::loc_expr m_saved_at_expr;
-					encap::loc_expr m_val_of_expr;
+					reg_off m_register_plus_offset; // "second" a.k.a. offset is only used for CFA-defining rules
+					const encap::loc_expr *m_expr; // SAVED_AT_EXPR and VAL_OF_EXPR; interned
 				} value;
+				
+				static const encap::loc_expr *intern_expr(const encap::loc_expr& e);
+
 				int  undefined_r() const { assert (k == UNDEFINED); return value.m_undefined; }
 				int& undefined_w()       { k = UNDEFINED;           return value.m_undefined; }
 
@@ -164,53 +209,81 @@ namespace dwarf
 				int  val_is_offset_from_cfa_r() const { assert (k == VAL_IS_OFFSET_FROM_CFA); return value.m_val_is_offset_from_cfa; }
 				int& val_is_offset_from_cfa_w()       { k = VAL_IS_OFFSET_FROM_CFA;           return value.m_val_is_offset_from_cfa; }
 
-				pair<int, int>  register_plus_offset_r() const { assert (k == REGISTER); return value.m_register_plus_offset; }
-				pair<int, int>& register_plus_offset_w()       { k = REGISTER;           return value.m_register_plus_offset; }
+				pair<int, int> register_plus_offset_r() const { assert (k == REGISTER); return make_pair(value.m_register_plus_offset.first, value.m_register_plus_offset.second); }
+				reg_off&       register_plus_offset_w()       { k = REGISTER;           return value.m_register_plus_offset; }
 
-				encap::loc_expr  saved_at_expr_r() const { assert(k == SAVED_AT_EXPR); return value.m_saved_at_expr; }
-				encap::loc_expr& saved_at_expr_w()       { k = SAVED_AT_EXPR;          return value.m_saved_at_expr; }
+				const encap::loc_expr& saved_at_expr_r() const { assert(k == SAVED_AT_EXPR); return *value.m_expr; }
+				void saved_at_expr_w(const encap::loc_expr& e) { k = SAVED_AT_EXPR;          value.m_expr = intern_expr(e); }
 
-				encap::loc_expr  val_of_expr_r() const { assert(k == VAL_OF_EXPR); return value.m_val_of_expr; }
-				encap::loc_expr& val_of_expr_w()       { k = VAL_OF_EXPR;          return value.m_val_of_expr; }
+				const encap::loc_expr& val_of_expr_r() const { assert(k == VAL_OF_EXPR); return *value.m_expr; }
+				void val_of_expr_w(const encap::loc_expr& e) { k = VAL_OF_EXPR;          value.m_expr = intern_expr(e); }
 
 				bool operator<(const register_def& r) const
 				{
 					if (this->k < r.k) return true;
 					if (r.k < this->k) return false;
 					// else they're equal-keyed
-					if (
-						(k == UNDEFINED && undefined_r() < r.undefined_r())
-					||  (k == SAVED_AT_OFFSET_FROM_CFA && saved_at_offset_from_cfa_r() < r.saved_at_offset_from_cfa_r())
-					||  (k == VAL_IS_OFFSET_FROM_CFA && val_is_offset_from_cfa_r() < r.val_is_offset_from_cfa_r())
-					||  (k == REGISTER && register_plus_offset_r() < r.register_plus_offset_r())
-					||  (k == SAVED_AT_EXPR && saved_at_expr_r() < r.saved_at_expr_r())
-					||  (k == VAL_OF_EXPR && val_of_expr_r() < r.val_of_expr_r())) return true;
-					else return false;
+					switch (k)
+					{
+						case SAVED_AT_OFFSET_FROM_CFA: return saved_at_offset_from_cfa_r() < r.saved_at_offset_from_cfa_r();
+						case VAL_IS_OFFSET_FROM_CFA: return val_is_offset_from_cfa_r() < r.val_is_offset_from_cfa_r();
+						case REGISTER: return register_plus_offset_r() < r.register_plus_offset_r();
+						// order expressions by content, so that the order doesn't vary from run to run
+						case SAVED_AT_EXPR:
+						case VAL_OF_EXPR: return value.m_expr != r.value.m_expr && *value.m_expr < *r.value.m_expr;
+						default: return false; // no payload
+					}
 				}
 				bool operator==(const register_def& r) const
 				{
 					if (this->k != r.k) return false;
-					return (
-						(k == UNDEFINED && undefined_r() == r.undefined_r())
-					||  (k == SAVED_AT_OFFSET_FROM_CFA && saved_at_offset_from_cfa_r() == r.saved_at_offset_from_cfa_r())
-					||  (k == VAL_IS_OFFSET_FROM_CFA && val_is_offset_from_cfa_r() == r.val_is_offset_from_cfa_r())
-					||  (k == REGISTER && register_plus_offset_r() == r.register_plus_offset_r())
-					||  (k == SAVED_AT_EXPR && saved_at_expr_r() == r.saved_at_expr_r())
-					||  (k == VAL_OF_EXPR && val_of_expr_r() == r.val_of_expr_r()));
+					switch (k)
+					{
+						case SAVED_AT_OFFSET_FROM_CFA: return saved_at_offset_from_cfa_r() == r.saved_at_offset_from_cfa_r();
+						case VAL_IS_OFFSET_FROM_CFA: return val_is_offset_from_cfa_r() == r.val_is_offset_from_cfa_r();
+						case REGISTER: return register_plus_offset_r() == r.register_plus_offset_r();
+						case SAVED_AT_EXPR:
+						case VAL_OF_EXPR: return value.m_expr == r.value.m_expr;
+						default: return true; // no payload
+					}
+				}
+				bool operator!=(const register_def& r) const { return !(*this == r); }
+			};
+
+			/* One row's rules, sorted by regnum. */
+			struct row_defs : public std::vector<pair<int /* regnum */, register_def> >
+			{
+				row_defs() {}
+				template <typename In>
+				row_defs(In first, In last) : std::vector<pair<int, register_def> >(first, last)
+				{
+					std::sort(this->begin(), this->end());
+					this->erase(std::unique(this->begin(), this->end()), this->end());
+				}
+				/* interval_map combines the rows of overlapping intervals with +=;
+				 * like the set<pair<int, register_def> > we used to use, that means union. */
+				row_defs& operator+=(const row_defs& r)
+				{
+					row_defs merged;
+					merged.reserve(this->size() + r.size());
+					std::set_union(this->begin(), this->end(), r.begin(), r.end(), std::back_inserter(merged));
+					this->swap(merged);
+					return *this;
 				}
 			};
 
 			struct instrs_results
 			{
-				boost::icl::interval_map<Dwarf_Addr, set<pair<int /* regnum */, register_def > > > rows;
+				/* Adjacent rows with identical rules are joined. Otherwise each
+				 * row has its own copy of its rules; only the compiled table
+				 * (below) shares one copy between rows with the same rules. */
+				boost::icl::interval_map<Dwarf_Addr, row_defs> rows;
 				std::map<int, register_def> unfinished_row;
 				Dwarf_Addr unfinished_row_addr;
 				
 				void add_unfinished_row(Dwarf_Addr high_pc) 
 				{
-					set< pair< int, FrameSection::register_def > > current_row_defs_set(
-						unfinished_row.begin(), unfinished_row.end()
-					);
+					row_defs current_row_defs_set(unfinished_row.begin(), unfinished_row.end());
 					rows += make_pair( 
 						boost::icl::interval<Dwarf_Addr>::right_open(unfinished_row_addr, high_pc),
 						current_row_defs_set
@@ -220,11 +293,116 @@ namespace dwarf
 				}
 			};
 
-			// extracted lambda function
+			/* Instructions are decoded as they're interpreted. If stop_pc is
+			 * given, we stop once we've finished the row covering it; the
+			 * result then has no unfinished row. */
 			instrs_results interpret_instructions(const Cie& cie, 
 				Dwarf_Addr initial_row_addr, 
 				Dwarf_Ptr instrs, Dwarf_Unsigned instrs_len,
-				opt< const instrs_results & > initial_instrs_results = opt< const instrs_results & >()) const;
+				opt< const instrs_results & > initial_instrs_results = opt< const instrs_results & >(),
+				opt<Dwarf_Addr> stop_pc = opt<Dwarf_Addr>()) const;
+
+			/* A "compiled" unwind table: every FDE's rows, decoded once and
+			 * flattened into a single array sorted by address. Rows are
+			 * fixed-size; the non-CFA register rules live in a shared array
+			 * (rows with identical rule sets share a single copy of them), and
+			 * expression rules point into a side table of loc_exprs. This is
+			 * what you want if you are unwinding lots of stacks; decode() and
+			 * interpret_instructions() are for when you want the gory detail. */
+			struct compiled_rule
+			{
+				uint16_t column;         // regnum, or DW_FRAME_CFA_COL3 for the CFA rule
+				uint8_t k;               // a register_def::kind
+				uint16_t reg;            // REGISTER only
+				int32_t offset_or_expr;  // offset for REGISTER and *_OFFSET_FROM_CFA; exprs index for *_EXPR
+				register_def::kind get_kind() const { return static_cast<register_def::kind>(k); }
+				bool operator==(const compiled_rule& r) const
+				{ return column == r.column && k == r.k && reg == r.reg && offset_or_expr == r.offset_or_expr; }
+				bool operator<(const compiled_rule& r) const
+				{
+					return std::make_tuple(column, k, reg, offset_or_expr)
+					     < std::make_tuple(r.column, r.k, r.reg, r.offset_or_expr);
+				}
+			};
+			struct compiled_row
+			{
+				Dwarf_Addr lopc;
+				Dwarf_Addr hipc;
+				compiled_rule cfa;
+				uint16_t ra_column;      // the CIE's return address register
+				uint32_t first_rule;     // index into compiled_table::rules
+				uint32_t nrules;
+			};
+			struct compiled_table
+			{
+				std::vector<compiled_row> rows;        // sorted by lopc
+				std::vector<compiled_rule> rules;      // each row's slice is sorted by column
+				std::vector<encap::loc_expr> exprs;
+
+				/* One binary search; returns nullptr if no row covers pc. */
+				const compiled_row *row_for_pc(Dwarf_Addr pc) const
+				{
+					auto found = std::upper_bound(rows.begin(), rows.end(), pc,
+						[](Dwarf_Addr addr, const compiled_row& row) { return addr < row.lopc; });
+					if (found == rows.begin()) return nullptr;
+					--found;
+					return (pc < found->hipc) ? &*found : nullptr;
+				}
+				const compiled_rule *rules_begin(const compiled_row& row) const
+				{ return rules.data() + row.first_rule; }
+				const compiled_rule *rules_end(const compiled_row& row) const
+				{ return rules.data() + row.first_rule + row.nrules; }
+				/* Returns nullptr if the row has no rule for this column. */
+				const compiled_rule *rule_for_column(const compiled_row& row, int column) const
+				{
+					if (column == DW_FRAME_CFA_COL3) return &row.cfa;
+					auto found = std::lower_bound(rules_begin(row), rules_end(row), column,
+						[](const compiled_rule& rule, int col) { return rule.column < col; });
+					return (found != rules_end(row) && found->column == column) ? found : nullptr;
+				}
+				const encap::loc_expr& expr_for(const compiled_rule& rule) const
+				{
+					assert(rule.get_kind() == register_def::SAVED_AT_EXPR
+						|| rule.get_kind() == register_def::VAL_OF_EXPR);
+					return exprs.at(rule.offset_or_expr);
+				}
+			};
+
+			/* Every FDE's rows, fully expanded, in columnar form. Row i covers
+			 * [row_lopc[i], row_hipc[i]) and belongs to FDE row_fde_idx[i] (an
+			 * index into fde_data); its rules are the columns numbered
+			 * row_first_col[i] up to row_first_col[i+1]. Rows are grouped by FDE,
+			 * in fde_data order, and are in address order within an FDE. */
+			struct expanded_section
+			{
+				std::vector<Dwarf_Addr> row_lopc;
+				std::vector<Dwarf_Addr> row_hipc;
+				std::vector<uint32_t> row_fde_idx;
+				std::vector<uint32_t> row_first_col; // one more than the number of rows
+				std::vector<int> col_regnum;
+				std::vector<register_def> col_def;
+				std::vector<uint32_t> fde_first_row; // one more than the number of FDEs
+
+				unsigned nrows() const { return row_lopc.size(); }
+			};
+			/* Expand the whole section, interpreting each CIE's initial
+			 * instructions only once, and the FDEs on nthreads threads
+			 * (0 means one per hardware thread). */
+			expanded_section expand_all(unsigned nthreads = 0) const;
+		private:
+			mutable std::shared_ptr<compiled_table> p_compiled_table;
+			mutable std::once_flag compiled_table_once;
+			void compile_table() const;
+		public:
+			/* Built on first use, then cached for the lifetime of the section.
+			 * A section may be shared between threads (see root_die::
+			 * frame_section_ptr()), so only one of them builds it; the others
+			 * wait for it. */
+			const compiled_table& get_compiled_table() const
+			{
+				std::call_once(compiled_table_once, [this]() { compile_table(); });
+				return *p_compiled_table;
+			}
 		};
 
 #define LIBDWARF_OK(ret) \
@@ -386,8 +564,9 @@ namespace dwarf
 			}
 		
 
+			/* If up_to_pc is given, we only decode as far as the row covering it. */
 			FrameSection::instrs_results
-			decode() const;
+			decode(opt<Dwarf_Addr> up_to_pc = opt<Dwarf_Addr>()) const;
 			
 			Dwarf_Fde raw_handle() const { return m_fde; }
 			Dwarf_Off get_fde_offset() const   { return fde_offset; }
@@ -422,10 +601,11 @@ namespace dwarf
 				if (LIBDWARF_OK(cie_ret))
 				{
 					// the iterator needs a Dwarf_Cie*, so we have to find this Dwarf_Cie
-					// in the array
-					auto found = std::find(owner.cie_data, owner.cie_data + owner.cie_element_count, cie);
-					assert(found != owner.cie_data + owner.cie_element_count);
-					return FrameSection::cie_iterator(found, owner.cie_transformer);
+					// in the array. libdwarf usually gives us its index directly.
+					Dwarf_Signed idx = (cie_index >= 0 && cie_index < owner.cie_element_count
+						&& owner.cie_data[cie_index] == cie) ? cie_index : owner.index_of_cie(cie);
+					assert(idx != -1);
+					return FrameSection::cie_iterator(owner.cie_data + idx, owner.cie_transformer);
 				} else return FrameSection::cie_iterator(owner.cie_data + owner.cie_element_count, owner.cie_transformer);
 			}
 			Dwarf_Off 
@@ -506,7 +686,8 @@ namespace dwarf
 		inline FrameSection::fde_iterator FrameSection::end() { return fde_end(); }
 
 		inline FrameSection::FrameSection(const Debug& dbg, bool use_eh /* = false */)
-		 : dbg(dbg), using_eh(use_eh), is_64bit(false), fde_transformer(*this), cie_transformer(*this)
+		 : dbg(dbg), using_eh(use_eh), is_64bit(false), fde_transformer(*this), cie_transformer(*this),
+		   cached_elf_machine(-1)
 		{
 
 			int ret = (use_eh ? dwarf_get_fde_list_eh : dwarf_get_fde_list)(
@@ -523,49 +704,138 @@ namespace dwarf
 				cie_data = nullptr;
 			}
 
-			/* Since libdwarf doesn't let us get the CIE offset, do a pass
-			 * to build a table of these eagerly. */
-			for (auto i_fde = fde_begin(); i_fde != fde_end(); ++i_fde)
+			/* Index the CIEs by handle first, since constructing an Fde
+			 * already wants to find its CIE. */
+			cie_indices_by_handle.reserve(cie_element_count);
+			for (Dwarf_Signed i = 0; i < cie_element_count; ++i)
 			{
-				fde_offsets_by_cie_offset[i_fde->get_cie_offset()].insert(i_fde->get_fde_offset());
-				lib::Dwarf_Signed index;
-				lib::Dwarf_Cie cie;
-				int cie_ret = dwarf_get_cie_of_fde(i_fde->raw_handle(), &cie, &core::current_dwarf_error);
-				if (LIBDWARF_OK(cie_ret))
-				{
-					int index_ret = dwarf_get_cie_index(cie, &index, &core::current_dwarf_error);
-					assert(index_ret == DW_DLV_OK);
-					if (LIBDWARF_OK(index_ret))
-					{
-						cie_offsets_by_index[index] = i_fde->get_cie_offset();
-					}
-				}
+				cie_indices_by_handle.push_back(make_pair(cie_data[i], i));
 			}
+			// std::less, since < on unrelated pointers isn't a total order
+			std::sort(cie_indices_by_handle.begin(), cie_indices_by_handle.end(),
+				[](const pair<Dwarf_Cie, Dwarf_Signed>& p1, const pair<Dwarf_Cie, Dwarf_Signed>& p2) {
+					return std::less<Dwarf_Cie>()(p1.first, p2.first);
+				});
+
+			/* libdwarf doesn't let us get the CIE offset, so we build a table
+			 * of these eagerly, in the same pass as the PC index. */
+			index_entries();
 
 			// do we have any orphan CIEs? we might do, if we had mangled entries, so comment out
 			// assert(cie_offsets_by_index.size() == (unsigned) cie_element_count);
+			
+			/* Fill our one lazily-set field now, so that from here on we're
+			 * read-only (apart from the compiled table, which has its own
+			 * once_flag) and can be shared between threads. */
+			get_elf_machine();
+		}
+		inline Dwarf_Signed FrameSection::index_of_cie(Dwarf_Cie cie) const
+		{
+			auto found = std::lower_bound(cie_indices_by_handle.begin(), cie_indices_by_handle.end(),
+				make_pair(cie, (Dwarf_Signed) 0),
+				[](const pair<Dwarf_Cie, Dwarf_Signed>& p1, const pair<Dwarf_Cie, Dwarf_Signed>& p2) {
+					return std::less<Dwarf_Cie>()(p1.first, p2.first);
+				});
+			if (found == cie_indices_by_handle.end() || found->first != cie) return -1;
+			return found->second;
 		}
 		inline FrameSection::fde_iterator FrameSection::find_fde_for_pc(Dwarf_Addr pc) const
 		{
-			Dwarf_Addr lopc;
-			Dwarf_Addr hipc;
-			Dwarf_Fde fde;
-			int ret = dwarf_get_fde_at_pc(fde_data, pc, &fde, &lopc, &hipc, &core::current_dwarf_error);
-			if (!LIBDWARF_OK(ret)) return fde_end();
-			auto found = std::find(fde_data, fde_data + fde_element_count, fde);
-			assert(found != fde_data + fde_element_count);
-			// assert that this FDE's range is consistent with what we asked for
-			Fde f(*this, fde);
-			assert(lopc >= f.get_low_pc() && lopc <  f.get_low_pc() + f.get_func_length());
-			assert(hipc >= f.get_low_pc() && hipc <= f.get_low_pc() + f.get_func_length());
-			return fde_iterator(found, fde_transformer);
+			/* FDEs shouldn't overlap, so the only candidate is the
+			 * last one starting at or below pc. (Unlike dwarf_get_fde_at_pc,
+			 * this doesn't need the FDEs to be in address order.) */
+			auto found = std::upper_bound(fde_ranges_by_pc.begin(), fde_ranges_by_pc.end(), pc,
+				[](Dwarf_Addr addr, const fde_pc_range& r) { return addr < r.lopc; });
+			if (found == fde_ranges_by_pc.begin()) return fde_end();
+			--found;
+			if (pc >= found->hipc) return fde_end();
+			return fde_iterator(fde_data + found->fde_idx, fde_transformer);
 		}
 		inline FrameSection::cie_iterator Cie::iterator_here() const
 		{
-			auto found = std::find(owner.cie_begin(), owner.cie_end(), *this);
-			assert(found != owner.cie_end());
-			return found;
+			Dwarf_Signed idx = owner.index_of_cie(m_cie);
+			assert(idx != -1);
+			return FrameSection::cie_iterator(owner.cie_data + idx, owner.cie_transformer);
 		}
+
+		/* Register values recovered for a frame. Registers we couldn't
+		 * recover (e.g. undefined, or caller-saved) are simply absent;
+		 * get() on those throws No_entry. */
+		struct unwound_regs : public expr::regs
+		{
+			std::vector<Dwarf_Signed> values;
+			std::vector<bool> valid;
+
+			bool has(int regnum) const
+			{ return regnum >= 0 && (unsigned) regnum < valid.size() && valid[regnum]; }
+			Dwarf_Signed get(int regnum)
+			{ if (!has(regnum)) throw No_entry(); return values[regnum]; }
+			void set(int regnum, Dwarf_Signed val)
+			{
+				assert(regnum >= 0);
+				if ((unsigned) regnum >= values.size())
+				{
+					values.resize(regnum + 1);
+					valid.resize(regnum + 1);
+				}
+				values[regnum] = val;
+				valid[regnum] = true;
+			}
+			void unset(int regnum) { if (has(regnum)) valid[regnum] = false; }
+			void clear() { values.clear(); valid.clear(); }
+		};
+
+		/* A CFI-driven stack unwinder, using the compiled table, so all the
+		 * decoding is done up front and each step is a binary search plus
+		 * the rules for that row. Memory is read through a callback, so this
+		 * works as well on a core file or a sample buffer as on a live process. */
+		struct unwinder
+		{
+			/* Read an address-sized word at addr into *out; false if unreadable. */
+			typedef std::function<bool(Dwarf_Addr addr, Dwarf_Unsigned *out)> memory_reader;
+
+			struct frame
+			{
+				Dwarf_Addr pc;
+				Dwarf_Addr cfa;
+			};
+			struct sample
+			{
+				Dwarf_Addr pc;
+				expr::regs *p_regs;
+			};
+
+			unwinder(const FrameSection& fs, memory_reader read_word);
+
+			/* One step: given the registers in the frame at pc (which is the
+			 * innermost frame if is_innermost, else the caller of something,
+			 * so we look up pc - 1), compute the caller's registers and pc, and
+			 * this frame's CFA. Returns false if we can't unwind further. */
+			bool step(Dwarf_Addr pc, bool is_innermost, expr::regs& in,
+				unwound_regs& out, Dwarf_Addr *out_caller_pc, Dwarf_Addr *out_cfa = nullptr) const;
+
+			/* Walk the whole stack, up to max_frames, starting with the
+			 * innermost frame. The result always has at least the first frame. */
+			std::vector<frame> unwind(Dwarf_Addr pc, expr::regs& regs, unsigned max_frames = 256) const;
+
+			/* The same, for many samples at once against the same tables. */
+			std::vector<std::vector<frame> > unwind_batch(const std::vector<sample>& samples,
+				unsigned max_frames = 256) const;
+
+		private:
+			const FrameSection& fs;
+			const FrameSection::compiled_table& table;
+			memory_reader read_word;
+			unsigned long long callee_saved; // columns to carry over when the CFI is silent
+			int sp_column;     // the caller's SP is the CFA minus cfa_minus_sp, unless the CFI says otherwise
+			int cfa_minus_sp;
+			const FrameSection::compiled_row *find_row(Dwarf_Addr lookup_pc,
+				const FrameSection::compiled_row *hint) const;
+			bool step_with_row(const FrameSection::compiled_row& row, expr::regs& in,
+				unwound_regs& out, Dwarf_Addr *out_caller_pc, Dwarf_Addr *out_cfa) const;
+			void unwind_into(Dwarf_Addr pc, expr::regs& regs, unsigned max_frames,
+				std::vector<frame>& frames, unwound_regs (&bufs)[2]) const;
+		};
 	}
 }
 
@@ -14,6 +14,7 @@
 #include <iostream>
 #include <utility>
 #include <functional>
+#include <memory>
 #include <vector>
 
 namespace dwarf
@@ -49,7 +50,10 @@ namespace dwarf
 			{
 				void operator ()(raw_handle_type arg) const;
 			};
-			typedef unique_ptr<opaque_type, deleter> handle_type;
+			/* Copies share one libdwarf instance, finished when the last of
+			 * them goes. This is how a FrameSection can outlive the root_die
+			 * it came from without opening the file a second time. */
+			typedef std::shared_ptr<opaque_type> handle_type;
 			
 			handle_type handle;
 			
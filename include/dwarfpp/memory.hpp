@@ -0,0 +1,127 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * memory.hpp: target memory readers for the expression evaluator.
+ *
+ * Copyright (c) 2010--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_MEMORY_HPP_
+#define DWARFPP_MEMORY_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <unordered_map>
+#include "expr.hpp"
+
+namespace dwarf
+{
+	namespace expr
+	{
+		using std::string;
+		using std::pair;
+		using std::unique_ptr;
+		using std::unordered_map;
+
+		/* A memory that fetches whole pages from somewhere and keeps them, so
+		 * that evaluating many expressions over the same data doesn't keep
+		 * going back to the source. Subclasses say how to fetch a page. We
+		 * assume the target's memory doesn't change under us; if it might
+		 * have (say a live process has run since), call flush(). */
+		class page_cached_memory : public memory
+		{
+		public:
+			static const unsigned CACHE_PAGE_SIZE = 4096;
+			explicit page_cached_memory(bool big_endian = false, unsigned max_pages = 1024)
+			 : big_endian(big_endian), max_pages(max_pages), nfetched(0),
+			   last_page_addr(0), p_last_page(nullptr) {}
+			virtual ~page_cached_memory() {}
+
+			/* Reads are of at most sizeof (Dwarf_Unsigned) bytes, and may
+			 * straddle pages. Throws No_entry if any byte is unavailable. */
+			lib::Dwarf_Unsigned read(lib::Dwarf_Addr addr, unsigned nbytes);
+			/* Copy out raw bytes, e.g. for a whole object. */
+			void read_bytes(lib::Dwarf_Addr addr, unsigned char *buf, size_t nbytes);
+			void flush();
+			size_t npages_cached() const { return pages.size(); }
+			size_t npages_fetched() const { return nfetched; }
+		protected:
+			/* Offsets [begin, end) within a page that we could read. */
+			typedef std::vector<pair<unsigned, unsigned> > valid_ranges;
+			/* Fill buf with the page starting at page_addr, and append to valid
+			 * the parts of it we could read, in order (none if we couldn't). */
+			virtual void fetch_page(lib::Dwarf_Addr page_addr, unsigned char *buf,
+				valid_ranges& valid) = 0;
+			bool big_endian;
+		private:
+			struct page
+			{
+				/* Sorted, with touching ranges merged, so that a read is
+				 * available iff it falls within one of them. Nearly always
+				 * there is just one. */
+				valid_ranges valid;
+				unsigned char bytes[CACHE_PAGE_SIZE];
+			};
+			const page& get_page(lib::Dwarf_Addr page_addr);
+			unordered_map<lib::Dwarf_Addr, unique_ptr<page> > pages;
+			unsigned max_pages;
+			size_t nfetched;
+			/* Most reads are near the last one, so skip the hash lookup. */
+			lib::Dwarf_Addr last_page_addr;
+			const page *p_last_page;
+		};
+
+		/* Memory read from a file descriptor at offsets equal to addresses,
+		 * as /proc/<pid>/mem works. The target is assumed to have our
+		 * byte order. Its address size, which DW_OP_deref reads, can't be
+		 * had from the memory itself, so is ours unless we're told. */
+		class fd_memory : public page_cached_memory
+		{
+			int fd;
+			bool owned;
+			unsigned addr_size;
+		public:
+			/* We don't close an fd we're given... */
+			explicit fd_memory(int fd, unsigned addr_size = sizeof (void*));
+			/* ... but do close one we open. Throws No_entry if we can't. */
+			explicit fd_memory(const string& path, unsigned addr_size = sizeof (void*));
+			/* For /proc/<pid>/mem. */
+			static string path_for_pid(int pid);
+			/* From the ELF class of /proc/<pid>/exe. Throws No_entry if we
+			 * can't read it. */
+			static unsigned address_size_for_pid(int pid);
+			~fd_memory();
+			unsigned address_size() const { return addr_size; }
+		protected:
+			void fetch_page(lib::Dwarf_Addr page_addr, unsigned char *buf, valid_ranges& valid);
+		};
+
+		/* Memory as recorded in an ELF core file, i.e. the file contents of
+		 * its PT_LOAD segments. Segments the kernel didn't dump (p_filesz
+		 * less than p_memsz, as for read-only file mappings) are unavailable,
+		 * not zero. Byte order comes from the ELF header. */
+		class core_file_memory : public page_cached_memory
+		{
+			struct segment
+			{
+				lib::Dwarf_Addr vaddr;
+				lib::Dwarf_Unsigned filesz;
+				lib::Dwarf_Unsigned offset;
+			};
+			int fd;
+			std::vector<segment> segments; // sorted by vaddr
+			unsigned addr_size;
+		public:
+			/* Throws No_entry if the file isn't an ELF core. */
+			explicit core_file_memory(const string& path);
+			~core_file_memory();
+			unsigned address_size() const { return addr_size; }
+		protected:
+			void fetch_page(lib::Dwarf_Addr page_addr, unsigned char *buf, valid_ranges& valid);
+		};
+	}
+}
+
+#endif
@@ -48,6 +48,116 @@ namespace dwarf
 		};
 		extern const char *dwarf_regnames_x86_64[];
 
+		/* The rest are from each architecture's DWARF ABI supplement. We only
+		 * give the integer registers and a few specials; other columns
+		 * (FP, vector...) have names in the tables below, if anywhere. */
+		enum dwarf_regs_aarch64
+		{
+			DWARF_AARCH64_X0     = 0,   // x1..x28 follow
+			DWARF_AARCH64_X29    = 29,  // frame pointer
+			DWARF_AARCH64_X30    = 30,  // link register
+			DWARF_AARCH64_SP     = 31,
+			DWARF_AARCH64_PC     = 32,
+			DWARF_AARCH64_ELR_MODE = 33,
+			DWARF_AARCH64_RA_SIGN_STATE = 34,
+			DWARF_AARCH64_V0     = 64   // v1..v31 follow
+		};
+		extern const char *dwarf_regnames_aarch64[];
+
+		enum dwarf_regs_riscv
+		{
+			DWARF_RISCV_X0       = 0,   // zero; x1..x31 follow
+			DWARF_RISCV_RA       = 1,
+			DWARF_RISCV_SP       = 2,
+			DWARF_RISCV_GP       = 3,
+			DWARF_RISCV_TP       = 4,
+			DWARF_RISCV_S0       = 8,   // a.k.a. fp
+			DWARF_RISCV_A0       = 10,
+			DWARF_RISCV_F0       = 32   // f1..f31 follow
+		};
+		extern const char *dwarf_regnames_riscv[];
+
+		enum dwarf_regs_arm
+		{
+			DWARF_ARM_R0         = 0,   // r1..r10 follow
+			DWARF_ARM_R11        = 11,  // frame pointer (ARM state; Thumb uses r7)
+			DWARF_ARM_R12        = 12,
+			DWARF_ARM_SP         = 13,
+			DWARF_ARM_LR         = 14,
+			DWARF_ARM_PC         = 15,
+			DWARF_ARM_D0         = 256  // d1..d31 follow
+		};
+		extern const char *dwarf_regnames_arm[];
+
+		enum dwarf_regs_ppc64
+		{
+			DWARF_PPC64_R0       = 0,
+			DWARF_PPC64_R1       = 1,   // stack pointer
+			DWARF_PPC64_R2       = 2,   // TOC pointer
+			DWARF_PPC64_R31      = 31,  // frame pointer, when there is one
+			DWARF_PPC64_F0       = 32,  // f1..f31 follow
+			DWARF_PPC64_LR       = 65,
+			DWARF_PPC64_CTR      = 66,
+			DWARF_PPC64_CR0      = 68,  // cr1..cr7 follow
+			DWARF_PPC64_XER      = 76,
+			DWARF_PPC64_VR0      = 77   // vr1..vr31 follow
+		};
+		extern const char *dwarf_regnames_ppc64[];
+
+		enum dwarf_regs_s390x
+		{
+			DWARF_S390X_R0       = 0,   // r1..r15 follow
+			DWARF_S390X_R11      = 11,  // frame pointer, when there is one
+			DWARF_S390X_R14      = 14,  // return address
+			DWARF_S390X_R15      = 15,  // stack pointer
+			DWARF_S390X_F0       = 16,  // then f2, f4, f6, f1, f3... (sic)
+			DWARF_S390X_A0       = 48,  // access registers a1..a15 follow
+			DWARF_S390X_PSWM     = 64,
+			DWARF_S390X_PSWA     = 65
+		};
+		extern const char *dwarf_regnames_s390x[];
+
+		/* Everything we know about an architecture's DWARF register
+		 * numbering, as a table, so that the CFI interpreter and unwinder
+		 * can look it up once (per FrameSection, say) and then just index.
+		 * All of these are constant-initialized, so there's no startup cost.
+		 * Register numbers are -1 where the architecture has no such thing
+		 * (or no fixed one). */
+		struct dwarf_reg_arch
+		{
+			int e_machine;
+			const char *name;
+			const char **regnames;  // nullptr-terminated, indexed by DWARF number
+			int nregnames;          // not counting the terminator
+			/* Which of columns 0..63 the ABI says a callee preserves, as a
+			 * bitmask. Those keep their values in the caller unless the CFI
+			 * says otherwise; the rest are unknown. */
+			unsigned long long callee_saved;
+			int cfa_minus_sp;       // the caller's SP is the CFA minus this
+			int sp;
+			int fp;
+			int ra;                 // usual return address column in CIEs
+			int pc;
+			/* Bytes in an address, for CIEs that don't say (eh_frame
+			 * versions 1 and 3); 0 where it depends on the ELF class. */
+			unsigned address_size;
+		};
+		extern const dwarf_reg_arch dwarf_reg_arch_x86;
+		extern const dwarf_reg_arch dwarf_reg_arch_x86_64;
+		extern const dwarf_reg_arch dwarf_reg_arch_aarch64;
+		extern const dwarf_reg_arch dwarf_reg_arch_riscv;
+		extern const dwarf_reg_arch dwarf_reg_arch_arm;
+		extern const dwarf_reg_arch dwarf_reg_arch_ppc64;
+		extern const dwarf_reg_arch dwarf_reg_arch_s390x;
+		/* Returns nullptr for machines we don't know about. */
+		const dwarf_reg_arch *dwarf_reg_arch_for_elf_machine(int e_machine);
+		/* Name of a DWARF register, or nullptr if we don't know it. */
+		inline const char *dwarf_regname(const dwarf_reg_arch *arch, int regnum)
+		{
+			if (!arch || regnum < 0 || regnum >= arch->nregnames) return nullptr;
+			return arch->regnames[regnum];
+		}
+
 		const char **dwarf_regnames_for_elf_machine(int e_machine);
 		
 		dwarf::encap::loc_expr dwarf_stack_pointer_expr_for_elf_machine(int e_machine,
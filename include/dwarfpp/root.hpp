@@ -13,7 +13,13 @@
 #include <utility>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <deque>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <sys/types.h>
 #include <boost/intrusive_ptr.hpp>
 #include <srk31/selective_iterator.hpp>
 #include <srk31/transform_iterator.hpp>
@@ -37,9 +43,15 @@ namespace dwarf
 	using std::dynamic_pointer_cast;
 	using boost::intrusive_ptr;
 	
+	namespace expr
+	{
+		struct compiled_loclist;
+	}
 	namespace core
 	{
 		struct FrameSection;
+		struct member_layout_table;
+		struct frame_layout;
 		// iterators: forward decls
 		template <typename Iter> struct sequence;
 		std::ostream& operator<<(std::ostream& s, const iterator_base& it);
@@ -347,6 +359,9 @@ namespace dwarf
 			
 			friend struct basic_die;
 			friend struct type_die; // for equal_to
+			friend struct with_data_members_die; // for the caches keyed by DIE offset
+			friend struct subprogram_die;        // ditto
+			friend struct with_dynamic_location_die; // ditto
 			friend class factory; // for visible_named_grandchildren_is_complete
 			
 		protected: // was protected -- consider changing back
@@ -373,24 +388,153 @@ namespace dwarf
 			map<pair<Dwarf_Off, Dwarf_Half>, Dwarf_Off> refers_to;
 			map<Dwarf_Off, pair< Dwarf_Off, bool> > equal_to;
 			map<Dwarf_Off, opt<uint32_t> > type_summary_code_cache; // FIXME: delete this after summary_code() uses SCCs
+			/* Whose cached summary codes were computed using a given type's 
+			 * summary code? We use this to invalidate only what an edit affects. */
+			unordered_map<Dwarf_Off, std::unordered_set<Dwarf_Off> > summary_code_dependents;
+			/* ... and the reverse, so that an invalidated code can drop its
+			 * registrations, rather than leave them to pile up. */
+			unordered_map<Dwarf_Off, std::unordered_set<Dwarf_Off> > summary_code_dependencies;
+			void invalidate_summary_codes_from(Dwarf_Off off);
+			/* A topological order of the in-memory types' SCCs: along any edge
+			 * the position never decreases, and two types share a position iff
+			 * they share an SCC. Only in-memory types gain edges, and nothing
+			 * libdwarf-backed refers to them, so a new edge can only close a
+			 * cycle through in-memory types lying between its ends in this
+			 * order; type_graph_edge_added() explores only those. Positions
+			 * are spread out, so that moving some types rarely means
+			 * renumbering the rest. If a libdwarf-backed type does gain an
+			 * edge (from an in-memory child), the reasoning fails, so we
+			 * drop the order and explore unboundedly from then on. */
+			static const Dwarf_Unsigned TYPE_TOPO_SPACING = 1ul<<16;
+			bool type_topo_order_valid;
+			unordered_map<Dwarf_Off, Dwarf_Unsigned> type_topo_pos;
+			map<Dwarf_Unsigned, unsigned> type_topo_pos_counts; // how many types at each
+			void set_type_topo_pos(Dwarf_Off off, Dwarf_Unsigned pos);
+			void place_types_after(Dwarf_Off anchor, const std::vector<std::vector<Dwarf_Off> >& groups);
+			void renumber_type_topo_order(Dwarf_Unsigned spacing);
 			opt<Dwarf_Off> synthetic_cu;
 
 			multimap<string, Dwarf_Off> visible_named_grandchildren_cache;
 			bool visible_named_grandchildren_is_complete;
 			friend class in_memory_abstract_die::attribute_map;
+		public:
+			/* Per-type facts, filled in for every type DIE by one pass of
+			 * precompute_type_facts(). We keep them in parallel arrays indexed
+			 * in DIE offset order, so a lookup is a binary search. The 
+			 * type_die virtuals (calculate_byte_size(), get_concrete_type(), 
+			 * get_unqualified_type()) check here first, so that callers don't
+			 * re-walk typedef chains, qualifiers and array dimensions each time.
+			 * In-memory edits (make_new) invalidate the lot. */
+			struct type_facts_table
+			{
+				static const Dwarf_Unsigned NO_SIZE = (Dwarf_Unsigned) -1;
+				std::vector<Dwarf_Off> offsets;          // sorted
+				std::vector<Dwarf_Off> concrete;         // 0 means END, i.e. void
+				std::vector<Dwarf_Off> unqualified;      // ditto
+				std::vector<Dwarf_Unsigned> byte_size;   // NO_SIZE if not calculable
+				bool complete;
+				type_facts_table() : complete(false) {}
+				int index_of(Dwarf_Off off) const
+				{
+					if (!complete) return -1;
+					auto found = std::lower_bound(offsets.begin(), offsets.end(), off);
+					if (found == offsets.end() || *found != off) return -1;
+					return found - offsets.begin();
+				}
+				void clear()
+				{ offsets.clear(); concrete.clear(); unqualified.clear(); byte_size.clear(); complete = false; }
+			};
+		protected:
+			type_facts_table type_facts;
+			/* Abstract names of types, computed at most once per type and
+			 * interned, so that name-based matching compares and copies no
+			 * more than it must. The pool only grows: edits invalidate the
+			 * cache, but references we handed out stay valid. */
+			std::unordered_set<string> interned_abstract_names;
+			unordered_map<Dwarf_Off, const string *> abstract_name_cache;
+			/* Things compiled from DIEs, keyed by DIE offset. They live here
+			 * rather than in the DIEs' payloads, because only CU payloads are
+			 * sticky, and a cache in any other payload would go when it did.
+			 * Layouts depend on other DIEs (members' types, nested locals),
+			 * so any edit drops them all; compiled locations depend only on
+			 * their own DIE's attributes, so only edits to it drop them. We
+			 * hand out shared_ptrs, so what callers hold outlives a drop. */
+			unordered_map<Dwarf_Off, std::shared_ptr<const member_layout_table> > member_layout_cache;
+			unordered_map<Dwarf_Off, std::shared_ptr<const frame_layout> > frame_layout_cache;
+			unordered_map<Dwarf_Off, std::shared_ptr<const expr::compiled_loclist> > compiled_location_cache;
+			unordered_map<Dwarf_Off, std::shared_ptr<const expr::compiled_loclist> > compiled_frame_base_cache;
+			unordered_map<Dwarf_Off, std::shared_ptr<const expr::compiled_loclist> > compiled_stack_location_cache;
+			void invalidate_type_caches()
+			{
+				type_facts.clear(); abstract_name_cache.clear();
+				member_layout_cache.clear(); frame_layout_cache.clear();
+			}
+			void invalidate_compiled_locations(Dwarf_Off off)
+			{
+				compiled_location_cache.erase(off); compiled_frame_base_cache.erase(off);
+				compiled_stack_location_cache.erase(off);
+			}
+		public:
+			const string *cached_abstract_name(Dwarf_Off off) const
+			{
+				auto found = abstract_name_cache.find(off);
+				return (found == abstract_name_cache.end()) ? nullptr : found->second;
+			}
+			const string& cache_abstract_name(Dwarf_Off off, string&& name)
+			{
+				const string *p_interned = &*interned_abstract_names.insert(std::move(name)).first;
+				abstract_name_cache[off] = p_interned;
+				return *p_interned;
+			}
+			void precompute_abstract_names();
 
-			FrameSection *p_fs;
+			/* Which file we were opened on, as device, inode, modification
+			 * time and size, so that root_dies on the same file can share a
+			 * FrameSection. Empty if we weren't opened on a file. */
+			typedef std::tuple<dev_t, ino_t, time_t, long, off_t> file_identity_t;
+		protected:
+			opt<file_identity_t> file_identity;
+			mutable std::shared_ptr<FrameSection> p_fs; // only via std::atomic_load/atomic_store
 			Dwarf_Off current_cu_offset; // 0 means none
 			::Elf *returned_elf;
 		public:
-			FrameSection&       get_frame_section()       { assert(p_fs); return *p_fs; }
-			const FrameSection& get_frame_section() const { assert(p_fs); return *p_fs; }
+			/* The FrameSection is created and indexed on first use. Root DIEs
+			 * opened on the same file share one FrameSection, built on the
+			 * libdwarf handle of whichever asked first; it keeps that handle
+			 * alive, so holders of frame_section_ptr() may outlive this
+			 * root_die. Safe to call from several threads. */
+			std::shared_ptr<FrameSection> frame_section_ptr() const;
+			FrameSection&       get_frame_section()       { return *frame_section_ptr(); }
+			const FrameSection& get_frame_section() const { return *frame_section_ptr(); }
 		protected:
 			virtual ptr_type make_payload(const iterator_base& it);
 		public:
 			virtual iterator_df<compile_unit_die> get_or_create_synthetic_cu();
 			virtual iterator_base make_new(const iterator_base& parent, Dwarf_Half tag);
 			virtual bool is_sticky(const abstract_die& d);
+		protected:
+			/* For DIEs the library synthesises for itself (the synthetic CU,
+			 * base types for bitfields): a new child of the root or of a CU,
+			 * with all its attributes at once. Nothing can refer to it yet, so
+			 * nothing cached depends on it, and unlike make_new() followed by
+			 * attribute inserts, this invalidates nothing. */
+			iterator_base make_new_synthetic(const iterator_base& parent, Dwarf_Half tag,
+				const encap::attribute_map& attrs);
+			friend struct member_die; // for make_new_synthetic
+		private:
+			iterator_base create_in_memory(const iterator_base& parent, Dwarf_Half tag);
+		public:
+			
+			void precompute_type_facts();
+			const type_facts_table& get_type_facts() const { return type_facts; }
+			
+			/* Call these when an edit to in-memory DIEs adds or removes an edge
+			 * in the type graph (in-memory attribute edits do this for you).
+			 * We keep any cached SCCs and summary codes up to date incrementally,
+			 * touching only the SCCs and dependent codes that the edge affects,
+			 * so that many edits don't mean many from-scratch recomputations. */
+			void type_graph_edge_added(const iterator_base& source, const iterator_base& target);
+			void type_graph_edge_removed(const iterator_base& source, const iterator_base& target);
 			
 			void get_referential_structure(
 				unordered_map<Dwarf_Off, Dwarf_Off>& parent_of,
@@ -401,7 +545,7 @@ namespace dwarf
 			virtual Dwarf_Off fresh_offset_under(const iterator_base& pos);
 		
 		public:
-			root_die() : dbg(), visible_named_grandchildren_is_complete(false), p_fs(nullptr),
+			root_die() : dbg(), type_topo_order_valid(true), visible_named_grandchildren_is_complete(false),
 				current_cu_offset(0), returned_elf(nullptr) {}
 			root_die(int fd);
 			virtual ~root_die();
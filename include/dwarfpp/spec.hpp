@@ -394,6 +394,35 @@ namespace dwarf
 			}
 		};
 		
+		/* Opcode metadata for the standard DWARF operators, as a dense table
+		 * indexed by opcode. It's generated from spec/dwarf_current.py, so
+		 * it can be constexpr, and decoding or evaluating an expression
+		 * needn't go near a std::map. */
+		struct op_info
+		{
+			const char *name;         // null if not a standard opcode
+			unsigned char noperands;
+			int operand_forms[3];     // zero-terminated, as op_operand_form_list returns
+			bool reads_register;
+			signed char pops;         // -1 if it depends on the operands
+			signed char pushes;       // ditto
+		};
+		struct dwarf_current_op_info
+		{
+			static constexpr op_info tbl[256] = {
+#define op_info_entry(code, name, noperands, form1, form2, reads_register, pops, pushes) \
+				{ "DW_OP_" #name, noperands, { form1, form2, 0 }, reads_register, pops, pushes },
+#define op_info_none(code) \
+				{ nullptr, 0, { 0, 0, 0 }, false, -1, -1 },
+#include "dwarf-current-opinfo.h"
+#undef op_info_none
+#undef op_info_entry
+			};
+		};
+		/* Opcode 0 is unused, so out-of-range opcodes get its empty entry. */
+		constexpr const op_info& op_info_for(int op)
+		{ return dwarf_current_op_info::tbl[(op >= 0 && op < 256) ? op : 0]; }
+		
 		/* define DWARF4 as an extension of the empty def */
 		class dwarf4_t : public extension_of<empty_def_t, dwarf4_t >//, 
 		{
@@ -403,6 +432,21 @@ namespace dwarf
 			DECLARE_MAPS
 			DECLARE_BOILERPLATE(dwarf4_t)
 			
+			/* Our opcodes are all in the dense table, so look there first
+			 * rather than in our maps. */
+			const char *op_lookup(int op) const
+			{
+				const char *name = op_info_for(op).name;
+				return name ? name : empty_def_t::inst.op_lookup(op);
+			}
+			size_t op_operand_count(int op) const
+			{ return op_info_for(op).noperands; }
+			const int *op_operand_form_list(int op) const
+			{
+				const op_info& info = op_info_for(op);
+				return info.name ? info.operand_forms : empty_def_t::inst.op_operand_form_list(op);
+			}
+			
 			/* Q. How do we define our preds so that they don't hide
 			      the ones we inherit (that call ours)?
 			 * A. Prefix them with "local". */ 
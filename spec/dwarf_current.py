@@ -242,3 +242,73 @@ tags = [ \
 ("shared_type", ( [], [], ["qualified_type"]  ) ) \
 ]
 tag_map = dict(tags)
+
+# DWARF expression operators, as (name, opcode, operand forms, reads register,
+# stack effect). Operand forms are as libdwarf decodes them into lr_number and
+# lr_number2. The stack effect is (pops, pushes), or None if it depends on
+# the operands. Opcodes must agree with dwarf.h; the generated code checks.
+ops = [ \
+("addr", 0x03, ["addr"], False, (0, 1) ), \
+("deref", 0x06, [], False, (1, 1) ), \
+("const1u", 0x08, ["data1"], False, (0, 1) ), \
+("const1s", 0x09, ["data1"], False, (0, 1) ), \
+("const2u", 0x0a, ["data2"], False, (0, 1) ), \
+("const2s", 0x0b, ["data2"], False, (0, 1) ), \
+("const4u", 0x0c, ["data4"], False, (0, 1) ), \
+("const4s", 0x0d, ["data4"], False, (0, 1) ), \
+("const8u", 0x0e, ["data8"], False, (0, 1) ), \
+("const8s", 0x0f, ["data8"], False, (0, 1) ), \
+("constu", 0x10, ["udata"], False, (0, 1) ), \
+("consts", 0x11, ["sdata"], False, (0, 1) ), \
+("dup", 0x12, [], False, (1, 2) ), \
+("drop", 0x13, [], False, (1, 0) ), \
+("over", 0x14, [], False, (2, 3) ), \
+("pick", 0x15, ["data1"], False, None ), \
+("swap", 0x16, [], False, (2, 2) ), \
+("rot", 0x17, [], False, (3, 3) ), \
+("xderef", 0x18, [], False, (2, 1) ), \
+("abs", 0x19, [], False, (1, 1) ), \
+("and", 0x1a, [], False, (2, 1) ), \
+("div", 0x1b, [], False, (2, 1) ), \
+("minus", 0x1c, [], False, (2, 1) ), \
+("mod", 0x1d, [], False, (2, 1) ), \
+("mul", 0x1e, [], False, (2, 1) ), \
+("neg", 0x1f, [], False, (1, 1) ), \
+("not", 0x20, [], False, (1, 1) ), \
+("or", 0x21, [], False, (2, 1) ), \
+("plus", 0x22, [], False, (2, 1) ), \
+("plus_uconst", 0x23, ["udata"], False, (1, 1) ), \
+("shl", 0x24, [], False, (2, 1) ), \
+("shr", 0x25, [], False, (2, 1) ), \
+("shra", 0x26, [], False, (2, 1) ), \
+("xor", 0x27, [], False, (2, 1) ), \
+("bra", 0x28, ["data2"], False, (1, 0) ), \
+("eq", 0x29, [], False, (2, 1) ), \
+("ge", 0x2a, [], False, (2, 1) ), \
+("gt", 0x2b, [], False, (2, 1) ), \
+("le", 0x2c, [], False, (2, 1) ), \
+("lt", 0x2d, [], False, (2, 1) ), \
+("ne", 0x2e, [], False, (2, 1) ), \
+("skip", 0x2f, ["data2"], False, (0, 0) ) ] \
++ [ ("lit%d" % n, 0x30 + n, [], False, (0, 1) ) for n in range(0, 32) ] \
++ [ ("reg%d" % n, 0x50 + n, [], True, (0, 1) ) for n in range(0, 32) ] \
++ [ ("breg%d" % n, 0x70 + n, ["sdata"], True, (0, 1) ) for n in range(0, 32) ] \
++ [ \
+("regx", 0x90, ["udata"], True, (0, 1) ), \
+("fbreg", 0x91, ["sdata"], True, (0, 1) ), \
+("bregx", 0x92, ["udata", "sdata"], True, (0, 1) ), \
+("piece", 0x93, ["udata"], False, (0, 0) ), \
+("deref_size", 0x94, ["data1"], False, (1, 1) ), \
+("xderef_size", 0x95, ["data1"], False, (2, 1) ), \
+("nop", 0x96, [], False, (0, 0) ), \
+("push_object_address", 0x97, [], False, (0, 1) ), \
+("call2", 0x98, ["data2"], False, None ), \
+("call4", 0x99, ["data4"], False, None ), \
+("call_ref", 0x9a, ["ref_udata"], False, None ), \
+("form_tls_address", 0x9b, [], False, (1, 1) ), \
+("call_frame_cfa", 0x9c, [], False, (0, 1) ), \
+("bit_piece", 0x9d, ["udata", "udata"], False, (0, 0) ), \
+("implicit_value", 0x9e, ["udata"], False, (0, 1) ), \
+("stack_value", 0x9f, [], False, (0, 0) ) \
+]
+op_map = dict([(name, (code, forms, reads_reg, effect)) for (name, code, forms, reads_reg, effect) in ops])
@@ -0,0 +1,23 @@
+#!/usr/bin/env python
+
+import sys
+
+sys.path.append('./spec')
+
+from dwarf_current import *
+
+def main(argv):
+    by_code = dict([(code, (name, forms, reads_reg, effect)) for (name, code, forms, reads_reg, effect) in ops])
+    for code in range(0, 256):
+        if code not in by_code:
+            print("op_info_none(0x%02x)" % code)
+            continue
+        (name, forms, reads_reg, effect) = by_code[code]
+        (pops, pushes) = effect if effect is not None else (-1, -1)
+        form_args = ["DW_FORM_%s" % form for form in forms] + ["0"] * (2 - len(forms))
+        print("op_info_entry(0x%02x, %s, %d, %s, %s, %d, %d)" % (code, name, len(forms), \
+            ', '.join(form_args), ("true" if reads_reg else "false"), pops, pushes))
+
+# main script
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -203,10 +203,39 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			}
 		}
 		
+		/* Which type-graph node has an outgoing edge because of a DW_AT_type
+		 * on this DIE? Types themselves, and the types containing members and
+		 * formal parameters. */
+		static iterator_base type_graph_source_for(const iterator_base& i)
+		{
+			if (i.is_a<type_die>()) return i;
+			if (i.is_a<data_member_die>() || i.is_a<formal_parameter_die>())
+			{
+				auto parent = i.parent();
+				if (parent.is_a<type_die>()) return parent;
+			}
+			return iterator_base::END;
+		}
+		void in_memory_abstract_die::attribute_map::invalidate_owner_caches()
+		{
+			/* What the root has compiled from our owner's own attributes.
+			 * Caches that depend on other DIEs too, like layouts, go with
+			 * the type caches. */
+			p_owner->p_root->invalidate_compiled_locations(p_owner->m_offset);
+		}
 		void in_memory_abstract_die::attribute_map::update_cache_on_insert(
 			attribute_map::iterator inserted
 		)
 		{
+			// any attribute might change a type's size or chain
+			p_owner->p_root->invalidate_type_caches();
+			invalidate_owner_caches();
+			if (inserted->first == DW_AT_type)
+			{
+				auto source = type_graph_source_for(p_owner->p_root->pos(p_owner->m_offset));
+				if (source) p_owner->p_root->type_graph_edge_added(source,
+					inserted->second.get_refiter_is_type());
+			}
 			if (inserted->first == DW_AT_name)
 			{
 				auto found = p_owner->p_root->pos(p_owner->m_offset);
@@ -222,5 +251,33 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				}
 			}
 		}
+		void in_memory_abstract_die::attribute_map::update_cache_on_erase(
+			key_type k, const mapped_type& erased
+		)
+		{
+			p_owner->p_root->invalidate_type_caches();
+			invalidate_owner_caches();
+			if (k == DW_AT_type)
+			{
+				auto source = type_graph_source_for(p_owner->p_root->pos(p_owner->m_offset));
+				if (source) p_owner->p_root->type_graph_edge_removed(source,
+					erased.get_refiter_is_type());
+			}
+			if (k == DW_AT_name)
+			{
+				/* Undo what update_cache_on_insert did, if it did it. */
+				auto found = p_owner->p_root->pos(p_owner->m_offset);
+				if (found && found.depth() == 2)
+				{
+					auto& cache = p_owner->p_root->visible_named_grandchildren_cache;
+					auto named = cache.equal_range(erased.get_string());
+					for (auto i = named.first; i != named.second; )
+					{
+						if (i->second == p_owner->m_offset) i = cache.erase(i);
+						else ++i;
+					}
+				}
+			}
+		}
 	}
 }
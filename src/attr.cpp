@@ -504,6 +504,8 @@ namespace dwarf
 			return s;
 		}
 		
+		attribute_value::attribute_value(const loclist& l)
+		 : orig_form(DW_FORM_block), f(LOCLIST), v_loclist(new loclist(l)) {}
 		attribute_value::attribute_value(const attribute_value& av) : f(av.f)
 		{
 			this->orig_form = av.orig_form;
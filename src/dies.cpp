@@ -16,6 +16,7 @@
 #include "dwarfpp/dies-inl.hpp"
 
 #include <memory>
+#include <algorithm>
 #include <boost/regex.hpp>
 #include <srk31/algorithm.hpp>
 
@@ -115,13 +116,77 @@ namespace dwarf
 			// = (char*) __builtin_return_address(0) - (char*) &__dwarfpp_assert_1;
 			//assert(return_site_distance_from_bad_caller > 50
 			//	|| return_site_distance_from_bad_caller < -50);
-			return t->print_abstract_name(s);
+			/* Names are cached in the root, so we only stream each type's
+			 * own contribution once; everything it refers to comes from the cache. */
+			s << interned_abstract_name_for_type(t);
+			return s;
 		}
-		string abstract_name_for_type(iterator_df<type_die> t)
+		const string& interned_abstract_name_for_type(iterator_df<type_die> t)
 		{
+			static const string void_name = "void";
+			if (!t) return void_name;
+			const string *p_cached = t.root().cached_abstract_name(t.offset_here());
+			if (p_cached) return *p_cached;
 			std::ostringstream s;
-			print_type_abstract_name(s, t);
-			return s.str();
+			t->print_abstract_name(s);
+			return t.root().cache_abstract_name(t.offset_here(), s.str());
+		}
+		string abstract_name_for_type(iterator_df<type_die> t)
+		{
+			return interned_abstract_name_for_type(t);
+		}
+		void root_die::precompute_abstract_names()
+		{
+			/* Name everything bottom-up, in one depth-first pass over the
+			 * whole type graph: in post-order, whatever a type's name refers
+			 * to (pointee, element type, ...) is named before the type is.
+			 * Only around a cycle is something still unnamed, and naming it
+			 * then stops at the (nominal, so self-naming) type closing it.
+			 * We gather the types before we start, because finding edges can
+			 * synthesise base types for bitfields; we reach those as edge
+			 * targets anyway. */
+			std::vector<iterator_df<type_die> > types;
+			for (auto i = begin(); i != end(); ++i)
+			{
+				if (i.is_a<type_die>()) types.push_back(i.as_a<type_die>());
+			}
+			struct frame
+			{
+				iterator_df<type_die> t;
+				std::vector<iterator_df<type_die> > succs;
+				unsigned next;
+			};
+			std::unordered_set<Dwarf_Off> seen;
+			std::vector<frame> stack;
+			auto push = [this, &seen, &stack](const iterator_df<type_die>& t) {
+				if (!t || cached_abstract_name(t.offset_here())
+					|| !seen.insert(t.offset_here()).second) return;
+				stack.push_back(frame { t, std::vector<iterator_df<type_die> >(), 0 });
+				type_iterator_outgoing_edges i_t(type_iterator_df_edges(t));
+				for (; i_t; ++i_t)
+				{
+					if (i_t.base()) stack.back().succs.push_back(i_t.base());
+				}
+			};
+			for (auto i_t = types.begin(); i_t != types.end(); ++i_t)
+			{
+				push(*i_t);
+				while (!stack.empty())
+				{
+					frame& top = stack.back();
+					if (top.next < top.succs.size())
+					{
+						// copy it, since pushing may move the frames
+						iterator_df<type_die> succ = top.succs[top.next++];
+						push(succ);
+					}
+					else
+					{
+						interned_abstract_name_for_type(top.t);
+						stack.pop_back();
+					}
+				}
+			}
 		}
 		bool base_type_die::abstractly_equals(iterator_df<type_die> t) const
 		{
@@ -150,12 +215,10 @@ namespace dwarf
 		}
 		std::ostream& with_data_members_die::print_abstract_name(std::ostream& s) const
 		{
-			vector<string> name_path(1, arbitrary_name()); /* FIXME: handle namespaces */
-			for (auto i = name_path.begin(); i != name_path.end(); ++i)
-			{
-				if (name_path.size() > 1) s << "__NL" << i->length() << "_";
-				s << *i;
-			}
+			/* FIXME: handle namespaces. When we do, a name path of more than
+			 * one element gets each element printed as "__NL<len>_<elem>".
+			 * Until then, don't bother building a one-element path. */
+			s << arbitrary_name();
 			return s;
 		}
 		bool enumeration_type_die::abstractly_equals(iterator_df<type_die> t) const
@@ -167,12 +230,10 @@ namespace dwarf
 		}
 		std::ostream& enumeration_type_die::print_abstract_name(std::ostream& s) const
 		{
-			vector<string> name_path(1, arbitrary_name()); /* FIXME: handle namespaces */
-			for (auto i = name_path.begin(); i != name_path.end(); ++i)
-			{
-				if (name_path.size() > 1) s << "__NL" << i->length() << "_";
-				s << *i;
-			}
+			/* FIXME: handle namespaces. When we do, a name path of more than
+			 * one element gets each element printed as "__NL<len>_<elem>".
+			 * Until then, don't bother building a one-element path. */
+			s << arbitrary_name();
 			return s;
 		}
 		bool type_die::abstractly_equals(iterator_df<type_die> t) const
@@ -737,6 +798,161 @@ namespace dwarf
 
 			if (post_f) post_f(t, reason);
 		}
+		void type_walker::reset_for(const iterator_df<type_die>& t)
+		{
+			/* If a callback threw out of a previous walk, we may have left
+			 * grey nodes on the stack. Clean up, so the invariant holds. */
+			for (auto i_frame = m_stack.begin(); i_frame != m_stack.end(); ++i_frame)
+			{
+				if (i_frame->off != 0 && in_bitmap(i_frame->off)) clear_bit(m_grey_bits, i_frame->off - m_lo);
+			}
+			m_stack.clear();
+			m_edges.clear();
+			m_grey_overflow.clear();
+			for (auto i_off = m_blackened.begin(); i_off != m_blackened.end(); ++i_off)
+			{
+				clear_bit(m_black_bits, *i_off - m_lo);
+			}
+			m_blackened.clear();
+			m_black_overflow.clear();
+			if (!t) return; // walking void; nothing to colour
+
+			/* Now all bits are clear, so we can re-base the bitmaps on t's CU
+			 * without re-zeroing them. We only allocate if this CU is bigger
+			 * than any we've seen before. In-memory CUs may not have a
+			 * sensible next_cu_header; they just use the overflow vectors. */
+			auto cu = t.enclosing_cu();
+			Dwarf_Off lo = cu.offset_here();
+			Dwarf_Off hi = cu->get_next_cu_header();
+			m_lo = lo;
+			if (hi > lo)
+			{
+				unsigned nwords = (hi - lo + 63) / 64;
+				if (m_grey_bits.size() < nwords)
+				{
+					m_grey_bits.resize(nwords, 0);
+					m_black_bits.resize(nwords, 0);
+				}
+			}
+		}
+		void type_walker::push_outgoing_edges(const iterator_df<type_die>& t)
+		{
+			/* These must be the same edges, in the same order, as walk_type. */
+			if (t.is_a<type_chain_die>()) // unary case -- includes typedefs, arrays, pointer/reference, ...
+			{
+				m_edges.emplace_back(t.as_a<type_chain_die>()->find_type(), t);
+			}
+			else if (t.is_a<with_data_members_die>())
+			{
+				auto member_children = t.as_a<with_data_members_die>().children().subseq_of<data_member_die>();
+				for (auto i_child = member_children.first;
+					i_child != member_children.second; ++i_child)
+				{
+					m_edges.emplace_back(i_child->find_or_create_type_handling_bitfields(), i_child);
+				}
+			}
+			else if (t.is_a<subrange_type_die>())
+			{
+				auto explicit_t = t.as_a<subrange_type_die>()->find_type();
+				// HACK: assume this is the same as for enums
+				m_edges.emplace_back(explicit_t ? explicit_t : t.enclosing_cu()->implicit_subrange_base_type(), t);
+			}
+			else if (t.is_a<enumeration_type_die>())
+			{
+				auto explicit_t = t.as_a<enumeration_type_die>()->find_type();
+				m_edges.emplace_back(explicit_t ? explicit_t : t.enclosing_cu()->implicit_enum_base_type(), t);
+			}
+			else if (t.is_a<type_describing_subprogram_die>())
+			{
+				auto sub_t = t.as_a<type_describing_subprogram_die>();
+				m_edges.emplace_back(sub_t->find_type(), sub_t);
+				auto fps = sub_t.children().subseq_of<formal_parameter_die>();
+				for (auto i_fp = fps.first; i_fp != fps.second; ++i_fp)
+				{
+					m_edges.emplace_back(i_fp->find_type(), i_fp);
+				}
+			}
+			else
+			{
+				// what are our nullary cases?
+				assert(t.is_a<base_type_die>() || t.is_a<unspecified_type_die>());
+			}
+		}
+		void root_die::precompute_type_facts()
+		{
+			type_facts.clear(); // also means the virtuals below won't consult it
+			struct facts { Dwarf_Off off; Dwarf_Off concrete; Dwarf_Off unqualified; Dwarf_Unsigned byte_size; };
+			vector<facts> working;
+			for (auto i = begin(); i != end(); ++i)
+			{
+				if (!i.is_a<type_die>()) continue;
+				auto t = i.as_a<type_die>();
+				auto concrete_t = t->get_concrete_type();
+				auto unqualified_t = t->get_unqualified_type();
+				opt<Dwarf_Unsigned> opt_sz;
+				/* Some type DIEs can't calculate a size at all, and say so
+				 * by asserting (e.g. a type chain that is its own concrete type).
+				 * Just leave those with no size. */
+				if (!(t.is_a<type_chain_die>() && concrete_t == t)
+					&& !(t.is_a<array_type_die>() && !t.as_a<array_type_die>()->get_type()))
+				{
+					opt_sz = t->calculate_byte_size();
+				}
+				working.push_back(facts {
+					t.offset_here(),
+					concrete_t ? concrete_t.offset_here() : 0,
+					unqualified_t ? unqualified_t.offset_here() : 0,
+					opt_sz ? *opt_sz : type_facts_table::NO_SIZE
+				});
+			}
+			// synthetic DIEs needn't come in offset order
+			std::sort(working.begin(), working.end(), [](const facts& f1, const facts& f2) {
+				return f1.off < f2.off;
+			});
+			type_facts.offsets.reserve(working.size());
+			type_facts.concrete.reserve(working.size());
+			type_facts.unqualified.reserve(working.size());
+			type_facts.byte_size.reserve(working.size());
+			for (auto i_f = working.begin(); i_f != working.end(); ++i_f)
+			{
+				type_facts.offsets.push_back(i_f->off);
+				type_facts.concrete.push_back(i_f->concrete);
+				type_facts.unqualified.push_back(i_f->unqualified);
+				type_facts.byte_size.push_back(i_f->byte_size);
+			}
+			type_facts.complete = true;
+		}
+		bool type_die::lookup_precomputed_byte_size(opt<Dwarf_Unsigned> *out) const
+		{
+			auto& facts = get_root().get_type_facts();
+			int idx = facts.index_of(get_offset());
+			if (idx == -1) return false;
+			*out = (facts.byte_size[idx] == root_die::type_facts_table::NO_SIZE)
+				? opt<Dwarf_Unsigned>() : opt<Dwarf_Unsigned>(facts.byte_size[idx]);
+			return true;
+		}
+		bool type_die::lookup_precomputed_concrete_type(iterator_df<type_die> *out) const
+		{
+			auto& facts = get_root().get_type_facts();
+			int idx = facts.index_of(get_offset());
+			if (idx == -1) return false;
+			Dwarf_Off off = facts.concrete[idx];
+			if (off == get_offset()) *out = find_self();
+			else if (off == 0) *out = iterator_base::END;
+			else *out = get_root().pos(off);
+			return true;
+		}
+		bool type_die::lookup_precomputed_unqualified_type(iterator_df<type_die> *out) const
+		{
+			auto& facts = get_root().get_type_facts();
+			int idx = facts.index_of(get_offset());
+			if (idx == -1) return false;
+			Dwarf_Off off = facts.unqualified[idx];
+			if (off == get_offset()) *out = find_self();
+			else if (off == 0) *out = iterator_base::END;
+			else *out = get_root().pos(off);
+			return true;
+		}
 		/* begin pasted from adt.cpp */
 		opt<Dwarf_Unsigned> type_die::calculate_byte_size() const
 		{
@@ -2051,8 +2267,14 @@ namespace dwarf
 			 * will trump an actual alias-of-summarised-full-definition symbol in the meta-obj.
 			 */
 			auto computed = this->containment_summary_code<uint32_t>(
-				/* Pass ourselves as the recursive call, to take advantage of caching. */
-				[](iterator_df<type_die> arg) -> opt<uint32_t> {
+				/* Pass ourselves as the recursive call, to take advantage of caching.
+				 * Also remember the dependency, so that edits can invalidate us. */
+				[this](iterator_df<type_die> arg) -> opt<uint32_t> {
+					if (arg)
+					{
+						get_root().summary_code_dependents[arg.offset_here()].insert(get_offset());
+						get_root().summary_code_dependencies[get_offset()].insert(arg.offset_here());
+					}
 					return summary_code_for_type(arg);
 				}
 			);
@@ -2591,6 +2813,334 @@ namespace dwarf
 				return opt<type_scc_t>(**this->opt_cached_scc);
 			} else return opt<type_scc_t>();
 		}
+		void root_die::invalidate_summary_codes_from(Dwarf_Off off)
+		{
+			std::deque<Dwarf_Off> worklist(1, off);
+			std::unordered_set<Dwarf_Off> seen;
+			while (!worklist.empty())
+			{
+				Dwarf_Off cur = worklist.front(); worklist.pop_front();
+				if (!seen.insert(cur).second) continue;
+				// if there's no payload, there's no cached code
+				auto found_live = live_dies.find(cur);
+				if (found_live != live_dies.end())
+				{
+					type_die *p_t = dynamic_cast<type_die *>(found_live->second);
+					if (p_t) p_t->cached_summary_code = opt<uint32_t>();
+				}
+				type_summary_code_cache.erase(cur);
+				auto found_deps = summary_code_dependents.find(cur);
+				if (found_deps != summary_code_dependents.end())
+				{
+					worklist.insert(worklist.end(), found_deps->second.begin(), found_deps->second.end());
+					// they will re-register when they're recomputed
+					summary_code_dependents.erase(found_deps);
+				}
+				// ... as will we, so drop our registrations with what we used
+				auto found_args = summary_code_dependencies.find(cur);
+				if (found_args != summary_code_dependencies.end())
+				{
+					for (auto i_arg = found_args->second.begin(); i_arg != found_args->second.end(); ++i_arg)
+					{
+						auto found_arg_deps = summary_code_dependents.find(*i_arg);
+						if (found_arg_deps == summary_code_dependents.end()) continue;
+						found_arg_deps->second.erase(cur);
+						if (found_arg_deps->second.empty()) summary_code_dependents.erase(found_arg_deps);
+					}
+					summary_code_dependencies.erase(found_args);
+				}
+			}
+		}
+		/* Given the complete node set of one SCC, build its edge set and
+		 * edges summary exactly as get_scc() does, and install it in each
+		 * member, or record that the members are acyclic if there are no edges. */
+		static void install_scc_for_nodes(const map<Dwarf_Off, iterator_df<type_die> >& nodes)
+		{
+			shared_ptr<type_scc_t> p_scc = std::make_shared<type_scc_t>();
+			std::set< pair<string, string> > edges_sorted;
+			for (auto i_node = nodes.begin(); i_node != nodes.end(); ++i_node)
+			{
+				type_iterator_outgoing_edges i_t(type_iterator_df_edges(i_node->second));
+				for (; i_t; ++i_t)
+				{
+					if (!i_t.base() || nodes.find(i_t.offset_here()) == nodes.end()) continue;
+					p_scc->insert(i_t.as_incoming_edge());
+					edges_sorted.insert(make_pair(
+						abstract_name_for_type(i_t),
+						abstract_name_for_type(i_t.as_incoming_edge().first.first)
+					));
+				}
+			}
+			for (auto i_edge = edges_sorted.begin(); i_edge != edges_sorted.end(); ++i_edge)
+			{
+				p_scc->edges_summary << i_edge->first;
+				p_scc->edges_summary << i_edge->second;
+			}
+			for (auto i_node = nodes.begin(); i_node != nodes.end(); ++i_node)
+			{
+				if (p_scc->size() == 0)
+				{
+					i_node->second->opt_cached_scc = opt<shared_ptr<type_scc_t> >(shared_ptr<type_scc_t>());
+				}
+				else i_node->second->opt_cached_scc = p_scc;
+			}
+		}
+		void root_die::set_type_topo_pos(Dwarf_Off off, Dwarf_Unsigned pos)
+		{
+			auto found = type_topo_pos.find(off);
+			if (found != type_topo_pos.end())
+			{
+				auto found_count = type_topo_pos_counts.find(found->second);
+				if (--found_count->second == 0) type_topo_pos_counts.erase(found_count);
+				found->second = pos;
+			}
+			else type_topo_pos.insert(make_pair(off, pos));
+			++type_topo_pos_counts[pos];
+		}
+		void root_die::renumber_type_topo_order(Dwarf_Unsigned spacing)
+		{
+			unordered_map<Dwarf_Unsigned, Dwarf_Unsigned> renumbered;
+			map<Dwarf_Unsigned, unsigned> new_counts;
+			Dwarf_Unsigned next = 0;
+			for (auto i_pos = type_topo_pos_counts.begin(); i_pos != type_topo_pos_counts.end(); ++i_pos)
+			{
+				renumbered[i_pos->first] = next;
+				new_counts[next] = i_pos->second;
+				next += spacing;
+			}
+			for (auto i_t = type_topo_pos.begin(); i_t != type_topo_pos.end(); ++i_t)
+			{
+				i_t->second = renumbered[i_t->second];
+			}
+			type_topo_pos_counts = std::move(new_counts);
+		}
+		/* Give each group its own position, in the order given, between the
+		 * anchor's and the next after it. The groups must all be at or
+		 * before the anchor now, so that they aren't in the way. */
+		void root_die::place_types_after(Dwarf_Off anchor, const std::vector<std::vector<Dwarf_Off> >& groups)
+		{
+			if (groups.empty()) return;
+			const Dwarf_Unsigned ngaps = groups.size() + 1;
+			Dwarf_Unsigned pos = type_topo_pos[anchor];
+			auto next = type_topo_pos_counts.upper_bound(pos);
+			if (next != type_topo_pos_counts.end() && next->first - pos < ngaps)
+			{
+				renumber_type_topo_order(std::max(TYPE_TOPO_SPACING, ngaps));
+				pos = type_topo_pos[anchor];
+				next = type_topo_pos_counts.upper_bound(pos);
+			}
+			Dwarf_Unsigned step = (next == type_topo_pos_counts.end()) ? TYPE_TOPO_SPACING
+				: (next->first - pos) / ngaps;
+			for (unsigned k = 0; k < groups.size(); ++k)
+			{
+				for (auto i_off = groups[k].begin(); i_off != groups[k].end(); ++i_off)
+				{
+					set_type_topo_pos(*i_off, pos + step * (k + 1));
+				}
+			}
+		}
+		void root_die::type_graph_edge_added(const iterator_base& source, const iterator_base& target)
+		{
+			invalidate_summary_codes_from(source.offset_here());
+			invalidate_type_caches();
+			if (!source || !target) return; // void is never on a cycle
+			iterator_df<type_die> u = source;
+			iterator_df<type_die> v = target;
+			Dwarf_Off u_off = u.offset_here();
+			
+			if (type_topo_order_valid && type_topo_pos.find(u_off) == type_topo_pos.end())
+			{
+				debug(5) << "Libdwarf-backed type gained an edge; dropping the type order" << endl;
+				type_topo_order_valid = false;
+				type_topo_pos.clear();
+				type_topo_pos_counts.clear();
+			}
+			const bool bounded = type_topo_order_valid;
+			Dwarf_Unsigned u_pos = 0;
+			if (bounded)
+			{
+				/* Libdwarf-backed types never lead back to in-memory ones. */
+				auto found_v = type_topo_pos.find(v.offset_here());
+				if (found_v == type_topo_pos.end()) return;
+				/* If the edge goes forwards in the order, the order stands,
+				 * and v can't reach u. */
+				u_pos = type_topo_pos[u_off];
+				if (u_pos < found_v->second) return;
+			}
+			
+			/* The new edge makes a new (or bigger) cycle iff v already reached u.
+			 * Explore forwards from v, remembering the edges backwards; then the
+			 * new SCC of u is everything we explored that reaches u. This is
+			 * closed under the old SCCs, so it subsumes all of them that it touches.
+			 * Positions only increase along a path, so with the order we need
+			 * explore only as far as u's. */
+			map<Dwarf_Off, iterator_df<type_die> > forward_seen;
+			std::unordered_multimap<Dwarf_Off, Dwarf_Off> preds;
+			std::deque<iterator_df<type_die> > worklist(1, v);
+			forward_seen.insert(make_pair(v.offset_here(), v));
+			bool reached_u = (v.offset_here() == u_off);
+			while (!worklist.empty())
+			{
+				iterator_df<type_die> cur = std::move(worklist.front()); worklist.pop_front();
+				type_iterator_outgoing_edges i_t(type_iterator_df_edges(cur));
+				for (; i_t; ++i_t)
+				{
+					if (!i_t.base()) continue;
+					Dwarf_Off t_off = i_t.offset_here();
+					if (bounded)
+					{
+						auto found_t = type_topo_pos.find(t_off);
+						if (found_t == type_topo_pos.end() || found_t->second > u_pos) continue;
+					}
+					preds.insert(make_pair(t_off, cur.offset_here()));
+					if (t_off == u_off) reached_u = true;
+					if (forward_seen.find(t_off) == forward_seen.end())
+					{
+						iterator_df<type_die> succ = i_t.base();
+						forward_seen.insert(make_pair(t_off, succ));
+						worklist.push_back(std::move(succ));
+					}
+				}
+			}
+			map<Dwarf_Off, iterator_df<type_die> > new_scc_nodes;
+			std::deque<Dwarf_Off> back_worklist;
+			if (reached_u) back_worklist.push_back(u_off);
+			while (!back_worklist.empty())
+			{
+				Dwarf_Off cur = back_worklist.front(); back_worklist.pop_front();
+				auto found = forward_seen.find(cur);
+				if (found == forward_seen.end() || new_scc_nodes.find(cur) != new_scc_nodes.end()) continue;
+				new_scc_nodes.insert(*found);
+				auto ps = preds.equal_range(cur);
+				for (auto i_p = ps.first; i_p != ps.second; ++i_p) back_worklist.push_back(i_p->second);
+			}
+			if (bounded)
+			{
+				/* The new SCC all goes at u's position. What else we explored
+				 * is reached from v but doesn't reach u, so goes after u,
+				 * keeping its order (and its SCCs). Everything we didn't
+				 * explore stays put, and the order holds. */
+				map<Dwarf_Unsigned, std::vector<Dwarf_Off> > to_move;
+				for (auto i_seen = forward_seen.begin(); i_seen != forward_seen.end(); ++i_seen)
+				{
+					if (new_scc_nodes.find(i_seen->first) != new_scc_nodes.end()) continue;
+					to_move[type_topo_pos[i_seen->first]].push_back(i_seen->first);
+				}
+				for (auto i_node = new_scc_nodes.begin(); i_node != new_scc_nodes.end(); ++i_node)
+				{
+					set_type_topo_pos(i_node->first, u_pos);
+				}
+				std::vector<std::vector<Dwarf_Off> > groups;
+				for (auto i_group = to_move.begin(); i_group != to_move.end(); ++i_group)
+				{
+					groups.push_back(std::move(i_group->second));
+				}
+				place_types_after(u_off, groups);
+			}
+			if (!reached_u)
+			{
+				/* No SCC changes, but if u was cached as acyclic, it still is. */
+				return;
+			}
+			debug(5) << "Edge addition merged " << new_scc_nodes.size() << " types into one SCC" << endl;
+			install_scc_for_nodes(new_scc_nodes);
+			for (auto i_node = new_scc_nodes.begin(); i_node != new_scc_nodes.end(); ++i_node)
+			{
+				// as in get_scc(), SCC members are sticky
+				sticky_dies.insert(make_pair(i_node->first, ptr_type(&i_node->second.dereference())));
+				invalidate_summary_codes_from(i_node->first);
+			}
+		}
+		void root_die::type_graph_edge_removed(const iterator_base& source, const iterator_base& target)
+		{
+			invalidate_summary_codes_from(source.offset_here());
+			invalidate_type_caches();
+			if (!source || !target) return;
+			iterator_df<type_die> u = source;
+			iterator_df<type_die> v = target;
+			/* Removing an edge can only split the SCC that contained both ends. 
+			 * If we haven't computed one, or the ends were in different SCCs,
+			 * there's nothing to do. */
+			if (!u->opt_cached_scc || !*u->opt_cached_scc) return;
+			shared_ptr<type_scc_t> p_old = *u->opt_cached_scc;
+			if (!v->opt_cached_scc || *v->opt_cached_scc != p_old) return;
+			
+			/* Re-run Tarjan's algorithm, restricted to the old SCC's nodes. */
+			map<Dwarf_Off, iterator_df<type_die> > old_nodes;
+			for (auto i_e = p_old->begin(); i_e != p_old->end(); ++i_e)
+			{
+				if (i_e->source()) old_nodes.insert(make_pair(i_e->source().offset_here(), i_e->source()));
+				if (i_e->target()) old_nodes.insert(make_pair(i_e->target().offset_here(), i_e->target()));
+			}
+			map<Dwarf_Off, pair<unsigned, unsigned> > index_and_lowlink;
+			vector<Dwarf_Off> tarjan_stack;
+			std::unordered_set<Dwarf_Off> on_stack;
+			unsigned next_index = 0;
+			vector< map<Dwarf_Off, iterator_df<type_die> > > components;
+			std::function<void(Dwarf_Off)> strongconnect = [&](Dwarf_Off off) {
+				index_and_lowlink[off] = make_pair(next_index, next_index); ++next_index;
+				tarjan_stack.push_back(off); on_stack.insert(off);
+				type_iterator_outgoing_edges i_t(type_iterator_df_edges(old_nodes[off]));
+				for (; i_t; ++i_t)
+				{
+					if (!i_t.base()) continue;
+					Dwarf_Off succ = i_t.offset_here();
+					if (old_nodes.find(succ) == old_nodes.end()) continue;
+					if (index_and_lowlink.find(succ) == index_and_lowlink.end())
+					{
+						strongconnect(succ);
+						index_and_lowlink[off].second = std::min(index_and_lowlink[off].second,
+							index_and_lowlink[succ].second);
+					}
+					else if (on_stack.find(succ) != on_stack.end())
+					{
+						index_and_lowlink[off].second = std::min(index_and_lowlink[off].second,
+							index_and_lowlink[succ].first);
+					}
+				}
+				if (index_and_lowlink[off].second == index_and_lowlink[off].first)
+				{
+					components.push_back(map<Dwarf_Off, iterator_df<type_die> >());
+					Dwarf_Off popped;
+					do
+					{
+						popped = tarjan_stack.back(); tarjan_stack.pop_back();
+						on_stack.erase(popped);
+						components.back().insert(make_pair(popped, old_nodes[popped]));
+					} while (popped != off);
+				}
+			};
+			for (auto i_node = old_nodes.begin(); i_node != old_nodes.end(); ++i_node)
+			{
+				if (index_and_lowlink.find(i_node->first) == index_and_lowlink.end()) strongconnect(i_node->first);
+			}
+			debug(5) << "Edge removal split an SCC into " << components.size() << " parts" << endl;
+			for (auto i_comp = components.begin(); i_comp != components.end(); ++i_comp)
+			{
+				install_scc_for_nodes(*i_comp);
+			}
+			if (type_topo_order_valid && components.size() > 1)
+			{
+				/* The parts shared the old SCC's position. Tarjan's algorithm
+				 * finds them in reverse topological order, so the last keeps
+				 * it and the others go after, in the reverse of that order. */
+				std::vector<std::vector<Dwarf_Off> > groups;
+				for (auto i_comp = components.rbegin() + 1; i_comp != components.rend(); ++i_comp)
+				{
+					groups.push_back(std::vector<Dwarf_Off>());
+					for (auto i_node = i_comp->begin(); i_node != i_comp->end(); ++i_node)
+					{
+						groups.back().push_back(i_node->first);
+					}
+				}
+				place_types_after(components.back().begin()->first, groups);
+			}
+			/* Any that are no longer cyclic can stay sticky; it does no harm. */
+			for (auto i_node = old_nodes.begin(); i_node != old_nodes.end(); ++i_node)
+			{
+				invalidate_summary_codes_from(i_node->first);
+			}
+		}
 		bool type_die::may_equal(iterator_df<type_die> t, const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& assuming_equal) const
 		{
 			if (!t) return false;
@@ -2966,6 +3516,8 @@ namespace dwarf
 /* from qualified_type_die */
 		iterator_df<type_die> qualified_type_die::get_unqualified_type() const
 		{
+			iterator_df<type_die> precomputed;
+			if (lookup_precomputed_unqualified_type(&precomputed)) return precomputed;
 			// for qualified types, our unqualified self is our get_type, recursively unqualified
 			opt<iterator_df<type_die> > opt_next_type = get_type();
 			if (!opt_next_type) return iterator_base::END; 
@@ -2976,6 +3528,8 @@ namespace dwarf
 /* from spec::type_chain_die */
 		opt<Dwarf_Unsigned> type_chain_die::calculate_byte_size() const
 		{
+			opt<Dwarf_Unsigned> precomputed;
+			if (lookup_precomputed_byte_size(&precomputed)) return precomputed;
 			// Size of a type_chain is always the size of its concrete type
 			// which is *not* to be confused with its pointed-to type!
 			auto next_type = get_concrete_type();
@@ -3017,6 +3571,8 @@ namespace dwarf
 				&& get_tag() != DW_TAG_rvalue_reference_type
 				&& get_tag() != DW_TAG_array_type);
 			
+			iterator_df<type_die> precomputed;
+			if (lookup_precomputed_concrete_type(&precomputed)) return precomputed;
 			root_die& r = get_root(); 
 			auto opt_next_type = get_type();
 			if (!opt_next_type) return iterator_base::END; // a.k.a. None
@@ -3034,6 +3590,8 @@ namespace dwarf
 		}
 		opt<Dwarf_Unsigned> address_holding_type_die::calculate_byte_size() const 
 		{
+			opt<Dwarf_Unsigned> precomputed;
+			if (lookup_precomputed_byte_size(&precomputed)) return precomputed;
 			root_die& r = get_root();
 			auto opt_size = get_byte_size();
 			if (opt_size) return opt_size;
@@ -3116,6 +3674,8 @@ namespace dwarf
 
 		opt<Dwarf_Unsigned> array_type_die::calculate_byte_size() const
 		{
+			opt<Dwarf_Unsigned> precomputed;
+			if (lookup_precomputed_byte_size(&precomputed)) return precomputed;
 			auto element_type = get_type();
 			assert(element_type != iterator_base::END);
 			opt<Dwarf_Unsigned> count = element_count();
@@ -3290,6 +3850,137 @@ namespace dwarf
 			return iterator_base::END;
 		}
 
+		void with_data_members_die::add_to_layout_table(member_layout_table& table,
+			Dwarf_Unsigned base_offset, unsigned short nesting, int parent_idx) const
+		{
+			auto members = find_self().children().subseq_of<data_member_die>();
+			for (auto i_memb = members.first; i_memb != members.second; ++i_memb)
+			{
+				// skip members that are mere declarations
+				if (i_memb->get_declaration() && *i_memb->get_declaration()) continue;
+
+				member_layout_entry ent;
+				ent.nesting = nesting;
+				ent.parent_idx = parent_idx;
+				ent.member_off = i_memb.offset_here();
+				ent.bit_size = 0;
+				ent.bit_offset = 0;
+				ent.data_bit_offset = false;
+
+				/* DWARF4-style bitfields have a data_bit_offset and no location,
+				 * so handle them before asking for the byte offset. */
+				opt<Dwarf_Unsigned> opt_data_boff;
+				if (i_memb.is_a<member_die>())
+				{
+					auto m = i_memb.as_a<member_die>();
+					opt_data_boff = m->get_data_bit_offset();
+					if (m->get_bit_size()) ent.bit_size = *m->get_bit_size();
+					// HACK: as in base_type_die::bit_size_and_offset, we don't
+					// convert the DWARF 2/3 big-endian-style bit_offset
+					if (!opt_data_boff && m->get_bit_offset()) ent.bit_offset = *m->get_bit_offset();
+				}
+				if (opt_data_boff)
+				{
+					ent.byte_offset = base_offset + *opt_data_boff / 8;
+					ent.bit_offset = *opt_data_boff % 8;
+					ent.data_bit_offset = true;
+				}
+				else
+				{
+					opt<Dwarf_Unsigned> opt_offset = i_memb->byte_offset_in_enclosing_type();
+					if (!opt_offset)
+					{
+						debug() << "Warning: saw member " << *i_memb << " with no apparent offset." << endl;
+						continue;
+					}
+					ent.byte_offset = base_offset + *opt_offset;
+				}
+
+				iterator_df<type_die> member_t = i_memb->find_type();
+				ent.type_off = member_t ? member_t.offset_here() : 0;
+				iterator_df<type_die> concrete_t = member_t ? member_t->get_concrete_type() : member_t;
+				ent.byte_size = concrete_t ? concrete_t->calculate_byte_size() : opt<Dwarf_Unsigned>();
+				table.push_back(ent);
+
+				/* Recurse into by-value aggregates. They can't contain themselves,
+				 * but a declaration has no members, so find its definition. */
+				if (concrete_t && concrete_t.is_a<with_data_members_die>())
+				{
+					iterator_df<with_data_members_die> defn
+					 = concrete_t.as_a<with_data_members_die>()->find_definition();
+					if (defn) defn->add_to_layout_table(table, ent.byte_offset,
+						nesting + 1, table.size() - 1);
+				}
+			}
+		}
+		shared_ptr<const member_layout_table> with_data_members_die::layout_table() const
+		{
+			auto& cache = get_root().member_layout_cache;
+			auto found = cache.find(get_offset());
+			if (found != cache.end()) return found->second;
+			auto p_table = std::make_shared<member_layout_table>();
+			add_to_layout_table(*p_table, 0, 0, -1);
+
+			/* Sort by offset, outermost first. Sorting moves entries, so
+			 * remap the parent indices afterwards. */
+			vector<unsigned> order(p_table->size());
+			for (unsigned i = 0; i < order.size(); ++i) order[i] = i;
+			std::stable_sort(order.begin(), order.end(),
+				[&p_table](unsigned i1, unsigned i2) {
+					const member_layout_entry& e1 = (*p_table)[i1];
+					const member_layout_entry& e2 = (*p_table)[i2];
+					return e1.byte_offset < e2.byte_offset
+						|| (e1.byte_offset == e2.byte_offset && e1.nesting < e2.nesting);
+				});
+			vector<int> new_pos(order.size());
+			for (unsigned i = 0; i < order.size(); ++i) new_pos[order[i]] = i;
+			member_layout_table sorted;
+			sorted.reserve(p_table->size());
+			for (unsigned i = 0; i < order.size(); ++i)
+			{
+				sorted.push_back((*p_table)[order[i]]);
+				if (sorted.back().parent_idx != -1) sorted.back().parent_idx
+				 = new_pos[sorted.back().parent_idx];
+			}
+			Dwarf_Unsigned max_end_so_far = 0;
+			for (auto i_ent = sorted.begin(); i_ent != sorted.end(); ++i_ent)
+			{
+				Dwarf_Unsigned end = i_ent->byte_offset + i_ent->covered_size();
+				if (end > max_end_so_far) max_end_so_far = end;
+				sorted.max_end.push_back(max_end_so_far);
+			}
+			*p_table = std::move(sorted);
+			cache.insert(make_pair(get_offset(), p_table));
+			return p_table;
+		}
+		const member_layout_entry *
+		member_layout_table::innermost_at(Dwarf_Unsigned byte_offset) const
+		{
+			// find the last entry starting at or before the offset
+			auto found = std::upper_bound(begin(), end(), byte_offset,
+				[](Dwarf_Unsigned off, const member_layout_entry& ent) {
+					return off < ent.byte_offset;
+				});
+			const member_layout_entry *best = nullptr;
+			for (unsigned i = found - begin(); i > 0 && max_end[i - 1] > byte_offset; --i)
+			{
+				const member_layout_entry& ent = (*this)[i - 1];
+				// >= so that among equals we end up with the first declared
+				if (ent.covers(byte_offset) && (!best || ent.nesting >= best->nesting)) best = &ent;
+			}
+			return best;
+		}
+		member_layout_table::const_iterator
+		member_layout_table::first_starting_at(Dwarf_Unsigned byte_offset) const
+		{
+			auto found = std::lower_bound(begin(), end(), byte_offset,
+				[](const member_layout_entry& ent, Dwarf_Unsigned off) {
+					return ent.byte_offset < off;
+				});
+			if (found != end() && found->byte_offset == byte_offset) return found;
+			return end();
+		}
+
 		bool variable_die::has_static_storage() const
 		{
 			// don't bother testing whether we have an enclosing subprogram -- too expensive
@@ -3447,22 +4138,17 @@ namespace dwarf
 			}
 			else
 			{
-				/* If we have an indirection here, we will get some memory access 
-				 * happening, and our evaluator should bail out. Q: how? A. DW_OP_deref
-				 * has no implementation, because we don't pass a memory. 
-				 *
-				 * FIXME: when we add support for memory operations, the error we
-				 * get will be different, and we need to update the catch case. */
-				try {
-					return expr::evaluator(
-						data_member_location->at(0), 
-						self.enclosing_cu().spec_here(), 
-						std::stack<Dwarf_Unsigned>(std::deque<Dwarf_Unsigned>(1, 0UL))).tos();
-				} 
-				catch (expr::Not_supported)
+				/* Work out the closed form rather than running the expression.
+				 * If there's an indirection here (as for virtual bases), the
+				 * offset depends on the object, so we come out DYNAMIC. A
+				 * constant is what we'd get by evaluating with the object at 0. */
+				expr::closed_form f = expr::symbolic_eval(data_member_location->at(0), true);
+				if (!f.is_value && (f.kind == expr::closed_form::OBJECT_RELATIVE
+					|| f.kind == expr::closed_form::CONSTANT))
 				{
-					goto location_not_understood;
+					return opt<Dwarf_Unsigned>(f.offset);
 				}
+				goto location_not_understood;
 			}
 		location_not_understood:
 				// error
@@ -3598,10 +4284,10 @@ namespace dwarf
 					}
 					
 					auto loclist = found_location->second.get_loclist();
-					std::vector<std::pair<dwarf::encap::loc_expr, Dwarf_Unsigned> > expr_pieces;
+					dwarf::encap::loc_expr static_expr;
 					try
 					{
-						expr_pieces = loclist.loc_for_vaddr(0).pieces();
+						static_expr = loclist.loc_for_vaddr(0);
 					}
 					catch (No_entry)
 					{
@@ -3610,26 +4296,58 @@ namespace dwarf
 							debug(2) << "Vaddr-dependent static location " << *this << endl;
 						}
 						else debug(2) << "Static var with no location: " << *this << endl;
-						//if (loclist.size() > 0)
-						//{
-						//	expr_pieces = loclist.begin()->pieces();
-						//}
-						/*else*/ goto out;
+						goto out;
 					}
 					
-					try
 					{
+						/* Constant pieces are folded symbolically, so a well-formed
+						 * static location never reaches the evaluator proper; one that
+						 * does wants registers or memory we don't have, and throws. */
+						expr::composite_location pieces;
+						try
+						{
+							pieces = expr::eval_pieces(static_expr.data(),
+								static_expr.data() + static_expr.size(), this->get_spec(r));
+						}
+						catch (No_entry)
+						{
+							debug() << "Non-constant static location in " << *this << endl;
+							goto out;
+						}
+						catch (expr::Not_supported)
+						{
+							debug() << "Non-constant static location in " << *this << endl;
+							goto out;
+						}
+						/* Check every piece before inserting any, so that we give
+						 * no intervals at all rather than some of them. */
+						for (auto i = pieces.begin(); i != pieces.end(); ++i)
+						{
+							/* A static location should be a constant address. */
+							if (i->kind != expr::location_piece::ADDRESS)
+							{
+								debug() << "Non-address piece in static location of " << *this << endl;
+								goto out;
+							}
+							/* Our intervals are of bytes, so we can't say which
+							 * addresses hold part of a piece that starts or ends
+							 * partway through a byte. */
+							if (!i->is_byte_aligned())
+							{
+								debug() << "Bit piece not on byte boundaries in static location of "
+									<< *this << endl;
+								goto out;
+							}
+						}
 						Dwarf_Off current_offset_within_object = 0UL;
-						for (auto i = expr_pieces.begin(); i != expr_pieces.end(); ++i)
+						for (auto i = pieces.begin(); i != pieces.end(); ++i)
 						{
-							/* Evaluate this piece. */
-							Dwarf_Unsigned piece_size = i->second;
-							Dwarf_Unsigned piece_start = expr::evaluator(i->first,
-								this->get_spec(r)).tos();
+							Dwarf_Unsigned piece_start = i->value + i->byte_offset();
+							Dwarf_Unsigned piece_size = i->byte_size();
 
 							/* If we have only one piece, it means there might be no DW_OP_piece,
 							 * so the size of the piece will be unreliable (possibly zero). */
-							if (expr_pieces.size() == 1 && expr_pieces.begin()->second == 0)
+							if (pieces.size() == 1 && i->bit_size == 0)
 							{
 								piece_size = byte_size;
 							}
@@ -3643,12 +4361,6 @@ namespace dwarf
 						}
 						assert(current_offset_within_object == byte_size);
 					}
-					catch (expr::Not_supported)
-					{
-						// some opcode we don't recognise
-						debug() << "Unrecognised opcode in " << *this << endl;
-						goto out;
-					}
 
 				}
 				else if (sym_resolve &&
@@ -3815,6 +4527,161 @@ namespace dwarf
 
 			forward_constructors(super, frame_subobject_iterator)
 		};
+/* from spec::subprogram_die */
+		shared_ptr<const expr::compiled_loclist> subprogram_die::get_compiled_frame_base() const
+		{
+			auto& cache = get_root().compiled_frame_base_cache;
+			auto found = cache.find(get_offset());
+			if (found != cache.end()) return found->second;
+			assert(this->get_frame_base());
+			auto p_compiled = std::make_shared<const expr::compiled_loclist>(*this->get_frame_base());
+			cache.insert(make_pair(get_offset(), p_compiled));
+			return p_compiled;
+		}
+		shared_ptr<const frame_layout> subprogram_die::get_frame_layout() const
+		{
+			auto& cache = get_root().frame_layout_cache;
+			auto found = cache.find(get_offset());
+			if (found != cache.end()) return found->second;
+			auto p_layout = std::make_shared<frame_layout>();
+			root_die& r = get_root();
+			auto i = find_self();
+			assert(i != iterator_base::END);
+			
+			/* Walk the same DIEs, in the same order, that the slow path in
+			 * spans_addr_in_frame_locals_or_args would, collecting a piece for
+			 * every loclist element that is frame-base-relative. */
+			struct piece
+			{
+				Dwarf_Addr lopc;
+				Dwarf_Addr hipc;
+				frame_layout_entry ent;
+			};
+			vector<piece> pieces;
+			auto child = r.first_child(i);
+			if (child != iterator_base::END)
+			{
+				frame_subobject_iterator start_iter(child);
+				unsigned initial_depth = start_iter.depth();
+				unsigned ordinal = 0;
+				for (auto i_bfs = start_iter;
+						i_bfs.depth() >= initial_depth;
+						++i_bfs)
+				{
+					auto with_stack_loc = dynamic_cast<with_dynamic_location_die*>(&i_bfs.dereference());
+					if (!with_stack_loc) continue;
+					frame_layout_entry ent = { 0, 0, ordinal++, i_bfs.offset_here(),
+						(unsigned short) i_bfs.depth() };
+					if (with_stack_loc->location_requires_object_base())
+					{
+						p_layout->others.push_back(ent);
+						continue;
+					}
+					auto attrs = i_bfs->copy_attrs();
+					auto found_loc = attrs.find(DW_AT_location);
+					// no location means spans_addr would say no, so leave it out
+					if (found_loc == attrs.end()) continue;
+					iterator_df<type_die> t = with_stack_loc->find_type();
+					opt<Dwarf_Unsigned> opt_size = t ? t->calculate_byte_size() : opt<Dwarf_Unsigned>();
+					/* Take the entries as the evaluator would see them, i.e.
+					 * with base address selection entries resolved. */
+					expr::compiled_loclist compiled(found_loc->second.get_loclist());
+					bool all_fbreg = !!opt_size;
+					for (auto i_ent = compiled.entries.begin(); all_fbreg && i_ent != compiled.entries.end(); ++i_ent)
+					{
+						all_fbreg = (i_ent->e.kind == expr::closed_form::FRAME_BASE_RELATIVE
+							&& !i_ent->e.is_value);
+					}
+					if (!all_fbreg)
+					{
+						debug(2) << "Frame layout of " << summary() << " can't place "
+							<< i_bfs->summary() << "; will evaluate it per query" << endl;
+						p_layout->others.push_back(ent);
+						continue;
+					}
+					ent.byte_size = *opt_size;
+					// the entries are disjoint, overlaps resolved as the evaluator would
+					for (auto i_ent = compiled.entries.begin(); i_ent != compiled.entries.end(); ++i_ent)
+					{
+						ent.fb_offset = i_ent->e.offset;
+						pieces.push_back(piece { i_ent->lopc, i_ent->hipc, ent });
+					}
+				}
+			}
+			
+			/* Split the vaddr space at every piece boundary, then add each
+			 * piece to every sub-range it spans. */
+			vector<Dwarf_Addr> bounds;
+			for (auto i_piece = pieces.begin(); i_piece != pieces.end(); ++i_piece)
+			{
+				bounds.push_back(i_piece->lopc);
+				bounds.push_back(i_piece->hipc);
+			}
+			std::sort(bounds.begin(), bounds.end());
+			bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+			vector<frame_layout_range> ranges(bounds.size() > 0 ? bounds.size() - 1 : 0);
+			for (unsigned k = 0; k < ranges.size(); ++k)
+			{
+				ranges[k].lopc = bounds[k];
+				ranges[k].hipc = bounds[k + 1];
+			}
+			for (auto i_piece = pieces.begin(); i_piece != pieces.end(); ++i_piece)
+			{
+				unsigned k_begin = std::lower_bound(bounds.begin(), bounds.end(), i_piece->lopc)
+					- bounds.begin();
+				unsigned k_end = std::lower_bound(bounds.begin(), bounds.end(), i_piece->hipc)
+					- bounds.begin();
+				for (unsigned k = k_begin; k < k_end; ++k) ranges[k].push_back(i_piece->ent);
+			}
+			for (auto i_range = ranges.begin(); i_range != ranges.end(); ++i_range)
+			{
+				if (i_range->empty()) continue;
+				std::sort(i_range->begin(), i_range->end(),
+					[](const frame_layout_entry& e1, const frame_layout_entry& e2) {
+						return e1.fb_offset < e2.fb_offset
+							|| (e1.fb_offset == e2.fb_offset && e1.ordinal < e2.ordinal);
+					});
+				Dwarf_Signed max_end_so_far = std::numeric_limits<Dwarf_Signed>::min();
+				for (auto i_ent = i_range->begin(); i_ent != i_range->end(); ++i_ent)
+				{
+					Dwarf_Signed end = i_ent->fb_offset + (Dwarf_Signed) i_ent->byte_size;
+					if (end > max_end_so_far) max_end_so_far = end;
+					i_range->max_end.push_back(max_end_so_far);
+				}
+				p_layout->ranges.push_back(std::move(*i_range));
+			}
+			debug(2) << "Frame layout of " << summary() << " has "
+				<< p_layout->ranges.size() << " sub-ranges and "
+				<< p_layout->others.size() << " DIEs needing evaluation" << endl;
+			cache.insert(make_pair(get_offset(), p_layout));
+			return p_layout;
+		}
+		const frame_layout_range *
+		frame_layout::range_for_vaddr(Dwarf_Addr vaddr) const
+		{
+			auto found = std::upper_bound(ranges.begin(), ranges.end(), vaddr,
+				[](Dwarf_Addr addr, const frame_layout_range& range) {
+					return addr < range.lopc;
+				});
+			if (found == ranges.begin()) return nullptr;
+			--found;
+			return (vaddr < found->hipc) ? &*found : nullptr;
+		}
+		const frame_layout_entry *
+		frame_layout_range::first_covering(Dwarf_Signed fb_offset) const
+		{
+			auto found = std::upper_bound(begin(), end(), fb_offset,
+				[](Dwarf_Signed off, const frame_layout_entry& ent) {
+					return off < ent.fb_offset;
+				});
+			const frame_layout_entry *best = nullptr;
+			for (unsigned i = found - begin(); i > 0 && max_end[i - 1] > fb_offset; --i)
+			{
+				const frame_layout_entry& ent = (*this)[i - 1];
+				if (ent.covers(fb_offset) && (!best || ent.ordinal < best->ordinal)) best = &ent;
+			}
+			return best;
+		}
 /* from spec::subprogram_die */
 		opt< pair<Dwarf_Off, iterator_df<with_dynamic_location_die> > >
 		subprogram_die::spans_addr_in_frame_locals_or_args( 
@@ -3833,7 +4700,6 @@ namespace dwarf
 			assert(i != iterator_base::END);
 			
 			// Calculate the vaddr which selects a loclist element
-			auto frame_base_loclist = *get_frame_base();
 			iterator_df<compile_unit_die> enclosing_cu
 			 = r.cu_pos(i.enclosing_cu_offset_here());
 			debug(2) << "Enclosing CU is " << enclosing_cu->summary() << endl;
@@ -3841,43 +4707,41 @@ namespace dwarf
 			assert(low_pc <= dieset_relative_ip);
 			Dwarf_Addr vaddr = dieset_relative_ip - low_pc;
 			/* Now calculate our frame base address. */
-			auto frame_base_addr = expr::evaluator(
-				frame_base_loclist,
-				vaddr,
-				get_spec(r),
-				p_regs).tos();
+			Dwarf_Signed frame_base_addr = get_compiled_frame_base()->eval(vaddr, p_regs);
 			if (out_frame_base) *out_frame_base = frame_base_addr;
 			
-			auto child = r.first_child(i);
-			if (child == iterator_base::END) return return_type();
-			/* Now we walk children
-			 * (not just immediate children, because more might hide under lexical_blocks), 
-			 * looking for with_dynamic_location_dies, and 
-			 * call spans_addr on what we find.
-			 * We skip contained DIEs that do not contain objects located in this frame. 
+			/* Now we look for stack-located children
+			 * (not just immediate children, because more might hide under lexical_blocks).
+			 * Most are at a fixed offset from the frame base, so the cached layout
+			 * answers for them; we only call spans_addr on the rest. To give the
+			 * same answer as walking the children in order, any of those
+			 * that come before the layout's answer get the first go.
 			 */
-			frame_subobject_iterator start_iter(child);
-			debug(2) << "Exploring stack-located children of " << summary() << std::endl;
-			unsigned initial_depth = start_iter.depth();
-			for (auto i_bfs = start_iter;
-					i_bfs.depth() >= initial_depth;
-					++i_bfs)
+			shared_ptr<const frame_layout> p_layout = get_frame_layout();
+			const frame_layout& layout = *p_layout;
+			const frame_layout_entry *found = nullptr;
+			const frame_layout_range *p_range = layout.range_for_vaddr(vaddr);
+			if (p_range) found = p_range->first_covering(
+				(Dwarf_Signed) absolute_addr - frame_base_addr);
+			for (auto i_other = layout.others.begin();
+					i_other != layout.others.end() && (!found || i_other->ordinal < found->ordinal);
+					++i_other)
 			{
+				auto i_die = r.pos< iterator_df<with_dynamic_location_die> >(
+					i_other->die_off, i_other->die_depth);
 				debug(2) << "Considering whether DIE has stack location: " 
-					<< i_bfs->summary() << std::endl;
-				auto with_stack_loc = dynamic_cast<with_dynamic_location_die*>(&i_bfs.dereference());
-				if (!with_stack_loc) continue;
-				
-				opt<Dwarf_Off> result = with_stack_loc->spans_addr(absolute_addr,
+					<< i_die->summary() << std::endl;
+				opt<Dwarf_Off> result = i_die->spans_addr(absolute_addr,
 					frame_base_addr,
 					r, 
 					dieset_relative_ip,
 					p_regs);
-				if (result) return make_pair(
-					*result, 
-					iterator_df<with_dynamic_location_die>(i_bfs)
-				);
+				if (result) return make_pair(*result, i_die);
 			}
+			if (found) return make_pair(
+				(Dwarf_Off) (absolute_addr - (frame_base_addr + found->fb_offset)),
+				r.pos< iterator_df<with_dynamic_location_die> >(found->die_off, found->die_depth)
+			);
 			return return_type();
 		}
 		iterator_df<type_die> subprogram_die::get_return_type() const
@@ -4160,9 +5024,7 @@ namespace dwarf
 					// we need to create
 					// where to create -- new CU? yes, I guess so
 					auto cu = get_root().get_or_create_synthetic_cu();
-					auto created = get_root().make_new(cu, DW_TAG_base_type);
-					auto& attrs = dynamic_cast<core::in_memory_abstract_die&>(created.dereference())
-						.attrs();
+					encap::attribute_map attrs;
 					encap::attribute_value v_name(*bt->get_name()); // must have a name
 					attrs.insert(make_pair(DW_AT_name, v_name));
 					encap::attribute_value v_bit_size(effective_bit_size);
@@ -4177,6 +5039,7 @@ namespace dwarf
 						1 + (effective_bit_offset + effective_bit_size) / 8;
 					encap::attribute_value v_byte_size(effective_byte_size);
 					attrs.insert(make_pair(DW_AT_byte_size, v_byte_size));
+					auto created = get_root().make_new_synthetic(cu, DW_TAG_base_type, attrs);
 					// debugging
 					get_root().print_tree(std::move(cu), debug(2));
 					return created;
@@ -4202,14 +5065,11 @@ namespace dwarf
 				Dwarf_Addr frame_base_addr,
 				root_die& r, 
 				Dwarf_Off dieset_relative_ip,
-				expr::regs *p_regs/* = 0*/) const
+				expr::regs *p_regs/* = 0*/,
+				expr::memory *p_mem/* = 0*/) const
 		{
-			auto attrs = copy_attrs();
-			assert(attrs.find(DW_AT_location) != attrs.end());
-			
 			/* We have to find ourselves. Well, almost -- enclosing CU. */
-			auto found = r.cu_pos(get_enclosing_cu_offset());
-			iterator_df<compile_unit_die> i_cu = found;
+			iterator_df<compile_unit_die> i_cu = r.cu_pos(get_enclosing_cu_offset());
 			assert(i_cu != iterator_base::END);
 			Dwarf_Addr dieset_relative_cu_base_ip
 			 = i_cu->get_low_pc() ? i_cu->get_low_pc()->addr : 0;
@@ -4223,49 +5083,61 @@ namespace dwarf
 				throw No_entry();
 			}
 			
-			auto& loclist = attrs.find(DW_AT_location)->second.get_loclist();
-			auto intervals = loclist.intervals();
-			assert(intervals.begin() != intervals.end());
-			auto first_interval = intervals.begin();
-			auto last_interval = intervals.end(); --last_interval;
-			encap::loc_expr fb_loc_expr((Dwarf_Unsigned[]) { DW_OP_plus_uconst, frame_base_addr }, 
-					first_interval->lower(), last_interval->upper());
-			encap::loclist fb_loclist(fb_loc_expr);
-			
-			auto rewritten_loclist = encap::rewrite_loclist_in_terms_of_cfa(
-				loclist, 
-				r.get_frame_section(),
-				fb_loclist
-			);
-			debug(2) << "After rewriting, loclist is " << rewritten_loclist << endl;
-			
-			return (Dwarf_Addr) expr::evaluator(
-				rewritten_loclist,
+			return (Dwarf_Addr) get_compiled_stack_location()->eval(
 				dieset_relative_ip // needs to be CU-relative
 				 - dieset_relative_cu_base_ip,
-				found.spec_here(),
 				p_regs,
-				frame_base_addr).tos();
+				frame_base_addr,
+				opt<Dwarf_Unsigned>(),
+				p_mem);
+		}
+		shared_ptr<const expr::compiled_loclist>
+		with_dynamic_location_die::get_compiled_stack_location() const
+		{
+			auto& cache = get_root().compiled_stack_location_cache;
+			auto found = cache.find(get_offset());
+			if (found != cache.end()) return found->second;
+			assert(has_attr(DW_AT_location));
+			/* Rewrite register-relative steps in terms of the CFA, where the
+			 * CFI lets us. That doesn't depend on the frame base, which we
+			 * supply when evaluating. */
+			auto rewritten_loclist = encap::rewrite_loclist_in_terms_of_cfa(
+				attr(DW_AT_location).get_loclist(),
+				get_root().get_frame_section(),
+				opt<const encap::loclist&>()
+			);
+			debug(2) << "After rewriting, loclist is " << rewritten_loclist << endl;
+			auto p_compiled = std::make_shared<const expr::compiled_loclist>(rewritten_loclist);
+			cache.insert(make_pair(get_offset(), p_compiled));
+			return p_compiled;
 		}
 		Dwarf_Addr
 		with_dynamic_location_die::calculate_addr_in_object(
 				Dwarf_Addr object_base_addr,
 				root_die& r, 
 				Dwarf_Off dieset_relative_ip,
-				expr::regs *p_regs /*= 0*/) const
+				expr::regs *p_regs /*= 0*/,
+				expr::memory *p_mem /*= 0*/) const
 		{
-			auto attrs = copy_attrs();
 			iterator_df<compile_unit_die> i_cu = r.cu_pos(get_enclosing_cu_offset());
-			assert(attrs.find(DW_AT_data_member_location) != attrs.end());
-			return (Dwarf_Addr) expr::evaluator(
-				attrs.find(DW_AT_data_member_location)->second.get_loclist(),
+			return (Dwarf_Addr) get_compiled_dynamic_location()->eval(
 				dieset_relative_ip == 0 ? 0 : // if we specify it, needs to be CU-relative
 				 - (i_cu->get_low_pc() ? 
 				 	i_cu->get_low_pc()->addr : (Dwarf_Addr)0),
-				i_cu.spec_here(), 
 				p_regs,
-				object_base_addr, // ignored
-				std::stack<Dwarf_Unsigned>(std::deque<Dwarf_Unsigned>(1, object_base_addr))).tos();
+				opt<Dwarf_Signed>(),
+				object_base_addr,
+				p_mem);
+		}
+		shared_ptr<const expr::compiled_loclist>
+		with_dynamic_location_die::get_compiled_dynamic_location() const
+		{
+			auto& cache = get_root().compiled_location_cache;
+			auto found = cache.find(get_offset());
+			if (found != cache.end()) return found->second;
+			auto p_compiled = std::make_shared<const expr::compiled_loclist>(get_dynamic_location());
+			cache.insert(make_pair(get_offset(), p_compiled));
+			return p_compiled;
 		}
 /* from spec::with_named_children_die */
 //         std::shared_ptr<spec::basic_die>
@@ -7,6 +7,9 @@
  */
 
 #include <limits>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
 #include <map>
 #include <set>
 #include <srk31/endian.hpp>
@@ -36,20 +39,40 @@ namespace dwarf
 		using namespace dwarf::lib;
 		using core::debug;
 		
-		evaluator::evaluator(const encap::loclist& loclist,
-			Dwarf_Addr vaddr,
-			const ::dwarf::spec::abstract_def& spec,
-			regs *p_regs,
-			opt<Dwarf_Signed> frame_base,
-			const std::stack<Dwarf_Unsigned>& initial_stack)
-		: m_stack(initial_stack), spec(spec), p_regs(p_regs), tos_is_value(false), frame_base(frame_base)
+		/* The arithmetic ops whose C++ counterparts can be undefined. Stack
+		 * values are two's complement and wrap, so we work unsigned; shifts
+		 * by the width or more give what shifting a bit at a time would. */
+		static inline Dwarf_Unsigned op_shl(Dwarf_Unsigned val, Dwarf_Unsigned n)
+		{ return n >= 8 * sizeof val ? 0 : val << n; }
+		static inline Dwarf_Unsigned op_shr(Dwarf_Unsigned val, Dwarf_Unsigned n)
+		{ return n >= 8 * sizeof val ? 0 : val >> n; }
+		static inline Dwarf_Unsigned op_shra(Dwarf_Unsigned val, Dwarf_Unsigned n)
+		{
+			if (n >= 8 * sizeof val) n = 8 * sizeof val - 1;
+			return (Dwarf_Unsigned) ((Dwarf_Signed) val >> n);
+		}
+		static inline Dwarf_Unsigned op_neg(Dwarf_Unsigned val)
+		{ return 0 - val; }
+		static inline Dwarf_Unsigned op_abs(Dwarf_Unsigned val)
+		{ return (Dwarf_Signed) val < 0 ? 0 - val : val; }
+		/* Divisor must be nonzero. DW_OP_div is signed, DW_OP_mod unsigned
+		 * (DWARF 4 sec. 2.5.1.4); dividing the most negative value by -1
+		 * traps, so negate instead. */
+		static inline Dwarf_Unsigned op_div(Dwarf_Unsigned dividend, Dwarf_Unsigned divisor)
+		{
+			if ((Dwarf_Signed) divisor == -1) return op_neg(dividend);
+			return (Dwarf_Unsigned) ((Dwarf_Signed) dividend / (Dwarf_Signed) divisor);
+		}
+		static inline Dwarf_Unsigned op_mod(Dwarf_Unsigned dividend, Dwarf_Unsigned divisor)
+		{ return dividend % divisor; }
+		
+		void evaluator::copy_from_loclist(const encap::loclist& loclist, Dwarf_Addr vaddr)
 		{
 			// sanity check while I suspect stack corruption
 			assert(vaddr < 0x00008000000000ULL
 			|| 	vaddr == 0xffffffffULL
 			||  vaddr == 0xffffffffffffffffULL);
 			
-			i = expr.begin();
 			Dwarf_Addr current_vaddr_base = 0; // relative to CU "applicable base" (Dwarf 3 sec 3.1)
 			/* Search through loc expressions for the one that matches vaddr. */
 			for (auto i_loc_expr = loclist.begin();
@@ -81,8 +104,6 @@ namespace dwarf
 					&& vaddr < i_loc_expr->hipc + current_vaddr_base))
 				{
 					expr = *i_loc_expr/*->m_expr*/;
-					i = expr.begin();
-					eval();
 					return;
 				}
 			}
@@ -96,15 +117,19 @@ namespace dwarf
 		
 		void evaluator::eval()
 		{
-			if (i != expr.end() && i != expr.begin())
+			const Dwarf_Loc *const begin = code_begin();
+			const Dwarf_Loc *const end = code_end();
+			const Dwarf_Loc *i = begin + pos;
+			if (i != end && i != begin)
 			{
 				/* This happens when we stopped at a DW_OP_piece argument. 
 				 * Advance the opcode iterator and clear the stack. */
 				++i;
 				while (!m_stack.empty()) m_stack.pop();
 			}
-			opt<std::string> error_detail;
-			while (i != expr.end())
+			const unsigned MAX_BRANCHES = 1u<<20;
+			unsigned nbranches = 0;
+			while (i != end)
 			{
 				// FIXME: be more descriminate -- do we want to propagate valueness? probably not
 				tos_is_value = false;
@@ -124,37 +149,109 @@ namespace dwarf
 					case DW_OP_consts:
 						m_stack.push((Dwarf_Signed) i->lr_number);
 						break;
-				   case DW_OP_plus_uconst: {
-						int tos = m_stack.top();
-						m_stack.pop();
+					/* Arithmetic and logic. We keep values untyped, as
+					 * address-sized-or-bigger integers (the DWARF 5 "generic
+					 * type"); signed operations reinterpret them. */
+					case DW_OP_plus_uconst: {
+						Dwarf_Unsigned tos = m_stack.top(); m_stack.pop();
 						m_stack.push(tos + i->lr_number);
 					} break;
-					case DW_OP_plus: {
-						int arg1 = m_stack.top(); m_stack.pop();
-						int arg2 = m_stack.top(); m_stack.pop();
-						m_stack.push(arg1 + arg2);
+#define binary_op(op, type) { \
+						type arg1 = (type) m_stack.top(); m_stack.pop(); \
+						type arg2 = (type) m_stack.top(); m_stack.pop(); \
+						m_stack.push((Dwarf_Unsigned) (arg2 op arg1)); \
+					}
+					case DW_OP_plus:  binary_op(+, Dwarf_Unsigned) break;
+					case DW_OP_minus: binary_op(-, Dwarf_Unsigned) break;
+					case DW_OP_mul:   binary_op(*, Dwarf_Unsigned) break;
+					case DW_OP_and:   binary_op(&, Dwarf_Unsigned) break;
+					case DW_OP_or:    binary_op(|, Dwarf_Unsigned) break;
+					case DW_OP_xor:   binary_op(^, Dwarf_Unsigned) break;
+					/* Comparisons are signed, and push 1 or 0. */
+					case DW_OP_eq:    binary_op(==, Dwarf_Signed) break;
+					case DW_OP_ne:    binary_op(!=, Dwarf_Signed) break;
+					case DW_OP_lt:    binary_op(<, Dwarf_Signed) break;
+					case DW_OP_le:    binary_op(<=, Dwarf_Signed) break;
+					case DW_OP_gt:    binary_op(>, Dwarf_Signed) break;
+					case DW_OP_ge:    binary_op(>=, Dwarf_Signed) break;
+#undef binary_op
+#define binary_fn(fn) { \
+						Dwarf_Unsigned arg1 = m_stack.top(); m_stack.pop(); \
+						Dwarf_Unsigned arg2 = m_stack.top(); m_stack.pop(); \
+						m_stack.push(fn(arg2, arg1)); \
+					}
+					case DW_OP_shl:   binary_fn(op_shl) break;
+					case DW_OP_shr:   binary_fn(op_shr) break;
+					case DW_OP_shra:  binary_fn(op_shra) break;
+#undef binary_fn
+					case DW_OP_div:
+					case DW_OP_mod: {
+						Dwarf_Unsigned arg1 = m_stack.top(); m_stack.pop();
+						Dwarf_Unsigned arg2 = m_stack.top(); m_stack.pop();
+						if (arg1 == 0) throw Not_supported("division by zero");
+						m_stack.push(i->lr_atom == DW_OP_div ? op_div(arg2, arg1) : op_mod(arg2, arg1));
 					} break;
-					case DW_OP_shl: {
-						int arg1 = m_stack.top(); m_stack.pop();
-						int arg2 = m_stack.top(); m_stack.pop();
-						m_stack.push(arg2 << arg1);
+					case DW_OP_abs: {
+						Dwarf_Unsigned tos = m_stack.top(); m_stack.pop();
+						m_stack.push(op_abs(tos));
 					} break;
-					case DW_OP_shr: {
-						int arg1 = m_stack.top(); m_stack.pop();
-						int arg2 = m_stack.top(); m_stack.pop();
-						m_stack.push((int)((unsigned) arg2 >> arg1));
+					case DW_OP_neg: {
+						Dwarf_Unsigned tos = m_stack.top(); m_stack.pop();
+						m_stack.push(op_neg(tos));
 					} break;
-					case DW_OP_shra: {
-						int arg1 = m_stack.top(); m_stack.pop();
-						int arg2 = m_stack.top(); m_stack.pop();
-						m_stack.push(arg2 >> arg1);
+					case DW_OP_not: {
+						Dwarf_Unsigned tos = m_stack.top(); m_stack.pop();
+						m_stack.push(~tos);
 					} break;
+					/* Stack manipulation. */
+					case DW_OP_dup:
+						m_stack.push(m_stack.top());
+						break;
+					case DW_OP_drop:
+						m_stack.pop();
+						break;
+					case DW_OP_over:
+						m_stack.push(m_stack.at_depth(1));
+						break;
+					case DW_OP_pick:
+						m_stack.push(m_stack.at_depth(i->lr_number));
+						break;
+					case DW_OP_swap: {
+						Dwarf_Unsigned arg1 = m_stack.top(); m_stack.pop();
+						Dwarf_Unsigned arg2 = m_stack.top(); m_stack.pop();
+						m_stack.push(arg1);
+						m_stack.push(arg2);
+					} break;
+					case DW_OP_rot: {
+						// the top three entries rotate: top becomes third, the others move up
+						Dwarf_Unsigned arg1 = m_stack.top(); m_stack.pop();
+						Dwarf_Unsigned arg2 = m_stack.top(); m_stack.pop();
+						Dwarf_Unsigned arg3 = m_stack.top(); m_stack.pop();
+						m_stack.push(arg1);
+						m_stack.push(arg3);
+						m_stack.push(arg2);
+					} break;
+					case DW_OP_nop:
+						break;
+					/* Control flow. Targets are byte offsets, but we have decoded
+					 * instructions, so map back using their lr_offsets. */
+					case DW_OP_skip:
+					case DW_OP_bra: {
+						if (i->lr_atom == DW_OP_bra)
+						{
+							Dwarf_Unsigned tos = m_stack.top(); m_stack.pop();
+							if (tos == 0) break;
+						}
+						// expressions can loop, so don't let them do so forever
+						if (++nbranches > MAX_BRANCHES) throw Not_supported("too many branches");
+						i = begin + jump_target(begin, end, i);
+					} continue;
 					case DW_OP_fbreg: {
-						if (!frame_base) goto logic_error;
-						m_stack.push(*frame_base + i->lr_number);
+						if (!frame_base) goto no_frame_base;
+						m_stack.push((Dwarf_Unsigned) *frame_base + i->lr_number);
 					} break;
 					case DW_OP_call_frame_cfa: {
-						if (!frame_base) goto logic_error;
+						if (!frame_base) goto no_frame_base;
 						m_stack.push(*frame_base);
 					} break;
 					case DW_OP_piece: {
@@ -163,6 +260,7 @@ namespace dwarf
 						 * to probe the piece size (by getting *i) and to resume by
 						 * calling eval() again. */
 						 ++i;
+						 pos = i - begin;
 					}	return;
 					case DW_OP_breg0:
 					case DW_OP_breg1:
@@ -200,7 +298,7 @@ namespace dwarf
 						/* the breg family get the contents of a register and add an offset */ 
 						if (!p_regs) goto no_regs;
 						int regnum = i->lr_atom - DW_OP_breg0;
-						m_stack.push(p_regs->get(regnum) + i->lr_number);
+						m_stack.push((Dwarf_Unsigned) p_regs->get(regnum) + i->lr_number);
 					} break;
 					case DW_OP_addr:
 					{
@@ -284,25 +382,148 @@ namespace dwarf
 						 * this. */
 						tos_is_value = true;
 						break;
-					case DW_OP_deref_size:
+					case DW_OP_regx:
+						if (!p_regs) goto no_regs;
+						m_stack.push(p_regs->get(i->lr_number));
+						break;
+					case DW_OP_bregx:
+						if (!p_regs) goto no_regs;
+						m_stack.push((Dwarf_Unsigned) p_regs->get(i->lr_number) + i->lr_number2);
+						break;
+					case /* DW_OP_regval_type */    0xa5:
+					case /* DW_OP_GNU_regval_type */ 0xf5:
+						/* The operands are the register and a base type DIE. We
+						 * don't do typed values, so just push the register. FIXME. */
+						if (!p_regs) goto no_regs;
+						m_stack.push(p_regs->get(i->lr_number));
+						break;
+					case /* DW_OP_convert */        0xa8:
+					case /* DW_OP_GNU_convert */    0xf7:
+					case /* DW_OP_reinterpret */    0xa9:
+					case /* DW_OP_GNU_reinterpret */ 0xf9:
+						/* Again we don't do typed values, so converting between
+						 * integer types of the generic size is the identity.
+						 * FIXME: truncation, sign extension and floating point. */
+						if (m_stack.empty()) throw Not_supported("operand stack underflow");
+						break;
+					/* Memory. */
 					case DW_OP_deref:
-						/* FIXME: we can do this one if we have p_mem analogous to p_regs. */
-						throw No_entry();
+					case DW_OP_deref_size:
+					case /* DW_OP_deref_type */     0xa6:
+					case /* DW_OP_GNU_deref_type */ 0xf6: {
+						if (!p_mem) throw No_entry();
+						if (i->lr_atom != DW_OP_deref
+							&& (i->lr_number == 0 || i->lr_number > p_mem->address_size()))
+						{
+							throw Not_supported("dereference size out of range");
+						}
+						unsigned nbytes = (i->lr_atom == DW_OP_deref)
+							? p_mem->address_size() : (unsigned) i->lr_number;
+						Dwarf_Addr addr = m_stack.top(); m_stack.pop();
+						m_stack.push(p_mem->read(addr, nbytes));
+					} break;
+					case DW_OP_xderef:
+					case DW_OP_xderef_size:
+					case /* DW_OP_xderef_type */    0xa7: {
+						if (!p_mem) throw No_entry();
+						if (i->lr_atom != DW_OP_xderef
+							&& (i->lr_number == 0 || i->lr_number > p_mem->address_size()))
+						{
+							throw Not_supported("dereference size out of range");
+						}
+						unsigned nbytes = (i->lr_atom == DW_OP_xderef)
+							? p_mem->address_size() : (unsigned) i->lr_number;
+						Dwarf_Addr addr = m_stack.top(); m_stack.pop();
+						Dwarf_Unsigned space = m_stack.top(); m_stack.pop();
+						m_stack.push(p_mem->read_in_space(space, addr, nbytes));
+					} break;
+					case DW_OP_push_object_address:
+						if (!object_address) throw No_entry();
+						m_stack.push(*object_address);
+						break;
+					case DW_OP_form_tls_address:
+					case DW_OP_GNU_push_tls_address: {
+						if (!p_mem) throw No_entry();
+						Dwarf_Unsigned offset = m_stack.top(); m_stack.pop();
+						m_stack.push(p_mem->tls_address(offset));
+					} break;
+					/* Things that aren't (just) addresses. */
+					case DW_OP_implicit_value: {
+						/* libdwarf gives us the block length and a pointer to the block. */
+						Dwarf_Unsigned len = i->lr_number;
+						const unsigned char *block = reinterpret_cast<const unsigned char *>(i->lr_number2);
+						if (len > sizeof (Dwarf_Unsigned) || !block)
+						{
+							throw Not_supported("implicit value wider than a stack slot");
+						}
+						// FIXME: assumes target byte order == host byte order
+						Dwarf_Unsigned value = 0;
+						memcpy(&value, block, len);
+						m_stack.push(value);
+						tos_is_value = true;
+					} break;
+					case /* DW_OP_implicit_pointer */     0xa0:
+					case /* DW_OP_GNU_implicit_pointer */ 0xf2:
+						/* The object has no address; record what it points to, and
+						 * stop, since there's nothing sensible to leave on the stack. */
+						implicit_pointer_target = make_pair(
+							(Dwarf_Off) i->lr_number, (Dwarf_Signed) i->lr_number2);
+						i = end;
+						continue;
+					case /* DW_OP_entry_value */     0xa3:
+					case /* DW_OP_GNU_entry_value */ 0xf3: {
+						/* The operand is a sub-expression, as a length and a
+						 * pointer to the block. We only handle the usual case,
+						 * a lone register, asking our regs for its entry value. */
+						if (!p_regs) goto no_regs;
+						const unsigned char *block = reinterpret_cast<const unsigned char *>(i->lr_number2);
+						const unsigned char *block_end = block + i->lr_number;
+						if (!block || block == block_end) throw Not_supported("empty entry value");
+						const unsigned char *cur = block + 1;
+						int regnum;
+						if (*block >= DW_OP_reg0 && *block <= DW_OP_reg31) regnum = *block - DW_OP_reg0;
+						else if (*block == DW_OP_regx) regnum = encap::read_uleb128(&cur, block_end);
+						else throw Not_supported("entry value of a non-register expression");
+						if (cur != block_end) throw Not_supported("entry value of a non-register expression");
+						m_stack.push(p_regs->get_at_entry(regnum));
+					} break;
 					default:
 						debug() << "Error: unrecognised opcode: " << spec.op_lookup(i->lr_atom) << std::endl;
 						throw Not_supported("unrecognised opcode");
 					no_regs:
 						debug() << "Warning: asked to evaluate register-dependent expression with no registers." << std::endl;
 						throw No_entry();
-					logic_error:
-						debug() << "Logic error in DWARF expression evaluator";
-						if (error_detail) debug() << ": " << *error_detail;
-						debug() << std::endl;
-						assert(false);
-						throw Not_supported(error_detail ? *error_detail : "unknown");
+					no_frame_base:
+						debug() << "Warning: asked to evaluate frame-base-dependent expression with no frame base." << std::endl;
+						throw No_entry();
 				}
 			i++;
 			}
+			pos = i - begin;
+		}
+		unsigned evaluator::jump_target(const Dwarf_Loc *begin, const Dwarf_Loc *end,
+			const Dwarf_Loc *i) const
+		{
+			/* The offset is a signed 2-byte constant, relative to the end of
+			 * this instruction, i.e. to the start of the next one. */
+			Dwarf_Unsigned next_offset = (i + 1 != end) ? (i + 1)->lr_offset : i->lr_offset + 3;
+			Dwarf_Signed displacement = (int16_t) i->lr_number;
+			/* Don't let a backward branch wrap around to somewhere huge. */
+			if (displacement < 0 && (Dwarf_Unsigned) -displacement > next_offset - begin->lr_offset)
+			{
+				throw Not_supported("branch before the start of the expression");
+			}
+			Dwarf_Unsigned target = next_offset + displacement;
+			auto found = std::lower_bound(begin, end, target,
+				[](const Dwarf_Loc& l, Dwarf_Unsigned off) { return l.lr_offset < off; });
+			/* Past the start of the last instruction means the end of the
+			 * expression. (We can't check it's exactly the end, since we
+			 * don't know how long the last instruction is.) */
+			if (found != end && found->lr_offset != target)
+			{
+				throw Not_supported("branch into the middle of an instruction");
+			}
+			return found - begin;
 		}
 		Dwarf_Unsigned eval(const encap::loclist& loclist,
 			Dwarf_Addr vaddr,
@@ -313,6 +534,649 @@ namespace dwarf
 		{
 			assert(false); return 0UL;
 		}
+
+		closed_form symbolic_eval(const Dwarf_Loc *first, const Dwarf_Loc *last,
+			bool object_pushed)
+		{
+			/* We run the expression with each stack slot holding a closed
+			 * form rather than a number, and give up as soon as some op's
+			 * result isn't one. Control flow gives up too, so we only ever
+			 * make one pass. Offsets wrap like the evaluator's arithmetic. */
+			const closed_form dynamic = { closed_form::DYNAMIC, -1, 0, false };
+			auto constant = [](Dwarf_Unsigned v) -> closed_form {
+				return closed_form { closed_form::CONSTANT, -1, (Dwarf_Signed) v, false };
+			};
+			auto add = [](Dwarf_Signed a, Dwarf_Unsigned b) -> Dwarf_Signed {
+				return (Dwarf_Signed) ((Dwarf_Unsigned) a + b);
+			};
+			vector<closed_form> st;
+			if (object_pushed) st.push_back(closed_form { closed_form::OBJECT_RELATIVE, -1, 0, false });
+			bool is_value = false;
+			for (const Dwarf_Loc *i = first; i != last; ++i)
+			{
+				is_value = false;
+				switch (i->lr_atom)
+				{
+					case DW_OP_addr:
+					case DW_OP_const1u: case DW_OP_const2u: case DW_OP_const4u: case DW_OP_const8u:
+					case DW_OP_const1s: case DW_OP_const2s: case DW_OP_const4s: case DW_OP_const8s:
+					case DW_OP_constu:
+					case DW_OP_consts:
+						st.push_back(constant(i->lr_number));
+						break;
+					case DW_OP_fbreg:
+						st.push_back(closed_form { closed_form::FRAME_BASE_RELATIVE, -1,
+							(Dwarf_Signed) i->lr_number, false });
+						break;
+					case DW_OP_call_frame_cfa:
+						st.push_back(closed_form { closed_form::CFA_RELATIVE, -1, 0, false });
+						break;
+					case DW_OP_bregx:
+						st.push_back(closed_form { closed_form::REGISTER_RELATIVE, (int) i->lr_number,
+							(Dwarf_Signed) i->lr_number2, false });
+						break;
+					case DW_OP_plus_uconst:
+						if (st.empty()) return dynamic;
+						st.back().offset = add(st.back().offset, i->lr_number);
+						break;
+					case DW_OP_plus: {
+						if (st.size() < 2) return dynamic;
+						closed_form arg1 = st.back(); st.pop_back();
+						closed_form arg2 = st.back(); st.pop_back();
+						// at most one side may have a base
+						if (arg1.kind != closed_form::CONSTANT) std::swap(arg1, arg2);
+						if (arg1.kind != closed_form::CONSTANT) return dynamic;
+						arg2.offset = add(arg2.offset, arg1.offset);
+						st.push_back(arg2);
+					} break;
+					case DW_OP_minus: {
+						if (st.size() < 2) return dynamic;
+						closed_form arg1 = st.back(); st.pop_back();
+						closed_form arg2 = st.back(); st.pop_back();
+						if (arg1.kind == closed_form::CONSTANT)
+						{
+							arg2.offset = add(arg2.offset, -(Dwarf_Unsigned) arg1.offset);
+							st.push_back(arg2);
+						}
+						// the same base on both sides cancels out
+						else if (arg1.kind == arg2.kind && arg1.regnum == arg2.regnum)
+						{
+							st.push_back(constant((Dwarf_Unsigned) arg2.offset - arg1.offset));
+						}
+						else return dynamic;
+					} break;
+					/* Anything else we can only do on constants. */
+#define constant_binary_op(op, type) { \
+						if (st.size() < 2) return dynamic; \
+						closed_form arg1 = st.back(); st.pop_back(); \
+						closed_form arg2 = st.back(); st.pop_back(); \
+						if (arg1.kind != closed_form::CONSTANT \
+						 || arg2.kind != closed_form::CONSTANT) return dynamic; \
+						st.push_back(constant((Dwarf_Unsigned) ((type) arg2.offset op (type) arg1.offset))); \
+					}
+					case DW_OP_mul:   constant_binary_op(*, Dwarf_Unsigned) break;
+					case DW_OP_and:   constant_binary_op(&, Dwarf_Unsigned) break;
+					case DW_OP_or:    constant_binary_op(|, Dwarf_Unsigned) break;
+					case DW_OP_xor:   constant_binary_op(^, Dwarf_Unsigned) break;
+					case DW_OP_eq:    constant_binary_op(==, Dwarf_Signed) break;
+					case DW_OP_ne:    constant_binary_op(!=, Dwarf_Signed) break;
+					case DW_OP_lt:    constant_binary_op(<, Dwarf_Signed) break;
+					case DW_OP_le:    constant_binary_op(<=, Dwarf_Signed) break;
+					case DW_OP_gt:    constant_binary_op(>, Dwarf_Signed) break;
+					case DW_OP_ge:    constant_binary_op(>=, Dwarf_Signed) break;
+#undef constant_binary_op
+#define constant_binary_fn(fn) { \
+						if (st.size() < 2) return dynamic; \
+						closed_form arg1 = st.back(); st.pop_back(); \
+						closed_form arg2 = st.back(); st.pop_back(); \
+						if (arg1.kind != closed_form::CONSTANT \
+						 || arg2.kind != closed_form::CONSTANT) return dynamic; \
+						st.push_back(constant(fn(arg2.offset, arg1.offset))); \
+					}
+					case DW_OP_shl:   constant_binary_fn(op_shl) break;
+					case DW_OP_shr:   constant_binary_fn(op_shr) break;
+					case DW_OP_shra:  constant_binary_fn(op_shra) break;
+#undef constant_binary_fn
+					case DW_OP_abs:
+					case DW_OP_neg:
+					case DW_OP_not: {
+						if (st.empty() || st.back().kind != closed_form::CONSTANT) return dynamic;
+						Dwarf_Unsigned v = st.back().offset; st.pop_back();
+						if (i->lr_atom == DW_OP_abs) st.push_back(constant(op_abs(v)));
+						else if (i->lr_atom == DW_OP_neg) st.push_back(constant(op_neg(v)));
+						else st.push_back(constant(~v));
+					} break;
+					case DW_OP_dup:
+						if (st.empty()) return dynamic;
+						st.push_back(st.back());
+						break;
+					case DW_OP_drop:
+						if (st.empty()) return dynamic;
+						st.pop_back();
+						break;
+					case DW_OP_over:
+					case DW_OP_pick: {
+						Dwarf_Unsigned depth = (i->lr_atom == DW_OP_over) ? 1 : i->lr_number;
+						if (depth >= st.size()) return dynamic;
+						st.push_back(st[st.size() - 1 - depth]);
+					} break;
+					case DW_OP_swap:
+						if (st.size() < 2) return dynamic;
+						std::swap(st[st.size() - 1], st[st.size() - 2]);
+						break;
+					case DW_OP_rot:
+						// as in the evaluator: top becomes third, the others move up
+						if (st.size() < 3) return dynamic;
+						std::rotate(st.end() - 3, st.end() - 1, st.end());
+						break;
+					case DW_OP_nop:
+						break;
+					case DW_OP_stack_value:
+						is_value = true;
+						break;
+					default:
+						if (i->lr_atom >= DW_OP_lit0 && i->lr_atom <= DW_OP_lit31)
+						{
+							st.push_back(constant(i->lr_atom - DW_OP_lit0));
+							break;
+						}
+						if (i->lr_atom >= DW_OP_breg0 && i->lr_atom <= DW_OP_breg31)
+						{
+							st.push_back(closed_form { closed_form::REGISTER_RELATIVE,
+								i->lr_atom - DW_OP_breg0, (Dwarf_Signed) i->lr_number, false });
+							break;
+						}
+						/* Memory, control flow, registers-as-locations, pieces,
+						 * division (which might trap) and so on. */
+						return dynamic;
+				}
+			}
+			if (st.empty()) return dynamic;
+			closed_form result = st.back();
+			result.is_value = is_value;
+			return result;
+		}
+
+		composite_location evaluator::pieces() const
+		{
+			return eval_pieces(code_begin(), code_end(), spec, p_regs, frame_base,
+				p_mem, object_address, m_initial_stack);
+		}
+		composite_location eval_pieces(const Dwarf_Loc *first, const Dwarf_Loc *last,
+			const ::dwarf::spec::abstract_def& spec,
+			regs *p_regs,
+			opt<Dwarf_Signed> frame_base,
+			memory *p_mem,
+			opt<Dwarf_Addr> object_address,
+			const operand_stack& initial_stack)
+		{
+			composite_location result;
+			const Dwarf_Loc *piece_begin = first;
+			for (const Dwarf_Loc *i = first; ; ++i)
+			{
+				bool at_end = (i == last);
+				if (!at_end && i->lr_atom != DW_OP_piece && i->lr_atom != DW_OP_bit_piece) continue;
+				// if we had pieces, we should have finished on one, so stop
+				if (at_end && piece_begin == i && !result.empty()) break;
+
+				/* [piece_begin, i) describes one piece. */
+				location_piece p = { location_piece::EMPTY, 0, 0, 0, 0 };
+				if (!at_end && i->lr_atom == DW_OP_piece) p.bit_size = 8 * i->lr_number;
+				else if (!at_end)
+				{
+					p.bit_size = i->lr_number;
+					p.bit_offset = i->lr_number2;
+				}
+				if (piece_begin == i) {} // no location, so EMPTY
+				else if (i - piece_begin == 1 && ((piece_begin->lr_atom >= DW_OP_reg0
+						&& piece_begin->lr_atom <= DW_OP_reg31)
+					|| piece_begin->lr_atom == DW_OP_regx))
+				{
+					/* The evaluator would give us the register's contents,
+					 * but here we want to say which register. */
+					p.kind = location_piece::REGISTER;
+					p.value = (piece_begin->lr_atom == DW_OP_regx) ? piece_begin->lr_number
+						: piece_begin->lr_atom - DW_OP_reg0;
+				}
+				else
+				{
+					/* symbolic_eval() starts from an empty stack, which only
+					 * the pieces after the first are sure to. */
+					bool from_initial = (piece_begin == first && !initial_stack.empty());
+					closed_form f = { closed_form::DYNAMIC, 0, 0, false };
+					if (!from_initial) f = symbolic_eval(piece_begin, i);
+					if (f.kind == closed_form::CONSTANT)
+					{
+						p.kind = f.is_value ? location_piece::VALUE : location_piece::ADDRESS;
+						p.value = f.offset;
+					}
+					else
+					{
+						evaluator e(piece_begin, i, spec, p_regs, frame_base,
+							from_initial ? initial_stack : operand_stack(), p_mem,
+							object_address);
+						if (e.implicit_pointer())
+						{
+							p.kind = location_piece::IMPLICIT_POINTER;
+							p.value = e.implicit_pointer()->first;
+							p.pointer_offset = e.implicit_pointer()->second;
+						}
+						else
+						{
+							p.kind = e.computed_value() ? location_piece::VALUE : location_piece::ADDRESS;
+							p.value = e.tos(true);
+						}
+					}
+				}
+				result.push_back(p);
+				if (at_end) break;
+				piece_begin = i + 1;
+			}
+			return result;
+		}
+
+		compiled_expr::compiled_expr(const encap::loc_expr& e)
+		 : closed_form(symbolic_eval(e, true)), p_spec(&e.spec)
+		{
+			/* We say the object is pushed, so that "plus_uconst N" and the
+			 * like come out OBJECT_RELATIVE. Other closed forms don't depend on
+			 * it, so are right whether or not eval() is given an object. */
+			if (kind == DYNAMIC) code.assign(e.begin(), e.end());
+		}
+		Dwarf_Unsigned compiled_expr::eval(regs *p_regs,
+			opt<Dwarf_Signed> frame_base,
+			opt<Dwarf_Unsigned> object_base,
+			memory *p_mem) const
+		{
+			switch (kind)
+			{
+				case CONSTANT:
+					return offset;
+				case OBJECT_RELATIVE:
+					if (!object_base) throw Not_supported("operand stack underflow");
+					return *object_base + offset;
+				case FRAME_BASE_RELATIVE:
+				case CFA_RELATIVE:
+					if (!frame_base) throw No_entry();
+					return (Dwarf_Unsigned) *frame_base + offset;
+				case REGISTER_RELATIVE:
+					if (!p_regs) throw No_entry();
+					return (Dwarf_Unsigned) p_regs->get(regnum) + offset;
+				case DYNAMIC:
+				default: {
+					const Dwarf_Loc *first = code.data();
+					const Dwarf_Loc *last = code.data() + code.size();
+					if (object_base) return evaluator(first, last, *p_spec, p_regs, frame_base,
+						{ *object_base }, p_mem).tos(true);
+					return evaluator(first, last, *p_spec, p_regs, frame_base, {}, p_mem).tos(true);
+				}
+			}
+		}
+		/* A regs over one frame of a batch, for when eval_batch has to
+		 * fall back to evaluating frame by frame. */
+		struct regs_columns_lane : public regs
+		{
+			const regs_columns *p_cols;
+			size_t k;
+			regs_columns_lane(const regs_columns *p_cols, size_t k) : p_cols(p_cols), k(k) {}
+			Dwarf_Signed get(int regnum)
+			{
+				const Dwarf_Signed *col = p_cols->column(regnum);
+				if (!col) throw No_entry();
+				return col[k];
+			}
+		};
+		void compiled_expr::eval_batch(size_t n, Dwarf_Unsigned *out,
+			const regs_columns *p_regs,
+			const Dwarf_Signed *frame_bases,
+			const Dwarf_Unsigned *object_bases,
+			memory *p_mem) const
+		{
+			switch (kind)
+			{
+				case CONSTANT:
+					for (size_t k = 0; k < n; ++k) out[k] = offset;
+					return;
+				case OBJECT_RELATIVE:
+					if (!object_bases) throw Not_supported("operand stack underflow");
+					for (size_t k = 0; k < n; ++k) out[k] = object_bases[k] + offset;
+					return;
+				case FRAME_BASE_RELATIVE:
+				case CFA_RELATIVE:
+					if (!frame_bases) throw No_entry();
+					for (size_t k = 0; k < n; ++k) out[k] = (Dwarf_Unsigned) frame_bases[k] + offset;
+					return;
+				case REGISTER_RELATIVE: {
+					const Dwarf_Signed *col = p_regs ? p_regs->column(regnum) : nullptr;
+					if (!col) throw No_entry();
+					for (size_t k = 0; k < n; ++k) out[k] = (Dwarf_Unsigned) col[k] + offset;
+				} return;
+				case DYNAMIC:
+				default:
+					if (eval_batch_arith(n, out, p_regs, frame_bases, object_bases)) return;
+					for (size_t k = 0; k < n; ++k)
+					{
+						regs_columns_lane lane(p_regs, k);
+						out[k] = eval(p_regs ? &lane : nullptr,
+							frame_bases ? opt<Dwarf_Signed>(frame_bases[k]) : opt<Dwarf_Signed>(),
+							object_bases ? opt<Dwarf_Unsigned>(object_bases[k]) : opt<Dwarf_Unsigned>(),
+							p_mem);
+					}
+					return;
+			}
+		}
+		bool compiled_expr::eval_batch_arith(size_t n, Dwarf_Unsigned *out,
+			const regs_columns *p_regs,
+			const Dwarf_Signed *frame_bases,
+			const Dwarf_Unsigned *object_bases) const
+		{
+			/* We can only go a column at a time if there is no control flow,
+			 * memory access or division (which might fault in some frames
+			 * but not others). Then the stack depth is the same in every
+			 * frame, so check it now. Anything we don't like, we leave to
+			 * the per-frame path, which will also report any errors. */
+			unsigned depth = object_bases ? 1 : 0;
+			unsigned max_depth = depth;
+			for (auto i = code.begin(); i != code.end(); ++i)
+			{
+				switch (i->lr_atom)
+				{
+					case DW_OP_addr:
+					case DW_OP_const1u: case DW_OP_const2u: case DW_OP_const4u: case DW_OP_const8u:
+					case DW_OP_const1s: case DW_OP_const2s: case DW_OP_const4s: case DW_OP_const8s:
+					case DW_OP_constu:
+					case DW_OP_consts:
+					case DW_OP_plus_uconst:
+					case DW_OP_abs:
+					case DW_OP_neg:
+					case DW_OP_not:
+					case DW_OP_plus: case DW_OP_minus: case DW_OP_mul:
+					case DW_OP_and: case DW_OP_or: case DW_OP_xor:
+					case DW_OP_shl: case DW_OP_shr: case DW_OP_shra:
+					case DW_OP_eq: case DW_OP_ne: case DW_OP_lt:
+					case DW_OP_le: case DW_OP_gt: case DW_OP_ge:
+					case DW_OP_dup:
+					case DW_OP_drop:
+					case DW_OP_over:
+					case DW_OP_swap:
+					case DW_OP_rot:
+					case DW_OP_nop:
+					case DW_OP_stack_value:
+						break;
+					case DW_OP_pick:
+						if (i->lr_number >= operand_stack::CAPACITY) return false;
+						break;
+					case DW_OP_fbreg:
+					case DW_OP_call_frame_cfa:
+						if (!frame_bases) return false;
+						break;
+					case DW_OP_regx:
+					case DW_OP_bregx:
+						if (!p_regs || !p_regs->column(i->lr_number)) return false;
+						break;
+					default:
+						if (i->lr_atom >= DW_OP_lit0 && i->lr_atom <= DW_OP_lit31) break;
+						if (i->lr_atom >= DW_OP_breg0 && i->lr_atom <= DW_OP_breg31)
+						{
+							if (!p_regs || !p_regs->column(i->lr_atom - DW_OP_breg0)) return false;
+							break;
+						}
+						if (i->lr_atom >= DW_OP_reg0 && i->lr_atom <= DW_OP_reg31)
+						{
+							if (!p_regs || !p_regs->column(i->lr_atom - DW_OP_reg0)) return false;
+							break;
+						}
+						return false;
+				}
+				/* The stack effect is in the opcode table, except for pick's. */
+				const ::dwarf::spec::op_info& info = ::dwarf::spec::op_info_for(i->lr_atom);
+				unsigned needs = (i->lr_atom == DW_OP_pick) ? i->lr_number + 1 : info.pops;
+				int delta = (i->lr_atom == DW_OP_pick) ? 1 : info.pushes - info.pops;
+				assert(i->lr_atom == DW_OP_pick || info.pops >= 0);
+				if (depth < needs) return false;
+				depth += delta;
+				if (depth > operand_stack::CAPACITY) return false;
+				max_depth = std::max(max_depth, depth);
+			}
+			if (depth == 0) return false;
+			
+			/* Now run the ops. We go in chunks of frames, so that the stack
+			 * slots (one row of CHUNK values per slot) stay in cache. */
+			const size_t CHUNK = 256;
+			vector<Dwarf_Unsigned> slab(max_depth * CHUNK);
+			for (size_t base = 0; base < n; base += CHUNK)
+			{
+				const size_t m = std::min(CHUNK, n - base);
+				auto slot = [&](unsigned d) { return &slab[d * CHUNK]; };
+				unsigned sp = 0;
+				if (object_bases)
+				{
+					std::copy(object_bases + base, object_bases + base + m, slot(sp++));
+				}
+				for (auto i = code.begin(); i != code.end(); ++i)
+				{
+#define push_lanes(expr) { \
+						Dwarf_Unsigned *a = slot(sp++); \
+						for (size_t k = 0; k < m; ++k) a[k] = (expr); \
+					}
+#define binary_lanes(op, type) { \
+						Dwarf_Unsigned *a = slot(sp - 2); \
+						const Dwarf_Unsigned *b = slot(sp - 1); \
+						for (size_t k = 0; k < m; ++k) a[k] = (Dwarf_Unsigned) ((type) a[k] op (type) b[k]); \
+						--sp; \
+					}
+#define binary_lanes_fn(fn) { \
+						Dwarf_Unsigned *a = slot(sp - 2); \
+						const Dwarf_Unsigned *b = slot(sp - 1); \
+						for (size_t k = 0; k < m; ++k) a[k] = fn(a[k], b[k]); \
+						--sp; \
+					}
+					switch (i->lr_atom)
+					{
+						case DW_OP_addr:
+						case DW_OP_const1u: case DW_OP_const2u: case DW_OP_const4u: case DW_OP_const8u:
+						case DW_OP_const1s: case DW_OP_const2s: case DW_OP_const4s: case DW_OP_const8s:
+						case DW_OP_constu:
+						case DW_OP_consts: {
+							const Dwarf_Unsigned v = i->lr_number;
+							push_lanes(v)
+						} break;
+						case DW_OP_fbreg: {
+							const Dwarf_Signed *fb = frame_bases + base;
+							const Dwarf_Signed off = i->lr_number;
+							push_lanes((Dwarf_Unsigned) fb[k] + off)
+						} break;
+						case DW_OP_call_frame_cfa: {
+							const Dwarf_Signed *fb = frame_bases + base;
+							push_lanes(fb[k])
+						} break;
+						case DW_OP_regx: {
+							const Dwarf_Signed *col = p_regs->column(i->lr_number) + base;
+							push_lanes(col[k])
+						} break;
+						case DW_OP_bregx: {
+							const Dwarf_Signed *col = p_regs->column(i->lr_number) + base;
+							const Dwarf_Signed off = i->lr_number2;
+							push_lanes((Dwarf_Unsigned) col[k] + off)
+						} break;
+						case DW_OP_plus_uconst: {
+							Dwarf_Unsigned *a = slot(sp - 1);
+							const Dwarf_Unsigned v = i->lr_number;
+							for (size_t k = 0; k < m; ++k) a[k] += v;
+						} break;
+						case DW_OP_abs: {
+							Dwarf_Unsigned *a = slot(sp - 1);
+							for (size_t k = 0; k < m; ++k) a[k] = op_abs(a[k]);
+						} break;
+						case DW_OP_neg: {
+							Dwarf_Unsigned *a = slot(sp - 1);
+							for (size_t k = 0; k < m; ++k) a[k] = op_neg(a[k]);
+						} break;
+						case DW_OP_not: {
+							Dwarf_Unsigned *a = slot(sp - 1);
+							for (size_t k = 0; k < m; ++k) a[k] = ~a[k];
+						} break;
+						case DW_OP_plus:  binary_lanes(+, Dwarf_Unsigned) break;
+						case DW_OP_minus: binary_lanes(-, Dwarf_Unsigned) break;
+						case DW_OP_mul:   binary_lanes(*, Dwarf_Unsigned) break;
+						case DW_OP_and:   binary_lanes(&, Dwarf_Unsigned) break;
+						case DW_OP_or:    binary_lanes(|, Dwarf_Unsigned) break;
+						case DW_OP_xor:   binary_lanes(^, Dwarf_Unsigned) break;
+						case DW_OP_shl:   binary_lanes_fn(op_shl) break;
+						case DW_OP_shr:   binary_lanes_fn(op_shr) break;
+						case DW_OP_shra:  binary_lanes_fn(op_shra) break;
+						case DW_OP_eq:    binary_lanes(==, Dwarf_Signed) break;
+						case DW_OP_ne:    binary_lanes(!=, Dwarf_Signed) break;
+						case DW_OP_lt:    binary_lanes(<, Dwarf_Signed) break;
+						case DW_OP_le:    binary_lanes(<=, Dwarf_Signed) break;
+						case DW_OP_gt:    binary_lanes(>, Dwarf_Signed) break;
+						case DW_OP_ge:    binary_lanes(>=, Dwarf_Signed) break;
+						case DW_OP_dup:
+						case DW_OP_over:
+						case DW_OP_pick: {
+							unsigned from = (i->lr_atom == DW_OP_dup) ? 0
+								: (i->lr_atom == DW_OP_over) ? 1 : i->lr_number;
+							const Dwarf_Unsigned *src = slot(sp - 1 - from);
+							push_lanes(src[k])
+						} break;
+						case DW_OP_drop:
+							--sp;
+							break;
+						case DW_OP_swap:
+							std::swap_ranges(slot(sp - 2), slot(sp - 2) + m, slot(sp - 1));
+							break;
+						case DW_OP_rot: {
+							Dwarf_Unsigned *a = slot(sp - 3);
+							Dwarf_Unsigned *b = slot(sp - 2);
+							Dwarf_Unsigned *c = slot(sp - 1);
+							for (size_t k = 0; k < m; ++k)
+							{
+								Dwarf_Unsigned t = c[k];
+								c[k] = b[k]; b[k] = a[k]; a[k] = t;
+							}
+						} break;
+						case DW_OP_nop:
+						case DW_OP_stack_value:
+							break;
+						default:
+							if (i->lr_atom >= DW_OP_lit0 && i->lr_atom <= DW_OP_lit31)
+							{
+								const Dwarf_Unsigned v = i->lr_atom - DW_OP_lit0;
+								push_lanes(v)
+							}
+							else if (i->lr_atom >= DW_OP_breg0 && i->lr_atom <= DW_OP_breg31)
+							{
+								const Dwarf_Signed *col = p_regs->column(i->lr_atom - DW_OP_breg0) + base;
+								const Dwarf_Signed off = i->lr_number;
+								push_lanes((Dwarf_Unsigned) col[k] + off)
+							}
+							else if (i->lr_atom >= DW_OP_reg0 && i->lr_atom <= DW_OP_reg31)
+							{
+								const Dwarf_Signed *col = p_regs->column(i->lr_atom - DW_OP_reg0) + base;
+								push_lanes(col[k])
+							}
+							else assert(false);
+							break;
+					}
+#undef binary_lanes_fn
+#undef binary_lanes
+#undef push_lanes
+				}
+				assert(sp == depth);
+				std::copy(slot(sp - 1), slot(sp - 1) + m, out + base);
+			}
+			return true;
+		}
+		compiled_loclist::compiled_loclist(const encap::loclist& l)
+		{
+			/* As in evaluator::copy_from_loclist. Each entry claims
+			 * whatever parts of its range no earlier entry has claimed. */
+			std::map<Dwarf_Addr, entry> claimed; // by lopc; disjoint
+			Dwarf_Addr current_vaddr_base = 0;
+			unsigned order = 0;
+			for (auto i_loc_expr = l.begin(); i_loc_expr != l.end(); ++i_loc_expr)
+			{
+				if (i_loc_expr->lopc == 0xffffffffU
+				||  i_loc_expr->lopc == 0xffffffffffffffffULL)
+				{
+					current_vaddr_base = i_loc_expr->hipc;
+					continue;
+				}
+				Dwarf_Addr lopc, hipc;
+				if ((i_loc_expr->lopc == 0 && i_loc_expr->hipc == std::numeric_limits<Dwarf_Addr>::max())
+				|| (i_loc_expr->lopc == 0 && i_loc_expr->hipc == 0))
+				{
+					lopc = 0;
+					hipc = std::numeric_limits<Dwarf_Addr>::max();
+				}
+				else
+				{
+					lopc = i_loc_expr->lopc + current_vaddr_base;
+					hipc = i_loc_expr->hipc + current_vaddr_base;
+				}
+				unsigned this_order = order++;
+				if (lopc >= hipc) continue;
+				compiled_expr e(*i_loc_expr);
+				// skip the part, if any, that an entry starting earlier covers
+				auto next = claimed.upper_bound(lopc);
+				if (next != claimed.begin() && std::prev(next)->second.hipc > lopc)
+				{
+					lopc = std::prev(next)->second.hipc;
+				}
+				// fill the gaps between the entries starting within our range
+				while (lopc < hipc)
+				{
+					Dwarf_Addr gap_end = (next == claimed.end()) ? hipc : std::min(hipc, next->first);
+					if (lopc < gap_end) claimed.insert(next,
+						make_pair(lopc, entry { lopc, gap_end, this_order, e }));
+					if (next == claimed.end() || next->first >= hipc) break;
+					lopc = next->second.hipc;
+					++next;
+				}
+			}
+			for (auto i_ent = claimed.begin(); i_ent != claimed.end(); ++i_ent)
+			{
+				entries.push_back(std::move(i_ent->second));
+			}
+		}
+		const compiled_expr *compiled_loclist::expr_for_vaddr(Dwarf_Addr vaddr) const
+		{
+			const entry *p_ent = entry_for_vaddr(vaddr);
+			return p_ent ? &p_ent->e : nullptr;
+		}
+		const compiled_loclist::entry *
+		compiled_loclist::entry_for_vaddr(Dwarf_Addr vaddr) const
+		{
+			// the last entry starting at or before vaddr is the only candidate
+			auto found = std::upper_bound(entries.begin(), entries.end(), vaddr,
+				[](Dwarf_Addr addr, const entry& ent) { return addr < ent.lopc; });
+			if (found == entries.begin()) return nullptr;
+			--found;
+			return found->covers(vaddr) ? &*found : nullptr;
+		}
+		void compiled_loclist::exprs_for_vaddrs(const Dwarf_Addr *vaddrs, size_t n,
+			const compiled_expr **out) const
+		{
+			/* The common case is one entry covering a run of vaddrs (think
+			 * of many samples in the same function), so try the last answer
+			 * first. Entries are disjoint, so if it covers, it's the one. */
+			const entry *p_last = nullptr;
+			for (size_t k = 0; k < n; ++k)
+			{
+				if (!p_last || !p_last->covers(vaddrs[k])) p_last = entry_for_vaddr(vaddrs[k]);
+				out[k] = p_last ? &p_last->e : nullptr;
+			}
+		}
+		Dwarf_Unsigned compiled_loclist::eval(Dwarf_Addr vaddr,
+			regs *p_regs,
+			opt<Dwarf_Signed> frame_base,
+			opt<Dwarf_Unsigned> object_base,
+			memory *p_mem) const
+		{
+			const compiled_expr *p_e = expr_for_vaddr(vaddr);
+			if (!p_e) throw No_entry();
+			return p_e->eval(p_regs, frame_base, object_base, p_mem);
+		}
 	}
 	namespace encap
 	{
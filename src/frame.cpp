@@ -7,9 +7,15 @@
  */
 
 #include <limits>
+#include <cstring>
 #include <map>
 #include <set>
 #include <cassert>
+#include <atomic>
+#include <exception>
+#include <system_error>
+#include <mutex>
+#include <thread>
 #include <boost/optional.hpp>
 #include <boost/icl/interval_map.hpp>
 #include <boost/graph/graph_traits.hpp>
@@ -60,13 +66,79 @@ namespace dwarf
 	
 		int FrameSection::get_elf_machine() const
 		{
+			if (cached_elf_machine != -1) return cached_elf_machine;
 			GElf_Ehdr ehdr;
 			GElf_Ehdr *ret = gelf_getehdr(get_elf(), &ehdr);
 			assert(ret != 0);
-			return ehdr.e_machine;
+			return cached_elf_machine = ehdr.e_machine;
 		}
-		
+
+		void FrameSection::index_entries()
+		{
+			/* The entries' own fields are in the ELF file's byte order. */
+			GElf_Ehdr ehdr;
+			GElf_Ehdr *ret = gelf_getehdr(get_elf(), &ehdr);
+			assert(ret != 0);
+			bool read_be = (ehdr.e_ident[EI_DATA] == ELFDATA2MSB);
+
+			fde_ranges_by_pc.reserve(fde_element_count);
+			for (Dwarf_Signed i = 0; i < fde_element_count; ++i)
+			{
+				Dwarf_Addr lopc;
+				Dwarf_Unsigned func_length;
+				Dwarf_Ptr fde_bytes;
+				Dwarf_Unsigned fde_byte_length;
+				Dwarf_Off cie_id;
+				Dwarf_Signed cie_index;
+				Dwarf_Off fde_offset;
+				int fde_ret = dwarf_get_fde_range(fde_data[i], &lopc, &func_length, &fde_bytes,
+					&fde_byte_length, &cie_id, &cie_index, &fde_offset, &core::current_dwarf_error);
+				if (!LIBDWARF_OK(fde_ret)) continue;
+				/* Build the PC index straight from the range, without
+				 * constructing an Fde (which would go looking for augmentation
+				 * bytes that we don't need here). */
+				if (func_length > 0) fde_ranges_by_pc.push_back(fde_pc_range { lopc, lopc + func_length, i });
+
+				/* libdwarf gives us the FDE's CIE id field as it is in the
+				 * section. In .debug_frame that's the CIE's offset. In .eh_frame
+				 * it counts backwards from the id field itself, which follows
+				 * the length: 4 bytes, or 0xffffffff and then 8. */
+				const unsigned char *pos = reinterpret_cast<const unsigned char *>(fde_bytes);
+				uint32_t length = read_be ? encap::read_4byte_be(&pos, pos + 4)
+					: encap::read_4byte_le(&pos, pos + 4);
+				bool entry_is_64bit = (length == 0xffffffff);
+				if (entry_is_64bit) is_64bit = true;
+				Dwarf_Off cie_offset = using_eh ? fde_offset + (entry_is_64bit ? 12 : 4) - cie_id : cie_id;
+				fde_offsets_by_cie_offset[cie_offset].insert(fde_offset);
+
+				/* libdwarf usually gives us the CIE's index directly, but
+				 * check, as Fde::find_cie does. */
+				Dwarf_Cie cie;
+				int cie_ret = dwarf_get_cie_of_fde(fde_data[i], &cie, &core::current_dwarf_error);
+				if (!LIBDWARF_OK(cie_ret)) continue;
+				if (!(cie_index >= 0 && cie_index < cie_element_count && cie_data[cie_index] == cie))
+				{
+					cie_index = index_of_cie(cie);
+				}
+				if (cie_index != -1) cie_offsets_by_index[cie_index] = cie_offset;
+			}
+			std::sort(fde_ranges_by_pc.begin(), fde_ranges_by_pc.end(),
+				[](const fde_pc_range& r1, const fde_pc_range& r2) { return r1.lopc < r2.lopc; });
+		}
+
 		const int FAKE_CFA_REGISTER = DW_FRAME_CFA_COL3;
+		static std::mutex libdwarf_mutex;
+		static std::mutex trace_mutex; // taken before libdwarf_mutex, if both
+
+		const encap::loc_expr *FrameSection::register_def::intern_expr(const encap::loc_expr& e)
+		{
+			/* These live as long as the process. There are rarely more
+			 * than a few hundred distinct CFI expressions in a binary. */
+			static std::set<encap::loc_expr> interned;
+			static std::mutex interned_mutex;
+			std::lock_guard<std::mutex> guard(interned_mutex);
+			return &*interned.insert(e).first;
+		}
 	}
 	/* libdwarf-tainted stuff continues.... */
 	namespace encap
@@ -96,154 +168,155 @@ namespace dwarf
 		uint32_t read_4byte_be(unsigned char const **cur, unsigned char const *limit);
 		uint16_t read_2byte_be(unsigned char const **cur, unsigned char const *limit);
 		Dwarf_Addr read_addr(int addrlen, unsigned char const **cur, unsigned char const *limit, bool use_host_byte_order);
-		frame_instrlist::frame_instrlist(const core::Cie& cie, int addrlen, const pair<unsigned char*, unsigned char*>& seq, bool use_host_byte_order /* = true */)
+		void frame_instr_iterator::decode_here()
 		{
-			// unsigned char *instrs_start = seq.first;
-			const unsigned char *pos = seq.first;
-			const unsigned char *const limit = seq.second;
+			const core::Cie& cie = *p_cie;
+			const unsigned char *pos = this->pos;
+			Dwarf_Frame_Op3 decoded = { 0, 0, 0, 0, 0, 0 };
+			decoded.fp_instr_offset = pos - start;
+			/* See DWARF4 page 181 for the summary of opcode encoding and arguments. 
+			 * This macro masks out any argument part of the basic opcodes. */
+#define opcode_from_byte(b) (((b) & 0xc0) ? (b) & 0xc0 : (b))
+			
+			unsigned char opcode_byte = *pos++;
+			
+			decoded.fp_base_op = opcode_byte >> 6;
+			decoded.fp_extended_op = (decoded.fp_base_op == 0) ? opcode_byte & ~0xc0 : 0;
 
-			while (pos < limit)
+			switch (opcode_from_byte(opcode_byte))
 			{
-				Dwarf_Frame_Op3 decoded = { 0, 0, 0, 0, 0, 0 };
-				/* See DWARF4 page 181 for the summary of opcode encoding and arguments. 
-				 * This macro masks out any argument part of the basic opcodes. */
-#define opcode_from_byte(b) (((b) & 0xc0) ? (b) & 0xc0 : (b))
-				
-				unsigned char opcode_byte = *pos++;
+				// "packed" two-bit opcodes
+				case DW_CFA_advance_loc: 
+					decoded.fp_offset_or_block_len = opcode_byte & ~0xc0;
+					break;
+				case DW_CFA_offset:
+					decoded.fp_register = opcode_byte & ~0xc0;
+					// NOTE: here we are writing a signed value into an unsigned location
+					decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_uleb128(&pos, limit);
+					// ... so assert something that says we can read it back
+					if (cie.get_data_alignment_factor() < 0)
+					{
+						assert((Dwarf_Signed) decoded.fp_offset_or_block_len <= 0);
+					}
+					break;
+				case DW_CFA_restore:
+					decoded.fp_register = opcode_byte & ~0xc0;
+					break;
+				// DW_CFA_extended and DW_CFA_nop are the same value, BUT
+				case DW_CFA_nop: goto no_args;      // this is a full zero byte
+				// extended opcodes follow
+				case DW_CFA_remember_state: goto no_args;
+				case DW_CFA_restore_state: goto no_args;
+				no_args:
+					break;
+				case DW_CFA_set_loc:
+					decoded.fp_offset_or_block_len = read_addr(addrlen, &pos, limit, use_host_byte_order);
+					break;
+				case DW_CFA_advance_loc1:
+					decoded.fp_offset_or_block_len = *pos++;
+					break;
+				case DW_CFA_advance_loc2:
+					decoded.fp_offset_or_block_len = (host_is_big_endian() ^ use_host_byte_order) 
+						? read_2byte_le(&pos, limit)
+						: read_2byte_be(&pos, limit);
+					break;
+				case DW_CFA_advance_loc4:
+					decoded.fp_offset_or_block_len = (host_is_big_endian() ^ use_host_byte_order) 
+						? read_4byte_le(&pos, limit)
+						: read_4byte_be(&pos, limit);
+					break;
+				// case DW_CFA_offset: // already dealt with, above
 				
-				decoded.fp_base_op = opcode_byte >> 6;
-				decoded.fp_extended_op = (decoded.fp_base_op == 0) ? opcode_byte & ~0xc0 : 0;
-
-				switch (opcode_from_byte(opcode_byte))
-				{
-					// "packed" two-bit opcodes
-					case DW_CFA_advance_loc: 
-						decoded.fp_offset_or_block_len = opcode_byte & ~0xc0;
-						break;
-					case DW_CFA_offset:
-						decoded.fp_register = opcode_byte & ~0xc0;
-						// NOTE: here we are writing a signed value into an unsigned location
-						decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_uleb128(&pos, seq.second);
-						// ... so assert something that says we can read it back
-						if (cie.get_data_alignment_factor() < 0)
-						{
-							assert((Dwarf_Signed) decoded.fp_offset_or_block_len <= 0);
-						}
-						break;
-					case DW_CFA_restore:
-						decoded.fp_register = opcode_byte & ~0xc0;
-						break;
-					// DW_CFA_extended and DW_CFA_nop are the same value, BUT
-					case DW_CFA_nop: goto no_args;      // this is a full zero byte
-					// extended opcodes follow
-					case DW_CFA_remember_state: goto no_args;
-					case DW_CFA_restore_state: goto no_args;
-					no_args:
-						break;
-					case DW_CFA_set_loc:
-						decoded.fp_offset_or_block_len = read_addr(addrlen, &pos, seq.second, use_host_byte_order);
-						break;
-					case DW_CFA_advance_loc1:
-						decoded.fp_offset_or_block_len = *pos++;
-						break;
-					case DW_CFA_advance_loc2:
-						decoded.fp_offset_or_block_len = (host_is_big_endian() ^ use_host_byte_order) 
-							? read_2byte_le(&pos, limit)
-							: read_2byte_be(&pos, limit);
-						break;
-					case DW_CFA_advance_loc4:
-						decoded.fp_offset_or_block_len = (host_is_big_endian() ^ use_host_byte_order) 
-							? read_4byte_le(&pos, limit)
-							: read_4byte_be(&pos, limit);
-						break;
-					// case DW_CFA_offset: // already dealt with, above
-					
-					case DW_CFA_restore_extended: goto uleb128_register_only;
-					case DW_CFA_undefined: goto uleb128_register_only;
-					case DW_CFA_same_value: goto uleb128_register_only;
-					case DW_CFA_def_cfa_register: goto uleb128_register_only;
-					uleb128_register_only:
-						decoded.fp_register = read_uleb128(&pos, limit);
-						break;
-						
-					case DW_CFA_offset_extended: goto uleb128_register_and_factored_offset;
-					case DW_CFA_register: goto uleb128_register_and_factored_offset;
-					uleb128_register_and_factored_offset:// FIXME: second register goes where? I've put it in fp_offset_or_block_len
-						decoded.fp_register = read_uleb128(&pos, limit);
-						decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_uleb128(&pos, limit);
-						break;
+				case DW_CFA_restore_extended: goto uleb128_register_only;
+				case DW_CFA_undefined: goto uleb128_register_only;
+				case DW_CFA_same_value: goto uleb128_register_only;
+				case DW_CFA_def_cfa_register: goto uleb128_register_only;
+				uleb128_register_only:
+					decoded.fp_register = read_uleb128(&pos, limit);
+					break;
 					
-					case DW_CFA_def_cfa: goto uleb128_register_and_offset;
-					uleb128_register_and_offset:// FIXME: second register goes where? I've put it in fp_offset_or_block_len
-						decoded.fp_register = read_uleb128(&pos, limit);
-						decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
-						break;
+				case DW_CFA_offset_extended: goto uleb128_register_and_factored_offset;
+				case DW_CFA_register: goto uleb128_register_and_factored_offset;
+				uleb128_register_and_factored_offset:// FIXME: second register goes where? I've put it in fp_offset_or_block_len
+					decoded.fp_register = read_uleb128(&pos, limit);
+					decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_uleb128(&pos, limit);
+					break;
+				
+				case DW_CFA_def_cfa: goto uleb128_register_and_offset;
+				uleb128_register_and_offset:// FIXME: second register goes where? I've put it in fp_offset_or_block_len
+					decoded.fp_register = read_uleb128(&pos, limit);
+					decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
+					break;
 
-					case DW_CFA_offset_extended_sf: goto uleb128_register_sleb128_offset;
-					case DW_CFA_def_cfa_sf: goto uleb128_register_sleb128_offset;
-					uleb128_register_sleb128_offset:
-						decoded.fp_register = read_uleb128(&pos, limit);
-						decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_sleb128(&pos, limit);
-						break;
-					
-					case DW_CFA_def_cfa_offset: goto uleb128_offset_only;
-					uleb128_offset_only:
-						decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
-						break;
-					
-					case DW_CFA_def_cfa_offset_sf: goto sleb128_offset_only;
-					sleb128_offset_only:
-						decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_sleb128(&pos, limit);
-						break;
-						
-					case DW_CFA_expression:
-						decoded.fp_register = read_uleb128(&pos, limit);
-						decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
-						decoded.fp_expr_block = const_cast<Dwarf_Small*>(pos);
-						pos += decoded.fp_offset_or_block_len;
-						break;
+				case DW_CFA_offset_extended_sf: goto uleb128_register_sleb128_offset;
+				case DW_CFA_def_cfa_sf: goto uleb128_register_sleb128_offset;
+				uleb128_register_sleb128_offset:
+					decoded.fp_register = read_uleb128(&pos, limit);
+					decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_sleb128(&pos, limit);
+					break;
+				
+				case DW_CFA_def_cfa_offset: goto uleb128_offset_only;
+				uleb128_offset_only:
+					decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
+					break;
+				
+				case DW_CFA_def_cfa_offset_sf: goto sleb128_offset_only;
+				sleb128_offset_only:
+					decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_sleb128(&pos, limit);
+					break;
 					
-					case DW_CFA_def_cfa_expression:
-						decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
-						decoded.fp_expr_block = const_cast<Dwarf_Small*>(pos);
-						pos += decoded.fp_offset_or_block_len;
-						break;
+				case DW_CFA_expression:
+					decoded.fp_register = read_uleb128(&pos, limit);
+					decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
+					decoded.fp_expr_block = const_cast<Dwarf_Small*>(pos);
+					pos += decoded.fp_offset_or_block_len;
+					break;
+				
+				case DW_CFA_def_cfa_expression:
+					decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
+					decoded.fp_expr_block = const_cast<Dwarf_Small*>(pos);
+					pos += decoded.fp_offset_or_block_len;
+					break;
+				
+				case DW_CFA_val_offset: 
+					decoded.fp_register = read_uleb128(&pos, limit);
+					decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_sleb128(&pos, limit);
+					break;
 					
-					case DW_CFA_val_offset: 
-						decoded.fp_register = read_uleb128(&pos, limit);
-						decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_sleb128(&pos, limit);
-						break;
-						
-					case DW_CFA_val_offset_sf:
-						decoded.fp_register = read_uleb128(&pos, limit);
-						decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_uleb128(&pos, limit);
-						break;
-						
-					case DW_CFA_val_expression:
-						decoded.fp_register = read_uleb128(&pos, limit);
-						decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
-						decoded.fp_expr_block = const_cast<Dwarf_Small*>(pos);
-						pos += decoded.fp_offset_or_block_len;
-						break;
+				case DW_CFA_val_offset_sf:
+					decoded.fp_register = read_uleb128(&pos, limit);
+					decoded.fp_offset_or_block_len = cie.get_data_alignment_factor() * read_uleb128(&pos, limit);
+					break;
 					
-					/* HACK: somewhere better to put the vendor-specific stuff? */
-					case DW_CFA_GNU_args_size:
-						/* from LSB 3.1.1: 
-						 * "The DW_CFA_GNU_args_size instruction takes an unsigned LEB128 operand 
-						 * representing an argument size. This instruction specifies the total 
-						 * of the size of the arguments which have been pushed onto the stack.
-						 */
-						decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
-						break;
-					default:
-						assert(false);
-				} // end switch
-
-				// push the current row
-				push_back(frame_instr(cie.get_owner().get_dbg().raw_handle(), decoded));
+				case DW_CFA_val_expression:
+					decoded.fp_register = read_uleb128(&pos, limit);
+					decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
+					decoded.fp_expr_block = const_cast<Dwarf_Small*>(pos);
+					pos += decoded.fp_offset_or_block_len;
+					break;
 				
+				/* HACK: somewhere better to put the vendor-specific stuff? */
+				case DW_CFA_GNU_args_size:
+					/* from LSB 3.1.1: 
+					 * "The DW_CFA_GNU_args_size instruction takes an unsigned LEB128 operand 
+					 * representing an argument size. This instruction specifies the total 
+					 * of the size of the arguments which have been pushed onto the stack.
+					 */
+					decoded.fp_offset_or_block_len = read_uleb128(&pos, limit);
+					break;
+				default:
+					assert(false);
+			} // end switch
+
+			cur = frame_instr(cie.get_owner().get_dbg().raw_handle(), decoded);
+			next = pos;
 #undef opcode_from_byte
-			} // end while
+		}
+		frame_instrlist::frame_instrlist(const core::Cie& cie, int addrlen, const pair<unsigned char*, unsigned char*>& seq, bool use_host_byte_order /* = true */)
+		{
+			frame_instr_iterator i(cie, addrlen, seq.first, seq.first, seq.second, use_host_byte_order);
+			frame_instr_iterator end(cie, addrlen, seq.first, seq.second, seq.second, use_host_byte_order);
+			std::copy(i, end, std::back_inserter(*this));
 		}
 		/* end of libdwarf-specific stuff I think */
 		
@@ -452,8 +525,10 @@ namespace dwarf
 			{
 				assert(version == 1 || version == 3);
 				// we have to guess it's an ELF file
-				auto e_machine = owner.get_elf_machine();
-				return (e_machine == EM_X86_64) ? 8 : (e_machine == EM_386) ? 4 : (assert(false), 4);
+				const lib::dwarf_reg_arch *arch = owner.get_reg_arch();
+				if (!arch) throw expr::Not_supported("address size of unknown architecture");
+				if (arch->address_size) return arch->address_size;
+				return (gelf_getclass(owner.get_elf()) == ELFCLASS64) ? 8 : 4;
 			}
 		}
 		unsigned char Cie::get_segment_size() const
@@ -640,7 +715,7 @@ namespace dwarf
 		}
 		
 		FrameSection::instrs_results
-		Fde::decode() const
+		Fde::decode(opt<Dwarf_Addr> up_to_pc /* = opt<Dwarf_Addr>() */) const
 		{
 			unsigned char *instr_bytes_begin = instr_bytes_seq().first;
 			unsigned char *instr_bytes_end = instr_bytes_seq().second;
@@ -656,9 +731,11 @@ namespace dwarf
 				cie.get_initial_instructions(), cie.get_initial_instructions_length(), initial_instrs_results_t());
 			/* Walk the FDE instructions. */
 			auto final_result = owner.interpret_instructions(cie, initial_result.unfinished_row_addr,
-				instr_bytes_begin, instr_bytes_end - instr_bytes_begin, initial_result);
-			/* Add any unfinished row, using the FDE high pc */
-			if (final_result.rows.size() > 0)
+				instr_bytes_begin, instr_bytes_end - instr_bytes_begin, initial_result, up_to_pc);
+			/* Add any unfinished row, using the FDE high pc. That's the only
+			 * row if the FDE has no instructions of its own. If we stopped
+			 * early, there isn't one. */
+			if (final_result.unfinished_row_addr < get_low_pc() + get_func_length())
 			{
 				final_result.add_unfinished_row(get_low_pc() + get_func_length());
 			}
@@ -671,15 +748,18 @@ namespace dwarf
 		FrameSection::interpret_instructions(const Cie& cie, 
 				Dwarf_Addr initial_row_addr, 
 				Dwarf_Ptr instrs, Dwarf_Unsigned instrs_len,
-				opt< const FrameSection::instrs_results & > initial_instrs_results) const
+				opt< const FrameSection::instrs_results & > initial_instrs_results,
+				opt<Dwarf_Addr> stop_pc) const
 		{
-			/* Expand the instructions. We would use dwarf_expand_frame_instructions but 
+			/* Decode the instructions as we go. We would use dwarf_expand_frame_instructions but 
 			 * it seems to be DWARF2-specific, and I don't want to use too many more 
-			 * libdwarf calls. So use our own frame_instrlist. */
-			encap::frame_instrlist instrlist(cie, cie.get_address_size(), 
-				make_pair(reinterpret_cast<unsigned char *>(instrs), 
-					      reinterpret_cast<unsigned char *>(instrs) + instrs_len),
-					      /* use_host_byte_order -- FIXME */ true);
+			 * libdwarf calls. So use our own decoder. */
+			const unsigned char *instrs_begin = reinterpret_cast<unsigned char *>(instrs);
+			const unsigned char *instrs_end = instrs_begin + instrs_len;
+			encap::frame_instr_iterator instrs_it(cie, cie.get_address_size(),
+				instrs_begin, instrs_begin, instrs_end, /* use_host_byte_order -- FIXME */ true);
+			encap::frame_instr_iterator instrs_it_end(cie, cie.get_address_size(),
+				instrs_begin, instrs_end, instrs_end, true);
 			
 			// create container for return values & working storage
 			instrs_results result;
@@ -699,11 +779,31 @@ namespace dwarf
 				current_row_addr = initial_row_addr;
 			}
 			std::stack< map<int, register_def> > remembered_row_defs;
+			/* Decoding expressions goes through libdwarf, which isn't
+			 * thread-safe, and we may be running in expand_all()'s workers. */
+			auto make_expr = [this](Dwarf_Ptr block, Dwarf_Unsigned len) -> encap::loc_expr {
+				std::lock_guard<std::mutex> guard(libdwarf_mutex);
+				return encap::loc_expr(get_dbg().raw_handle(), block, len);
+			};
 
-			debug() << "Interpreting instrlist " << instrlist << endl;
-			for (auto i_op = instrlist.begin(); i_op != instrlist.end(); ++i_op)
+			/* With expand_all()'s workers all interpreting at once, keep each
+			 * call's trace in one piece. Printing instructions decodes their
+			 * expressions, through libdwarf, so only do it if we must. */
+			std::unique_lock<std::mutex> trace_guard(trace_mutex, std::defer_lock);
+			if (debug_level >= 1)
 			{
-				debug() << "\tInterpreting instruction " << *i_op << endl;
+				trace_guard.lock();
+				std::lock_guard<std::mutex> guard(libdwarf_mutex);
+				debug(1) << "Interpreting instrlist "
+					<< encap::frame_instrlist(instrs_it, instrs_it_end) << endl;
+			}
+			for (auto i_op = instrs_it; i_op != instrs_it_end; ++i_op)
+			{
+				if (debug_level >= 1)
+				{
+					std::lock_guard<std::mutex> guard(libdwarf_mutex);
+					debug(1) << "\tInterpreting instruction " << *i_op << endl;
+				}
 				switch (i_op->fp_base_op << 6 | i_op->fp_extended_op)
 				{
 					// row creation
@@ -719,13 +819,22 @@ namespace dwarf
 					add_new_row: {
 						// assert greater than current
 						assert(new_row_addr > current_row_addr);
-						set< pair< int, register_def > > current_row_defs_set(current_row_defs.begin(), current_row_defs.end());
+						row_defs current_row_defs_set(current_row_defs.begin(), current_row_defs.end());
 
 						// add the old row to the interval map
 						working += make_pair( 
 							interval<Dwarf_Addr>::right_open(current_row_addr, new_row_addr),
 							current_row_defs_set
 						);
+						/* If that row covers the PC we're interested in, we're done.
+						 * We haven't seen the next row's instructions, so don't
+						 * pretend we know what it looks like. */
+						if (stop_pc && *stop_pc < new_row_addr)
+						{
+							current_row_defs.clear();
+							current_row_addr = std::numeric_limits<Dwarf_Addr>::max();
+							return result;
+						}
 						current_row_addr = new_row_addr;
 						} break;
 					// CFA definition
@@ -751,7 +860,7 @@ namespace dwarf
 						current_row_defs[DW_FRAME_CFA_COL3].register_plus_offset_w().second = i_op->fp_offset_or_block_len;
 						break;
 					case DW_CFA_def_cfa_expression: 
-						current_row_defs[DW_FRAME_CFA_COL3].saved_at_expr_w() = encap::loc_expr(get_dbg().raw_handle(), i_op->fp_expr_block, i_op->fp_offset_or_block_len);
+						current_row_defs[DW_FRAME_CFA_COL3].saved_at_expr_w(make_expr(i_op->fp_expr_block, i_op->fp_offset_or_block_len));
 						break;
 					// register rule
 					case DW_CFA_undefined:
@@ -775,10 +884,10 @@ namespace dwarf
 						current_row_defs[i_op->fp_register].register_plus_offset_w() = make_pair(i_op->fp_offset_or_block_len, 0);
 						break;
 					case DW_CFA_expression:
-						current_row_defs[i_op->fp_register].saved_at_expr_w() = encap::loc_expr(get_dbg().raw_handle(), i_op->fp_expr_block, i_op->fp_offset_or_block_len);
+						current_row_defs[i_op->fp_register].saved_at_expr_w(make_expr(i_op->fp_expr_block, i_op->fp_offset_or_block_len));
 						break;
 					case DW_CFA_val_expression:
-						current_row_defs[i_op->fp_register].val_of_expr_w() = encap::loc_expr(get_dbg().raw_handle(), i_op->fp_expr_block, i_op->fp_offset_or_block_len);
+						current_row_defs[i_op->fp_register].val_of_expr_w(make_expr(i_op->fp_expr_block, i_op->fp_offset_or_block_len));
 						break;
 					case DW_CFA_restore:
 					case DW_CFA_restore_extended: {
@@ -842,7 +951,369 @@ namespace dwarf
 			// there might be an unfinished row in result.unfinished_row; if so we'll fix it up outside
 			return result;
 		}
-		
+
+		void FrameSection::compile_table() const
+		{
+			auto p_table = std::make_shared<compiled_table>();
+			auto& table = *p_table;
+			/* Expressions and rule sets are both heavily repeated across FDEs
+			 * (think of every PLT-ish stub), so intern them as we go. */
+			map<encap::loc_expr, int32_t> expr_indices;
+			map<std::vector<compiled_rule>, uint32_t> ruleset_indices;
+			auto compile_rule = [&table, &expr_indices](int column, const register_def& def) -> compiled_rule {
+				compiled_rule rule = { static_cast<uint16_t>(column), static_cast<uint8_t>(def.k), 0, 0 };
+				auto intern = [&table, &expr_indices](const encap::loc_expr& e) -> int32_t {
+					auto found = expr_indices.find(e);
+					if (found != expr_indices.end()) return found->second;
+					int32_t idx = table.exprs.size();
+					table.exprs.push_back(e);
+					expr_indices.insert(make_pair(e, idx));
+					return idx;
+				};
+				switch (def.k)
+				{
+					case register_def::SAVED_AT_OFFSET_FROM_CFA:
+						rule.offset_or_expr = def.saved_at_offset_from_cfa_r();
+						break;
+					case register_def::VAL_IS_OFFSET_FROM_CFA:
+						rule.offset_or_expr = def.val_is_offset_from_cfa_r();
+						break;
+					case register_def::REGISTER:
+						rule.reg = def.register_plus_offset_r().first;
+						rule.offset_or_expr = def.register_plus_offset_r().second;
+						break;
+					case register_def::SAVED_AT_EXPR:
+						rule.offset_or_expr = intern(def.saved_at_expr_r());
+						break;
+					case register_def::VAL_OF_EXPR:
+						rule.offset_or_expr = intern(def.val_of_expr_r());
+						break;
+					default: // nothing more to record
+						break;
+				}
+				return rule;
+			};
+
+			for (auto i_fde = fde_begin(); i_fde != fde_end(); ++i_fde)
+			{
+				Dwarf_Addr fde_hipc = i_fde->get_low_pc() + i_fde->get_func_length();
+				uint16_t ra_column = i_fde->find_cie()->get_return_address_register_rule();
+				instrs_results result = i_fde->decode();
+
+				for (auto i_row = result.rows.begin(); i_row != result.rows.end(); ++i_row)
+				{
+					compiled_row row = { i_row->first.lower(), i_row->first.upper(),
+						{ static_cast<uint16_t>(DW_FRAME_CFA_COL3),
+						  static_cast<uint8_t>(register_def::INDETERMINATE), 0, 0 },
+						ra_column, 0, 0 };
+					std::vector<compiled_rule> ruleset;
+					// the set is ordered by regnum, so ruleset comes out sorted by column
+					for (auto i_def = i_row->second.begin(); i_def != i_row->second.end(); ++i_def)
+					{
+						if (i_def->first == DW_FRAME_CFA_COL3) row.cfa = compile_rule(i_def->first, i_def->second);
+						else ruleset.push_back(compile_rule(i_def->first, i_def->second));
+					}
+					auto found = ruleset_indices.find(ruleset);
+					if (found != ruleset_indices.end()) row.first_rule = found->second;
+					else
+					{
+						row.first_rule = table.rules.size();
+						table.rules.insert(table.rules.end(), ruleset.begin(), ruleset.end());
+						ruleset_indices.insert(make_pair(ruleset, row.first_rule));
+					}
+					row.nrules = ruleset.size();
+					table.rows.push_back(row);
+				}
+			}
+			/* FDEs are not necessarily in address order. */
+			std::stable_sort(table.rows.begin(), table.rows.end(),
+				[](const compiled_row& r1, const compiled_row& r2) { return r1.lopc < r2.lopc; });
+			table.rows.shrink_to_fit();
+			table.rules.shrink_to_fit();
+			debug() << "Compiled unwind table has " << table.rows.size() << " rows, "
+				<< table.rules.size() << " register rules and "
+				<< table.exprs.size() << " expressions" << endl;
+			p_compiled_table = p_table;
+		}
+
+		FrameSection::expanded_section FrameSection::expand_all(unsigned nthreads) const
+		{
+			/* Phase one is serial, because it talks to libdwarf: gather what
+			 * each FDE needs, and interpret each CIE's initial instructions
+			 * once. We can share the CIE's result among its FDEs as long as it
+			 * didn't advance the location, which in practice it never does. */
+			std::vector<Cie> cies;
+			cies.reserve(cie_element_count);
+			std::vector<instrs_results> cie_initial_results;
+			std::vector<bool> cie_initial_shareable;
+			for (auto i_cie = cie_begin(); i_cie != cie_end(); ++i_cie)
+			{
+				cies.push_back(*i_cie);
+				cie_initial_results.push_back(interpret_instructions(cies.back(), 0,
+					cies.back().get_initial_instructions(), cies.back().get_initial_instructions_length()));
+				cie_initial_shareable.push_back(cie_initial_results.back().rows.size() == 0);
+			}
+			struct fde_job
+			{
+				Dwarf_Addr lopc;
+				Dwarf_Addr hipc;
+				pair<unsigned char *, unsigned char *> instrs;
+				Dwarf_Signed cie_idx;
+			};
+			std::vector<fde_job> jobs;
+			jobs.reserve(fde_element_count);
+			for (auto i_fde = fde_begin(); i_fde != fde_end(); ++i_fde)
+			{
+				jobs.push_back(fde_job { i_fde->get_low_pc(), i_fde->get_low_pc() + i_fde->get_func_length(),
+					i_fde->instr_bytes_seq(), i_fde->find_cie() - cie_begin() });
+			}
+
+			/* Phase two: fan the FDEs out. Workers grab small blocks of FDEs
+			 * from a shared counter, since FDEs vary a lot in size. */
+			std::vector<instrs_results> results(jobs.size());
+			std::atomic<unsigned> next_job(0);
+			const unsigned block_size = 64;
+			auto work = [&]() {
+				for (unsigned begin = next_job.fetch_add(block_size); begin < jobs.size();
+					begin = next_job.fetch_add(block_size))
+				{
+					for (unsigned j = begin; j < std::min<unsigned>(begin + block_size, jobs.size()); ++j)
+					{
+						const fde_job& job = jobs[j];
+						const Cie& cie = cies.at(job.cie_idx);
+						instrs_results initial = cie_initial_shareable[job.cie_idx]
+							? cie_initial_results[job.cie_idx]
+							: interpret_instructions(cie, job.lopc, cie.get_initial_instructions(),
+								cie.get_initial_instructions_length());
+						if (cie_initial_shareable[job.cie_idx]) initial.unfinished_row_addr = job.lopc;
+						results[j] = interpret_instructions(cie, initial.unfinished_row_addr,
+							job.instrs.first, job.instrs.second - job.instrs.first, initial);
+						if (results[j].unfinished_row_addr < job.hipc) results[j].add_unfinished_row(job.hipc);
+					}
+				}
+			};
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			/* Malformed CFI can throw. An exception escaping a std::thread
+			 * terminates the process, so each worker catches its own, and
+			 * we rethrow the first once everyone has been joined. */
+			std::vector<std::exception_ptr> errors(nthreads);
+			auto guarded_work = [&](unsigned worker) {
+				try { work(); }
+				catch (...)
+				{
+					errors[worker] = std::current_exception();
+					next_job = jobs.size(); // the others may as well stop
+				}
+			};
+			std::vector<std::thread> workers;
+			for (unsigned i = 1; i < nthreads; ++i)
+			{
+				// if we can't start a thread, the rest of us will take up the slack
+				try { workers.push_back(std::thread(guarded_work, i)); }
+				catch (std::system_error&) { break; }
+			}
+			guarded_work(0); // this thread works too
+			for (auto i_worker = workers.begin(); i_worker != workers.end(); ++i_worker) i_worker->join();
+			for (auto i_err = errors.begin(); i_err != errors.end(); ++i_err)
+			{
+				if (*i_err) std::rethrow_exception(*i_err);
+			}
+
+			/* Phase three: lay the results out in columns. */
+			expanded_section out;
+			for (unsigned j = 0; j < results.size(); ++j)
+			{
+				out.fde_first_row.push_back(out.row_lopc.size());
+				for (auto i_row = results[j].rows.begin(); i_row != results[j].rows.end(); ++i_row)
+				{
+					out.row_lopc.push_back(i_row->first.lower());
+					out.row_hipc.push_back(i_row->first.upper());
+					out.row_fde_idx.push_back(j);
+					out.row_first_col.push_back(out.col_regnum.size());
+					for (auto i_def = i_row->second.begin(); i_def != i_row->second.end(); ++i_def)
+					{
+						out.col_regnum.push_back(i_def->first);
+						out.col_def.push_back(i_def->second);
+					}
+				}
+				results[j] = instrs_results(); // free as we go
+			}
+			out.fde_first_row.push_back(out.row_lopc.size());
+			out.row_first_col.push_back(out.col_regnum.size());
+			return out;
+		}
+
+		unwinder::unwinder(const FrameSection& fs, memory_reader read_word)
+		 : fs(fs), table(fs.get_compiled_table()), read_word(read_word), callee_saved(0),
+		   sp_column(-1), cfa_minus_sp(0)
+		{
+			/* If we don't know the ABI, the caller gets only what the CFI gives it. */
+			const lib::dwarf_reg_arch *arch = fs.get_reg_arch();
+			if (arch)
+			{
+				callee_saved = arch->callee_saved;
+				sp_column = arch->sp;
+				cfa_minus_sp = arch->cfa_minus_sp;
+			}
+		}
+
+		const FrameSection::compiled_row *
+		unwinder::find_row(Dwarf_Addr lookup_pc, const FrameSection::compiled_row *hint) const
+		{
+			// consecutive samples often hit the same row, so try that first
+			if (hint && hint->lopc <= lookup_pc && lookup_pc < hint->hipc) return hint;
+			return table.row_for_pc(lookup_pc);
+		}
+
+		bool unwinder::step(Dwarf_Addr pc, bool is_innermost, expr::regs& in,
+			unwound_regs& out, Dwarf_Addr *out_caller_pc, Dwarf_Addr *out_cfa) const
+		{
+			/* In a caller frame, pc is a return address, which may be just
+			 * past the end of the calling function's FDE. */
+			auto p_row = find_row(is_innermost ? pc : pc - 1, nullptr);
+			if (!p_row) return false;
+			return step_with_row(*p_row, in, out, out_caller_pc, out_cfa);
+		}
+
+		bool unwinder::step_with_row(const FrameSection::compiled_row& row, expr::regs& in,
+			unwound_regs& out, Dwarf_Addr *out_caller_pc, Dwarf_Addr *out_cfa) const
+		{
+			typedef FrameSection::register_def register_def;
+			out.clear();
+			try
+			{
+				/* First the CFA. */
+				Dwarf_Addr cfa;
+				switch (row.cfa.get_kind())
+				{
+					case register_def::REGISTER:
+						cfa = in.get(row.cfa.reg) + row.cfa.offset_or_expr;
+						break;
+					case register_def::SAVED_AT_EXPR: { // a.k.a. DW_CFA_def_cfa_expression: value is the CFA
+						const encap::loc_expr& e_cfa = table.expr_for(row.cfa);
+						expr::evaluator e(e_cfa.data(), e_cfa.data() + e_cfa.size(),
+							spec::DEFAULT_DWARF_SPEC, &in, 0);
+						cfa = e.tos();
+					} break;
+					default:
+						debug() << "Can't unwind: no CFA rule at 0x" << std::hex << row.lopc << std::dec << endl;
+						return false;
+				}
+				if (out_cfa) *out_cfa = cfa;
+
+				/* Where the CFI is silent, callee-saved registers keep their
+				 * values; the others could be anything. */
+				for (int col = 0; col < 64; ++col)
+				{
+					if (!(callee_saved & (1ull << col))) continue;
+					try { out.set(col, in.get(col)); } catch (No_entry) {}
+				}
+				if (sp_column != -1) out.set(sp_column, cfa - cfa_minus_sp);
+
+				for (auto p_rule = table.rules_begin(row); p_rule != table.rules_end(row); ++p_rule)
+				{
+					Dwarf_Unsigned word;
+					switch (p_rule->get_kind())
+					{
+						case register_def::INDETERMINATE:
+						case register_def::UNDEFINED:
+							out.unset(p_rule->column);
+							break;
+						case register_def::SAME_VALUE:
+							out.set(p_rule->column, in.get(p_rule->column));
+							break;
+						case register_def::SAVED_AT_OFFSET_FROM_CFA:
+							if (!read_word(cfa + p_rule->offset_or_expr, &word)) goto unreadable;
+							out.set(p_rule->column, word);
+							break;
+						case register_def::VAL_IS_OFFSET_FROM_CFA:
+							out.set(p_rule->column, cfa + p_rule->offset_or_expr);
+							break;
+						case register_def::REGISTER:
+							out.set(p_rule->column, in.get(p_rule->reg) + p_rule->offset_or_expr);
+							break;
+						/* Expression rules start with the CFA pushed. */
+						case register_def::SAVED_AT_EXPR: {
+							const encap::loc_expr& e_rule = table.expr_for(*p_rule);
+							expr::evaluator e(e_rule.data(), e_rule.data() + e_rule.size(),
+								spec::DEFAULT_DWARF_SPEC, &in, 0, { cfa });
+							if (!read_word(e.tos(), &word)) goto unreadable;
+							out.set(p_rule->column, word);
+						} break;
+						case register_def::VAL_OF_EXPR: {
+							const encap::loc_expr& e_rule = table.expr_for(*p_rule);
+							expr::evaluator e(e_rule.data(), e_rule.data() + e_rule.size(),
+								spec::DEFAULT_DWARF_SPEC, &in, 0, { cfa });
+							out.set(p_rule->column, e.tos(true));
+						} break;
+						default: assert(false);
+					}
+					continue;
+				unreadable:
+					/* We can't recover this register, but we may not need it. */
+					out.unset(p_rule->column);
+				}
+
+				if (!out.has(row.ra_column)) return false;
+				*out_caller_pc = out.get(row.ra_column);
+				return true;
+			}
+			catch (No_entry)
+			{
+				// we needed a register, or memory, that we don't have
+				return false;
+			}
+			catch (expr::Not_supported)
+			{
+				return false;
+			}
+		}
+
+		void unwinder::unwind_into(Dwarf_Addr pc, expr::regs& regs, unsigned max_frames,
+			std::vector<frame>& frames, unwound_regs (&bufs)[2]) const
+		{
+			expr::regs *p_in = &regs;
+			const FrameSection::compiled_row *p_row = nullptr;
+			for (unsigned n = 0; n < max_frames; ++n)
+			{
+				frame f = { pc, 0 };
+				p_row = find_row(n == 0 ? pc : pc - 1, p_row);
+				Dwarf_Addr caller_pc;
+				// alternate buffers, so that the caller's registers never overwrite our inputs
+				unwound_regs& out = bufs[n % 2];
+				bool ok = p_row && step_with_row(*p_row, *p_in, out, &caller_pc, &f.cfa);
+				frames.push_back(f);
+				if (!ok || caller_pc == 0) break;
+				// the stack grows one way, so the CFA must too; stop if not
+				if (frames.size() > 1 && frames[frames.size() - 2].cfa >= f.cfa) break;
+				pc = caller_pc;
+				p_in = &out;
+			}
+		}
+
+		std::vector<unwinder::frame>
+		unwinder::unwind(Dwarf_Addr pc, expr::regs& regs, unsigned max_frames) const
+		{
+			std::vector<frame> frames;
+			unwound_regs bufs[2];
+			unwind_into(pc, regs, max_frames, frames, bufs);
+			return frames;
+		}
+
+		std::vector<std::vector<unwinder::frame> >
+		unwinder::unwind_batch(const std::vector<sample>& samples, unsigned max_frames) const
+		{
+			/* The tables are shared and read-only, so this is just a loop;
+			 * the main saving over calling unwind() yourself is that we
+			 * allocate the register buffers once. */
+			std::vector<std::vector<frame> > results(samples.size());
+			unwound_regs bufs[2];
+			for (unsigned i = 0; i < samples.size(); ++i)
+			{
+				unwind_into(samples[i].pc, *samples[i].p_regs, max_frames, results[i], bufs);
+			}
+			return results;
+		}
 	}
 	namespace encap
 	{
@@ -1225,12 +1696,14 @@ namespace dwarf
 										<< " with CFA" << std::showpos << sum_of_differences << std::noshowpos 
 										<< " " << std::showpos << regoff << std::noshowpos
 										<< endl;
+									const lib::dwarf_reg_arch *arch = fs.get_reg_arch();
+									auto reg_name = [arch](int regnum) -> const char * {
+										if (regnum == core::FAKE_CFA_REGISTER) return "CFA";
+										const char *name = lib::dwarf_regname(arch, regnum);
+										return (name && *name) ? name : "(unknown)";
+									};
 									for (auto i_edge = path_edges.rbegin(); i_edge != path_edges.rend(); ++i_edge)
 									{
-										auto reg_name = [&](int regnum) -> const char * {
-											if (regnum == core::FAKE_CFA_REGISTER) return "CFA";
-											else return dwarf_regnames_for_elf_machine(fs.get_elf_machine())[regnum];
-										};
 										debug() << reg_name(i_edge->from_reg) 
 											<< std::showpos << i_edge->difference << std::noshowpos
 											<< " == " << reg_name(i_edge->to_reg) << endl;
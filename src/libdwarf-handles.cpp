@@ -174,7 +174,7 @@ namespace dwarf
 			int ret = dwarf_init(fd, DW_DLC_READ, exception_error_handler, 
 				nullptr, &returned, &current_dwarf_error);
 			assert(ret == DW_DLV_OK);
-			this->handle = handle_type(returned);
+			this->handle = handle_type(returned, deleter());
 		}
 		
 		Debug::Debug(Elf *elf)
@@ -184,7 +184,7 @@ namespace dwarf
 				DW_DLC_READ, exception_error_handler, 
 				nullptr, &returned, &current_dwarf_error);
 			assert(ret == DW_DLV_OK);
-			this->handle = handle_type(returned);
+			this->handle = handle_type(returned, deleter());
 		}
 		
 		void 
@@ -0,0 +1,237 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * memory.cpp: target memory readers for the expression evaluator.
+ *
+ * Copyright (c) 2010--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+
+#include "dwarfpp/memory.hpp"
+
+using std::endl;
+using std::make_pair;
+
+namespace dwarf
+{
+	namespace expr
+	{
+		using namespace dwarf::lib;
+		using core::debug;
+
+		static bool host_is_big_endian()
+		{
+			const uint16_t one = 1;
+			return *reinterpret_cast<const unsigned char *>(&one) == 0;
+		}
+
+		const page_cached_memory::page&
+		page_cached_memory::get_page(Dwarf_Addr page_addr)
+		{
+			if (p_last_page && last_page_addr == page_addr) return *p_last_page;
+			auto found = pages.find(page_addr);
+			if (found == pages.end())
+			{
+				/* When full, start again rather than tracking recency. A
+				 * working set bigger than the cache is unusual for us. */
+				if (pages.size() >= max_pages) flush();
+				unique_ptr<page> p(new page);
+				valid_ranges valid;
+				fetch_page(page_addr, p->bytes, valid);
+				for (auto i_r = valid.begin(); i_r != valid.end(); ++i_r)
+				{
+					if (i_r->first >= i_r->second) continue;
+					if (!p->valid.empty() && i_r->first <= p->valid.back().second)
+					{
+						p->valid.back().second = std::max(p->valid.back().second, i_r->second);
+					}
+					else p->valid.push_back(*i_r);
+				}
+				++nfetched;
+				found = pages.insert(make_pair(page_addr, std::move(p))).first;
+			}
+			last_page_addr = page_addr;
+			p_last_page = found->second.get();
+			return *p_last_page;
+		}
+		void page_cached_memory::read_bytes(Dwarf_Addr addr, unsigned char *buf, size_t nbytes)
+		{
+			while (nbytes > 0)
+			{
+				Dwarf_Addr page_addr = addr & ~(Dwarf_Addr)(CACHE_PAGE_SIZE - 1);
+				unsigned off = addr - page_addr;
+				unsigned n = std::min<size_t>(nbytes, CACHE_PAGE_SIZE - off);
+				const page& pg = get_page(page_addr);
+				auto i_r = pg.valid.begin();
+				while (i_r != pg.valid.end() && i_r->second <= off) ++i_r;
+				if (i_r == pg.valid.end() || off < i_r->first || off + n > i_r->second)
+				{
+					debug(2) << "Memory at 0x" << std::hex << addr << std::dec
+						<< " is not available" << endl;
+					throw No_entry();
+				}
+				memcpy(buf, pg.bytes + off, n);
+				buf += n;
+				addr += n;
+				nbytes -= n;
+			}
+		}
+		Dwarf_Unsigned page_cached_memory::read(Dwarf_Addr addr, unsigned nbytes)
+		{
+			if (nbytes > sizeof (Dwarf_Unsigned)) throw Not_supported("reading more than a word");
+			unsigned char buf[sizeof (Dwarf_Unsigned)];
+			read_bytes(addr, buf, nbytes);
+			Dwarf_Unsigned value = 0;
+			for (unsigned i = 0; i < nbytes; ++i)
+			{
+				unsigned shift = 8 * (big_endian ? nbytes - 1 - i : i);
+				value |= (Dwarf_Unsigned) buf[i] << shift;
+			}
+			return value;
+		}
+		void page_cached_memory::flush()
+		{
+			pages.clear();
+			p_last_page = nullptr;
+		}
+
+		fd_memory::fd_memory(int fd, unsigned addr_size)
+		 : page_cached_memory(host_is_big_endian()), fd(fd), owned(false), addr_size(addr_size)
+		{}
+		fd_memory::fd_memory(const string& path, unsigned addr_size)
+		 : page_cached_memory(host_is_big_endian()), fd(open(path.c_str(), O_RDONLY)), owned(true),
+		   addr_size(addr_size)
+		{
+			if (fd == -1)
+			{
+				debug() << "Could not open " << path << " to read memory" << endl;
+				throw No_entry();
+			}
+		}
+		fd_memory::~fd_memory()
+		{
+			if (owned) close(fd);
+		}
+		string fd_memory::path_for_pid(int pid)
+		{
+			std::ostringstream s;
+			s << "/proc/" << pid << "/mem";
+			return s.str();
+		}
+		unsigned fd_memory::address_size_for_pid(int pid)
+		{
+			std::ostringstream s;
+			s << "/proc/" << pid << "/exe";
+			int exe_fd = open(s.str().c_str(), O_RDONLY);
+			if (exe_fd == -1)
+			{
+				debug() << "Could not open " << s.str() << endl;
+				throw No_entry();
+			}
+			unsigned char ident[EI_NIDENT];
+			bool got_ident = (pread(exe_fd, ident, EI_NIDENT, 0) == EI_NIDENT
+				&& memcmp(ident, ELFMAG, SELFMAG) == 0);
+			close(exe_fd);
+			if (got_ident && ident[EI_CLASS] == ELFCLASS32) return 4;
+			if (got_ident && ident[EI_CLASS] == ELFCLASS64) return 8;
+			debug() << s.str() << " is not an ELF file we understand" << endl;
+			throw No_entry();
+		}
+		void fd_memory::fetch_page(Dwarf_Addr page_addr, unsigned char *buf, valid_ranges& valid)
+		{
+			/* An unmapped page fails outright; a short read means we ran
+			 * into one partway. */
+			ssize_t n = pread(fd, buf, CACHE_PAGE_SIZE, (off_t) page_addr);
+			if (n > 0) valid.push_back(make_pair(0u, (unsigned) n));
+		}
+
+		core_file_memory::core_file_memory(const string& path)
+		 : fd(open(path.c_str(), O_RDONLY)), addr_size(sizeof (Dwarf_Addr))
+		{
+			if (fd == -1)
+			{
+				debug() << "Could not open core file " << path << endl;
+				throw No_entry();
+			}
+			unsigned char ident[EI_NIDENT];
+			if (pread(fd, ident, EI_NIDENT, 0) != EI_NIDENT
+				|| memcmp(ident, ELFMAG, SELFMAG) != 0)
+			{
+				close(fd);
+				debug() << path << " is not an ELF file" << endl;
+				throw No_entry();
+			}
+			big_endian = (ident[EI_DATA] == ELFDATA2MSB);
+			if (big_endian != host_is_big_endian())
+			{
+				/* We'd have to byte-swap the headers; we don't yet. */
+				close(fd);
+				debug() << "Core file " << path << " has foreign byte order" << endl;
+				throw No_entry();
+			}
+			/* Read the program headers, in whichever class, keeping PT_LOADs. */
+#define read_loads(Ehdr, Phdr) { \
+				Ehdr ehdr; \
+				if (pread(fd, &ehdr, sizeof ehdr, 0) != sizeof ehdr || ehdr.e_type != ET_CORE) goto not_core; \
+				for (unsigned i = 0; i < ehdr.e_phnum; ++i) \
+				{ \
+					Phdr phdr; \
+					if (pread(fd, &phdr, sizeof phdr, ehdr.e_phoff + (off_t) i * ehdr.e_phentsize) \
+						!= sizeof phdr) goto not_core; \
+					if (phdr.p_type != PT_LOAD || phdr.p_filesz == 0) continue; \
+					segments.push_back(segment { phdr.p_vaddr, phdr.p_filesz, phdr.p_offset }); \
+				} \
+			}
+			switch (ident[EI_CLASS])
+			{
+				case ELFCLASS32:
+					addr_size = 4;
+					read_loads(Elf32_Ehdr, Elf32_Phdr)
+					break;
+				case ELFCLASS64:
+					addr_size = 8;
+					read_loads(Elf64_Ehdr, Elf64_Phdr)
+					break;
+				default:
+				not_core:
+					close(fd);
+					debug() << path << " is not an ELF core file" << endl;
+					throw No_entry();
+			}
+#undef read_loads
+			std::sort(segments.begin(), segments.end(),
+				[](const segment& s1, const segment& s2) { return s1.vaddr < s2.vaddr; });
+		}
+		core_file_memory::~core_file_memory()
+		{
+			close(fd);
+		}
+		void core_file_memory::fetch_page(Dwarf_Addr page_addr, unsigned char *buf, valid_ranges& valid)
+		{
+			/* Segments are page-aligned in practice, so usually one segment
+			 * covers the whole page. If several meet it, say exactly which
+			 * bytes each gave us: there may be gaps between them, and a
+			 * truncated core may give us less than a segment promises. */
+			auto i_seg = std::upper_bound(segments.begin(), segments.end(), page_addr,
+				[](Dwarf_Addr addr, const segment& s) { return addr < s.vaddr; });
+			if (i_seg != segments.begin()) --i_seg;
+			for (; i_seg != segments.end() && i_seg->vaddr < page_addr + CACHE_PAGE_SIZE; ++i_seg)
+			{
+				Dwarf_Addr lo = std::max(page_addr, i_seg->vaddr);
+				Dwarf_Addr hi = std::min(page_addr + CACHE_PAGE_SIZE, i_seg->vaddr + i_seg->filesz);
+				if (lo >= hi) continue;
+				ssize_t n = pread(fd, buf + (lo - page_addr), hi - lo,
+					i_seg->offset + (lo - i_seg->vaddr));
+				if (n <= 0) continue; // truncated core
+				valid.push_back(make_pair((unsigned) (lo - page_addr), (unsigned) (lo - page_addr + n)));
+			}
+		}
+	}
+}
@@ -43,33 +43,434 @@ const char *dwarf_regnames_x86_64[] = {
 	nullptr
 };
 
-const char **dwarf_regnames_for_elf_machine(int e_machine)
+/* Reserved numbers get an empty name, so the arrays stay nullptr-terminated. */
+const char *dwarf_regnames_aarch64[] = {
+	"x0",
+	"x1",
+	"x2",
+	"x3",
+	"x4",
+	"x5",
+	"x6",
+	"x7",
+	"x8",
+	"x9",
+	"x10",
+	"x11",
+	"x12",
+	"x13",
+	"x14",
+	"x15",
+	"x16",
+	"x17",
+	"x18",
+	"x19",
+	"x20",
+	"x21",
+	"x22",
+	"x23",
+	"x24",
+	"x25",
+	"x26",
+	"x27",
+	"x28",
+	"x29",
+	"x30",
+	"sp",
+	"pc",
+	"elr_mode",
+	"ra_sign_state",
+	"tpidrro_el0",
+	"tpidr_el0",
+	"", // reserved
+	"", // reserved
+	"", // reserved
+	"", // reserved
+	"", // reserved
+	"", // reserved
+	"", // reserved
+	"", // reserved
+	"", // reserved
+	"vg",
+	"ffr",
+	"p0",
+	"p1",
+	"p2",
+	"p3",
+	"p4",
+	"p5",
+	"p6",
+	"p7",
+	"p8",
+	"p9",
+	"p10",
+	"p11",
+	"p12",
+	"p13",
+	"p14",
+	"p15",
+	"v0",
+	"v1",
+	"v2",
+	"v3",
+	"v4",
+	"v5",
+	"v6",
+	"v7",
+	"v8",
+	"v9",
+	"v10",
+	"v11",
+	"v12",
+	"v13",
+	"v14",
+	"v15",
+	"v16",
+	"v17",
+	"v18",
+	"v19",
+	"v20",
+	"v21",
+	"v22",
+	"v23",
+	"v24",
+	"v25",
+	"v26",
+	"v27",
+	"v28",
+	"v29",
+	"v30",
+	"v31",
+	nullptr
+};
+
+const char *dwarf_regnames_riscv[] = {
+	"zero",
+	"ra",
+	"sp",
+	"gp",
+	"tp",
+	"t0",
+	"t1",
+	"t2",
+	"s0",
+	"s1",
+	"a0",
+	"a1",
+	"a2",
+	"a3",
+	"a4",
+	"a5",
+	"a6",
+	"a7",
+	"s2",
+	"s3",
+	"s4",
+	"s5",
+	"s6",
+	"s7",
+	"s8",
+	"s9",
+	"s10",
+	"s11",
+	"t3",
+	"t4",
+	"t5",
+	"t6",
+	"ft0",
+	"ft1",
+	"ft2",
+	"ft3",
+	"ft4",
+	"ft5",
+	"ft6",
+	"ft7",
+	"fs0",
+	"fs1",
+	"fa0",
+	"fa1",
+	"fa2",
+	"fa3",
+	"fa4",
+	"fa5",
+	"fa6",
+	"fa7",
+	"fs2",
+	"fs3",
+	"fs4",
+	"fs5",
+	"fs6",
+	"fs7",
+	"fs8",
+	"fs9",
+	"fs10",
+	"fs11",
+	"ft8",
+	"ft9",
+	"ft10",
+	"ft11",
+	nullptr
+};
+
+const char *dwarf_regnames_arm[] = {
+	"r0",
+	"r1",
+	"r2",
+	"r3",
+	"r4",
+	"r5",
+	"r6",
+	"r7",
+	"r8",
+	"r9",
+	"r10",
+	"r11",
+	"r12",
+	"sp",
+	"lr",
+	"pc",
+	nullptr
+};
+
+const char *dwarf_regnames_ppc64[] = {
+	"r0",
+	"r1",
+	"r2",
+	"r3",
+	"r4",
+	"r5",
+	"r6",
+	"r7",
+	"r8",
+	"r9",
+	"r10",
+	"r11",
+	"r12",
+	"r13",
+	"r14",
+	"r15",
+	"r16",
+	"r17",
+	"r18",
+	"r19",
+	"r20",
+	"r21",
+	"r22",
+	"r23",
+	"r24",
+	"r25",
+	"r26",
+	"r27",
+	"r28",
+	"r29",
+	"r30",
+	"r31",
+	"f0",
+	"f1",
+	"f2",
+	"f3",
+	"f4",
+	"f5",
+	"f6",
+	"f7",
+	"f8",
+	"f9",
+	"f10",
+	"f11",
+	"f12",
+	"f13",
+	"f14",
+	"f15",
+	"f16",
+	"f17",
+	"f18",
+	"f19",
+	"f20",
+	"f21",
+	"f22",
+	"f23",
+	"f24",
+	"f25",
+	"f26",
+	"f27",
+	"f28",
+	"f29",
+	"f30",
+	"f31",
+	"mq",
+	"lr",
+	"ctr",
+	"ap",
+	"cr0",
+	"cr1",
+	"cr2",
+	"cr3",
+	"cr4",
+	"cr5",
+	"cr6",
+	"cr7",
+	"xer",
+	"vr0",
+	"vr1",
+	"vr2",
+	"vr3",
+	"vr4",
+	"vr5",
+	"vr6",
+	"vr7",
+	"vr8",
+	"vr9",
+	"vr10",
+	"vr11",
+	"vr12",
+	"vr13",
+	"vr14",
+	"vr15",
+	"vr16",
+	"vr17",
+	"vr18",
+	"vr19",
+	"vr20",
+	"vr21",
+	"vr22",
+	"vr23",
+	"vr24",
+	"vr25",
+	"vr26",
+	"vr27",
+	"vr28",
+	"vr29",
+	"vr30",
+	"vr31",
+	nullptr
+};
+
+const char *dwarf_regnames_s390x[] = {
+	"r0",
+	"r1",
+	"r2",
+	"r3",
+	"r4",
+	"r5",
+	"r6",
+	"r7",
+	"r8",
+	"r9",
+	"r10",
+	"r11",
+	"r12",
+	"r13",
+	"r14",
+	"r15",
+	"f0",
+	"f2",
+	"f4",
+	"f6",
+	"f1",
+	"f3",
+	"f5",
+	"f7",
+	"f8",
+	"f10",
+	"f12",
+	"f14",
+	"f9",
+	"f11",
+	"f13",
+	"f15",
+	"c0",
+	"c1",
+	"c2",
+	"c3",
+	"c4",
+	"c5",
+	"c6",
+	"c7",
+	"c8",
+	"c9",
+	"c10",
+	"c11",
+	"c12",
+	"c13",
+	"c14",
+	"c15",
+	"a0",
+	"a1",
+	"a2",
+	"a3",
+	"a4",
+	"a5",
+	"a6",
+	"a7",
+	"a8",
+	"a9",
+	"a10",
+	"a11",
+	"a12",
+	"a13",
+	"a14",
+	"a15",
+	"pswm",
+	"pswa",
+	nullptr
+};
+
+#define nregnames_of(arr) ((int) (sizeof arr / sizeof arr[0]) - 1)
+/* Callee-saved registers are from each psABI: x86 ebx, esp, ebp, esi, edi;
+ * x86_64 rbx, rbp, rsp, r12--r15; aarch64 x19--x29, sp; riscv sp, s0--s11,
+ * fs0--fs11; arm r4--r11, sp; ppc64 r1, r2, r14--r31, f14--f31; s390x
+ * r6--r13, r15, f8--f15. Vector registers are beyond the 64 we track.
+ * Only s390x's CFA isn't the caller's SP: it's 160 bytes above. RISC-V
+ * uses the same numbering for 32 and 64 bits, so its address size is
+ * whatever the ELF class says. */
+/*                                            e_machine name       regnames                  nregnames                          callee_saved         cfa_minus_sp sp  fp  ra  pc  addr */
+const dwarf_reg_arch dwarf_reg_arch_x86     = { 3,      "x86",     dwarf_regnames_x86,     nregnames_of(dwarf_regnames_x86),     0xf8ull,               0,   4,  5,  8,  8,  4 };
+const dwarf_reg_arch dwarf_reg_arch_x86_64  = { 62,     "x86_64",  dwarf_regnames_x86_64,  nregnames_of(dwarf_regnames_x86_64),  0xf0c8ull,             0,   7,  6,  16, 16, 8 };
+const dwarf_reg_arch dwarf_reg_arch_aarch64 = { 183,    "aarch64", dwarf_regnames_aarch64, nregnames_of(dwarf_regnames_aarch64), 0xbff80000ull,         0,   31, 29, 30, 32, 8 };
+const dwarf_reg_arch dwarf_reg_arch_riscv   = { 243,    "riscv",   dwarf_regnames_riscv,   nregnames_of(dwarf_regnames_riscv),   0x0ffc03000ffc0304ull, 0,   2,  8,  1,  -1, 0 };
+const dwarf_reg_arch dwarf_reg_arch_arm     = { 40,     "arm",     dwarf_regnames_arm,     nregnames_of(dwarf_regnames_arm),     0x2ff0ull,             0,   13, 11, 14, 15, 4 };
+const dwarf_reg_arch dwarf_reg_arch_ppc64   = { 21,     "ppc64",   dwarf_regnames_ppc64,   nregnames_of(dwarf_regnames_ppc64),   0xffffc000ffffc006ull, 0,   1,  31, 65, -1, 8 };
+const dwarf_reg_arch dwarf_reg_arch_s390x   = { 22,     "s390x",   dwarf_regnames_s390x,   nregnames_of(dwarf_regnames_s390x),   0xff00bfc0ull,         160, 15, 11, 14, 65, 8 };
+#undef nregnames_of
+
+const dwarf_reg_arch *dwarf_reg_arch_for_elf_machine(int e_machine)
 {
 	switch (e_machine)
 	{
 		case /* EM_386 */           3:           /* Intel 80386 */
-			return dwarf_regnames_x86;
+			return &dwarf_reg_arch_x86;
 		case /* EM_X86_64 */       62:              /* AMD x86-64 architecture */
-			return dwarf_regnames_x86_64;
+			return &dwarf_reg_arch_x86_64;
+		case /* EM_AARCH64 */     183:              /* ARM AARCH64 */
+			return &dwarf_reg_arch_aarch64;
+		case /* EM_RISCV */       243:              /* RISC-V; same numbering for 32 and 64 */
+			return &dwarf_reg_arch_riscv;
+		case /* EM_ARM */          40:              /* ARM */
+			return &dwarf_reg_arch_arm;
+		case /* EM_PPC64 */        21:              /* PowerPC 64-bit */
+			return &dwarf_reg_arch_ppc64;
+		case /* EM_S390 */         22:              /* IBM S390; we assume s390x */
+			return &dwarf_reg_arch_s390x;
 		default:
 		return nullptr;
 	}
 }
 
+const char **dwarf_regnames_for_elf_machine(int e_machine)
+{
+	const dwarf_reg_arch *arch = dwarf_reg_arch_for_elf_machine(e_machine);
+	return arch ? arch->regnames : nullptr;
+}
+
 dwarf::encap::loc_expr dwarf_stack_pointer_expr_for_elf_machine(int e_machine,
 	dwarf::lib::Dwarf_Addr lopc, dwarf::lib::Dwarf_Addr hipc)
 {
 	using dwarf::encap::loc_expr;
 	using dwarf::lib::Dwarf_Unsigned;
-	switch (e_machine)
-	{
-		case /* EM_386 */           3:           /* Intel 80386 */
-			return loc_expr((Dwarf_Unsigned[]) { DW_OP_breg0 + DWARF_X86_ESP, 0 }, lopc, hipc);
-		case /* EM_X86_64 */       62:              /* AMD x86-64 architecture */
-			return loc_expr((Dwarf_Unsigned[]) { DW_OP_breg0 + DWARF_X86_64_RSP, 0 }, lopc, hipc);
-		default:
-		return loc_expr();
-	}
+	const dwarf_reg_arch *arch = dwarf_reg_arch_for_elf_machine(e_machine);
+	if (!arch || arch->sp == -1) return loc_expr();
+	if (arch->sp < 32) return loc_expr((Dwarf_Unsigned[]) { DW_OP_breg0 + (Dwarf_Unsigned) arch->sp, 0 }, lopc, hipc);
+	return loc_expr((Dwarf_Unsigned[]) { DW_OP_bregx, (Dwarf_Unsigned) arch->sp, 0 }, lopc, hipc);
 }
 
 }
@@ -13,6 +13,10 @@
 #include "dwarfpp/frame.hpp"
 
 #include <iostream>
+#include <mutex>
+#include <tuple>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <srk31/indenting_ostream.hpp>
 #include <srk31/algorithm.hpp>
 
@@ -169,10 +173,13 @@ namespace dwarf
 // 			} else return find_self();
 		}
 		
+		const Dwarf_Unsigned root_die::type_facts_table::NO_SIZE;
+		const Dwarf_Unsigned root_die::TYPE_TOPO_SPACING;
+		
 		root_die::root_die(int fd)
 		 :  dbg(fd), 
+			type_topo_order_valid(true),
 			visible_named_grandchildren_is_complete(false),
-			p_fs(new FrameSection(get_dbg(), true)), 
 			current_cu_offset(0UL), returned_elf(nullptr), 
 			first_cu_offset(),
 			last_seen_cu_header_length(),
@@ -182,9 +189,97 @@ namespace dwarf
 			last_seen_offset_size(),
 			last_seen_extension_size(),
 			last_seen_next_cu_header()
-		{ assert(p_fs != 0); }
+		{
+			struct stat st;
+			if (fstat(fd, &st) == 0)
+			{
+				file_identity = file_identity_t(st.st_dev, st.st_ino,
+					st.st_mtim.tv_sec, st.st_mtim.tv_nsec, st.st_size);
+			}
+		}
 		
-		root_die::~root_die() { delete p_fs; }
+		root_die::~root_die() {}
+		
+		namespace
+		{
+			/* A FrameSection with a share in the libdwarf handle it was built
+			 * on, so that it can be shared between root_dies and outlive any of
+			 * them. Members are destroyed in reverse order, so the handle goes
+			 * last. */
+			struct owned_frame_section
+			{
+				Debug dbg;
+				FrameSection fs;
+				owned_frame_section(const Debug& root_dbg) : dbg(root_dbg), fs(dbg, true) {}
+			};
+			/* One slot per file. Building a section takes a while, so we do it
+			 * holding only the slot's lock: other files' sections can be built
+			 * at the same time, and other users of this one wait for it. */
+			struct frame_section_slot
+			{
+				std::mutex mutex;
+				std::weak_ptr<owned_frame_section> p_owned;
+			};
+			/* Entries expire when the last user of their section does. Rather
+			 * than sweep on every lookup, we sweep when the map has doubled in
+			 * size since the last sweep, so the cost is amortised. */
+			map<root_die::file_identity_t, std::shared_ptr<frame_section_slot> > frame_sections_by_file;
+			std::mutex frame_sections_by_file_mutex;
+			size_t frame_sections_next_sweep = 16;
+
+			void sweep_frame_sections()
+			{
+				for (auto i = frame_sections_by_file.begin(); i != frame_sections_by_file.end(); )
+				{
+					/* If nobody else has the slot, nobody else can get it
+					 * while we hold the map's lock. */
+					bool dead = false;
+					if (i->second.use_count() == 1)
+					{
+						std::lock_guard<std::mutex> guard(i->second->mutex);
+						dead = i->second->p_owned.expired();
+					}
+					if (dead) i = frame_sections_by_file.erase(i);
+					else ++i;
+				}
+				frame_sections_next_sweep = std::max<size_t>(16, 2 * frame_sections_by_file.size());
+			}
+		}
+		
+		std::shared_ptr<FrameSection> root_die::frame_section_ptr() const
+		{
+			/* Another thread may be setting p_fs as we look. If we both miss,
+			 * we both find the same shared section below; no harm done. */
+			auto p_existing = std::atomic_load(&p_fs);
+			if (p_existing) return p_existing;
+			assert(file_identity);
+			std::shared_ptr<frame_section_slot> p_slot;
+			{
+				std::lock_guard<std::mutex> guard(frame_sections_by_file_mutex);
+				auto found = frame_sections_by_file.find(*file_identity);
+				if (found != frame_sections_by_file.end()) p_slot = found->second;
+				else
+				{
+					if (frame_sections_by_file.size() >= frame_sections_next_sweep) sweep_frame_sections();
+					p_slot = std::make_shared<frame_section_slot>();
+					frame_sections_by_file.insert(make_pair(*file_identity, p_slot));
+				}
+			}
+			std::shared_ptr<owned_frame_section> p_owned;
+			{
+				std::lock_guard<std::mutex> guard(p_slot->mutex);
+				p_owned = p_slot->p_owned.lock();
+				if (!p_owned)
+				{
+					p_owned = std::make_shared<owned_frame_section>(dbg);
+					p_slot->p_owned = p_owned;
+				}
+			}
+			// aliasing constructor: share ownership of the whole owned_frame_section
+			std::shared_ptr<FrameSection> p_new(p_owned, &p_owned->fs);
+			std::atomic_store(&p_fs, p_new);
+			return p_new;
+		}
 		
 		::Elf *root_die::get_elf()
 		{
@@ -632,14 +727,14 @@ namespace dwarf
 				return find(*this->synthetic_cu).as_a<compile_unit_die>();
 			}
 			
-			auto created = make_new(begin(), DW_TAG_compile_unit);
 			/* Set attributes. We must have a DW_AT_language. We pretend we're C.
 			 * FIXME: should have one synthetic CU per language requested? */
-			auto& attrs = dynamic_cast<core::in_memory_abstract_die&>(created.dereference()).attrs();
+			encap::attribute_map attrs;
 			encap::attribute_value v_lang((Dwarf_Unsigned) DW_LANG_C);
 			attrs.insert(make_pair(DW_AT_language, v_lang));
 			encap::attribute_value v_name(std::string("dwarfpp.synthetic"));
 			attrs.insert(make_pair(DW_AT_name, v_name));
+			auto created = make_new_synthetic(begin(), DW_TAG_compile_unit, attrs);
 			
 			this->synthetic_cu = created.offset_here();
 			iterator_df<compile_unit_die> created_cu = created.as_a<compile_unit_die>();
@@ -647,7 +742,7 @@ namespace dwarf
 		}
 		
 		iterator_base
-		root_die::make_new(const iterator_base& parent, Dwarf_Half tag)
+		root_die::create_in_memory(const iterator_base& parent, Dwarf_Half tag)
 		{
 			/* heap-allocate the right kind of (in-memory) DIE, 
 			 * creating the intrusive ptr, hence bumping the refcount */
@@ -659,8 +754,38 @@ namespace dwarf
 			parent_of.insert(make_pair(o, parent.offset_here()));
 			auto found = find(o);
 			assert(found);
+			if (type_topo_order_valid && found.is_a<type_die>())
+			{
+				/* It has no edges yet, so anywhere in the order will do; 
+				 * after everything else leaves the most room. */
+				set_type_topo_pos(o, type_topo_pos_counts.empty() ? 0
+					: type_topo_pos_counts.rbegin()->first + TYPE_TOPO_SPACING);
+			}
 			return found;
 		}
+		iterator_base
+		root_die::make_new(const iterator_base& parent, Dwarf_Half tag)
+		{
+			auto created = create_in_memory(parent, tag);
+			invalidate_type_caches();
+			return created;
+		}
+		iterator_base
+		root_die::make_new_synthetic(const iterator_base& parent, Dwarf_Half tag,
+			const encap::attribute_map& attrs)
+		{
+			assert(parent.is_root_position() || parent.tag_here() == DW_TAG_compile_unit);
+			auto created = create_in_memory(parent, tag);
+			dynamic_cast<in_memory_abstract_die&>(created.dereference()).attrs().insert_unhooked(attrs);
+			/* The one cache that a new DIE does affect: see
+			 * attribute_map::update_cache_on_insert(). */
+			if (created.depth() == 2 && created.global_name_here())
+			{
+				visible_named_grandchildren_cache.insert(
+					make_pair(*created.name_here(), created.offset_here()));
+			}
+			return created;
+		}
 		
 		/* NOTE: I was thinking to put all factory code in namespace spec, 
 		 * so that we can do 
@@ -610,8 +610,8 @@ pair_type name[] = { \
 						make_decl(DW_OP_call_ref, DW_FORM_ref_udata /* FIXME */) \
 						make_decl(DW_OP_form_tls_address, 0) \
 						make_decl(DW_OP_call_frame_cfa, 0) \
-						make_decl(DW_OP_bit_piece, 0) \
-						make_decl(DW_OP_implicit_value, 2) \
+						make_decl(DW_OP_bit_piece, DW_FORM_udata, DW_FORM_udata) \
+						make_decl(DW_OP_implicit_value, DW_FORM_udata) \
 						make_decl(DW_OP_stack_value, 0) /*\
 						make_decl(DW_OP_GNU_push_tls_address, 0) \
 						make_decl(DW_OP_HP_is_value, 0) \
@@ -624,9 +624,17 @@ pair_type name[] = { \
 
 		bool dwarf4_t::local_op_reads_register(int op) const
 		{
-			return (op >= DW_OP_reg0 && op <= DW_OP_bregx)
-				|| op == DW_OP_fbreg;
+			return op_info_for(op).reads_register;
 		}
+		
+		constexpr op_info dwarf_current_op_info::tbl[256];
+		// check the generated table against dwarf.h
+#define op_info_entry(code, name, ...) \
+		static_assert(DW_OP_ ## name == code, "opcode table disagrees with dwarf.h for DW_OP_" #name);
+#define op_info_none(code)
+#include "dwarf-current-opinfo.h"
+#undef op_info_none
+#undef op_info_entry
 		MAKE_LOOKUP(forward_name_mapping_t, op_forward_tbl, PAIR_ENTRY_FORWARDS_VARARGS, PAIR_ENTRY_FORWARDS_VARARGS_LAST, OP_DECL_LIST);
 		MAKE_LOOKUP(inverse_name_mapping_t, op_inverse_tbl, PAIR_ENTRY_BACKWARDS_VARARGS, PAIR_ENTRY_BACKWARDS_VARARGS_LAST, OP_DECL_LIST);
 
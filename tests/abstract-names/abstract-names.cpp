@@ -0,0 +1,52 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::core;
+
+/* precompute_abstract_names() must leave every type named, with the same
+ * name we'd print for it from scratch, even though naming our own
+ * bitfields makes new base types as it goes. */
+
+struct bits
+{
+	unsigned a:3;
+	unsigned b:9;
+	struct bits *next;
+} bits1;
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	root_die root(fileno(in));
+	root.precompute_abstract_names();
+
+	unsigned ntypes = 0;
+	for (auto i = root.begin(); i != root.end(); ++i)
+	{
+		if (!i.is_a<type_die>()) continue;
+		const string *p_cached = root.cached_abstract_name(i.offset_here());
+		assert(p_cached);
+		std::ostringstream s;
+		i.as_a<type_die>()->print_abstract_name(s);
+		assert(*p_cached == s.str());
+		// asking again gives the same string, not a copy
+		assert(&interned_abstract_name_for_type(i.as_a<type_die>()) == p_cached);
+		++ntypes;
+	}
+	cout << "All " << ntypes << " types named as expected" << endl;
+
+	/* That included the synthetic CU, if our bitfields needed one. */
+	auto cu = root.begin(); ++cu;
+	auto bits_die = cu.named_child("bits"); assert(bits_die);
+	auto b = bits_die.named_child("b"); assert(b);
+	auto b_t = b.as_a<member_die>()->find_or_create_type_handling_bitfields();
+	assert(root.cached_abstract_name(b_t.offset_here()));
+	return 0;
+}
@@ -0,0 +1,119 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+#include <dwarfpp/frame.hpp>
+#include <dwarfpp/regs.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+
+/* eh_frame CIEs of versions 1 and 3, which are what compilers emit, don't
+ * say how big an address is, so we get it from the architecture. Check that
+ * this works for machines other than the one we run on, by taking a copy of
+ * ourselves and changing its e_machine, and that a machine we don't know
+ * about gets an exception rather than an abort. */
+
+static std::vector<FrameSection::instrs_results> decode_all(const FrameSection& fs,
+	unsigned *p_address_size, unsigned *p_nsizeless)
+{
+	std::vector<FrameSection::instrs_results> results;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		auto i_cie = i_fde->find_cie();
+		if (i_cie->get_version() == 1 || i_cie->get_version() == 3) ++*p_nsizeless;
+		*p_address_size = i_cie->get_address_size();
+		results.push_back(i_fde->decode());
+	}
+	return results;
+}
+
+static string copy_with_machine(const char *path, uint16_t e_machine)
+{
+	char tmp_path[] = "/tmp/cie-arch.XXXXXX";
+	int fd = mkstemp(tmp_path);
+	assert(fd != -1);
+	close(fd);
+	{
+		std::ifstream in(path, std::ios::binary);
+		std::ofstream out(tmp_path, std::ios::binary);
+		out << in.rdbuf();
+	}
+	/* e_machine follows e_ident and e_type in either class, and we are
+	 * in our own byte order. */
+	fd = open(tmp_path, O_WRONLY);
+	assert(fd != -1);
+	ssize_t n = pwrite(fd, &e_machine, sizeof e_machine, EI_NIDENT + 2);
+	assert(n == sizeof e_machine);
+	close(fd);
+	return tmp_path;
+}
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+	FrameSection fs(root.get_dbg(), true);
+	unsigned native_address_size = 0, nsizeless = 0;
+	auto native = decode_all(fs, &native_address_size, &nsizeless);
+	assert(native.size() > 0);
+	cout << "Decoded " << native.size() << " FDEs natively, " << nsizeless
+		<< " of them with CIEs that don't give an address size" << endl;
+
+	const lib::dwarf_reg_arch *arches[] = { &lib::dwarf_reg_arch_aarch64, &lib::dwarf_reg_arch_riscv,
+		&lib::dwarf_reg_arch_arm, &lib::dwarf_reg_arch_ppc64, &lib::dwarf_reg_arch_s390x };
+	for (unsigned k = 0; k < sizeof arches / sizeof arches[0]; ++k)
+	{
+		string path = copy_with_machine(argv[0], arches[k]->e_machine);
+		std::ifstream foreign_in(path);
+		unlink(path.c_str());
+		core::root_die foreign_root(fileno(foreign_in));
+		FrameSection foreign_fs(foreign_root.get_dbg(), true);
+		assert(foreign_fs.get_reg_arch() == arches[k]);
+		unsigned address_size = 0, foreign_nsizeless = 0;
+		auto foreign = decode_all(foreign_fs, &address_size, &foreign_nsizeless);
+		cout << "As " << arches[k]->name << ": decoded " << foreign.size()
+			<< " FDEs, address size " << address_size << endl;
+		assert(foreign.size() == native.size());
+		/* RISC-V's address size is the ELF class's, i.e. ours. */
+		unsigned expected_size = arches[k]->address_size ? arches[k]->address_size
+			: native_address_size;
+		if (foreign_nsizeless > 0) assert(address_size == expected_size);
+		/* The instructions are the same, so where the address size is too,
+		 * so are the rows. */
+		if (address_size == native_address_size)
+		{
+			for (unsigned i = 0; i < native.size(); ++i) assert(foreign[i].rows == native[i].rows);
+		}
+	}
+
+	/* An e_machine nobody has. */
+	string path = copy_with_machine(argv[0], 0xfedc);
+	std::ifstream unknown_in(path);
+	unlink(path.c_str());
+	core::root_die unknown_root(fileno(unknown_in));
+	bool threw = false;
+	unsigned address_size = 0, unknown_nsizeless = 0;
+	try
+	{
+		FrameSection unknown_fs(unknown_root.get_dbg(), true);
+		decode_all(unknown_fs, &address_size, &unknown_nsizeless);
+	}
+	catch (expr::Not_supported) { threw = true; }
+	cout << "Unknown machine: " << (threw ? "threw" : "no exception") << endl;
+	assert(threw == (nsizeless > 0));
+
+	return 0;
+}
@@ -0,0 +1,110 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <initializer_list>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+#include <dwarfpp/expr.hpp>
+#include "../expr-fixture.hpp"
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::core;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Signed;
+using dwarf::lib::Dwarf_Addr;
+
+/* compiled_expr::eval must agree with the evaluator, for expressions of
+ * each closed form and for those it leaves DYNAMIC. Then, for in-memory
+ * DIEs, the compiled locations and frame bases we cache must follow
+ * edits to the attributes they were compiled from. */
+
+static void check(const char *what, std::initializer_list<unsigned char> bytes,
+	expr::closed_form::kind_t expected_kind, bool with_object = false)
+{
+	encap::loc_expr e = decode(bytes);
+	expr::compiled_expr c(e);
+	fake_regs regs;
+	fake_memory mem;
+	const Dwarf_Signed frame_base = 0x7ffd0000;
+	const Dwarf_Unsigned object_base = 0x600000;
+
+	Dwarf_Unsigned compiled = c.eval(&regs, frame_base,
+		with_object ? object_base : spec::opt<Dwarf_Unsigned>(), &mem);
+	Dwarf_Unsigned evaluated = with_object
+		? expr::evaluator(e.data(), e.data() + e.size(), spec::DEFAULT_DWARF_SPEC,
+			&regs, frame_base, { object_base }, &mem).tos(true)
+		: expr::evaluator(e.data(), e.data() + e.size(), spec::DEFAULT_DWARF_SPEC,
+			&regs, frame_base, {}, &mem).tos(true);
+	cout << what << ": kind " << c.kind << ", 0x" << std::hex << compiled
+		<< " (evaluator: 0x" << evaluated << ")" << std::dec << endl;
+	assert(c.kind == expected_kind);
+	assert(compiled == evaluated);
+}
+
+static in_memory_abstract_die::attribute_map& attrs_of(const iterator_base& i)
+{
+	return dynamic_cast<in_memory_abstract_die&>(i.dereference()).attrs();
+}
+static encap::attribute_value location(Dwarf_Unsigned op, Dwarf_Unsigned arg)
+{
+	Dwarf_Unsigned ops[] = { op, arg };
+	return encap::attribute_value(encap::loclist(encap::loc_expr(ops, 0, 0)));
+}
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+	p_root = &root;
+
+	typedef expr::closed_form f;
+	check("constant", { DW_OP_constu, 0xb4, 0x24 }, f::CONSTANT);
+	check("folded constant", { DW_OP_lit5, DW_OP_lit3, DW_OP_shl, DW_OP_const1s, 0xfe, DW_OP_plus }, f::CONSTANT);
+	check("constant value", { DW_OP_lit7, DW_OP_stack_value }, f::CONSTANT);
+	check("object-relative", { DW_OP_plus_uconst, 0x10 }, f::OBJECT_RELATIVE, true);
+	check("object-relative plus", { DW_OP_lit8, DW_OP_plus }, f::OBJECT_RELATIVE, true);
+	check("frame-base-relative", { DW_OP_fbreg, 0x68 }, f::FRAME_BASE_RELATIVE);
+	check("frame-base-relative plus", { DW_OP_fbreg, 0x08, DW_OP_plus_uconst, 0x04 }, f::FRAME_BASE_RELATIVE);
+	check("register-relative", { DW_OP_breg6, 0x10 }, f::REGISTER_RELATIVE);
+	check("register-relative, regx", { DW_OP_bregx, 40, 0x78 }, f::REGISTER_RELATIVE);
+	check("register-relative minus", { DW_OP_breg7, 0x00, DW_OP_lit8, DW_OP_minus }, f::REGISTER_RELATIVE);
+	check("CFA-relative", { DW_OP_call_frame_cfa, DW_OP_plus_uconst, 0x08 }, f::CFA_RELATIVE);
+	check("difference of registers", { DW_OP_breg1, 0x00, DW_OP_breg1, 0x08, DW_OP_minus }, f::CONSTANT);
+	check("dynamic: deref", { DW_OP_breg7, 0x00, DW_OP_deref }, f::DYNAMIC);
+	check("dynamic: two registers", { DW_OP_breg1, 0x00, DW_OP_breg2, 0x00, DW_OP_plus }, f::DYNAMIC);
+	check("dynamic: branch", { DW_OP_lit1, DW_OP_bra, 0x01, 0x00, DW_OP_lit5, DW_OP_lit7 }, f::DYNAMIC);
+	check("dynamic: register value", { DW_OP_breg3, 0x00, DW_OP_lit4, DW_OP_mul }, f::DYNAMIC);
+	check("dynamic: object", { DW_OP_dup, DW_OP_deref, DW_OP_plus }, f::DYNAMIC, true);
+
+	/* Now the caches, on in-memory DIEs. */
+	in_memory_root_die r;
+	auto cu = r.get_or_create_synthetic_cu();
+	iterator_base s = r.make_new(cu, DW_TAG_structure_type);
+	iterator_df<with_dynamic_location_die> m = r.make_new(s, DW_TAG_member);
+	attrs_of(m).insert(make_pair(DW_AT_data_member_location, location(DW_OP_plus_uconst, 8)));
+	auto p_before = m->get_compiled_dynamic_location();
+	assert(p_before->eval(0, nullptr, {}, 0x1000) == 0x1008);
+	assert(m->get_compiled_dynamic_location() == p_before);
+	attrs_of(m).set(DW_AT_data_member_location, location(DW_OP_plus_uconst, 16));
+	assert(m->get_compiled_dynamic_location()->eval(0, nullptr, {}, 0x1000) == 0x1010);
+	// what we were holding is stale, but still there
+	assert(p_before->eval(0, nullptr, {}, 0x1000) == 0x1008);
+	cout << "Compiled member location follows edits" << endl;
+
+	fake_regs regs;
+	iterator_df<subprogram_die> sub = r.make_new(cu, DW_TAG_subprogram);
+	attrs_of(sub).insert(make_pair(DW_AT_frame_base, location(DW_OP_breg6, 16)));
+	assert(sub->get_compiled_frame_base()->eval(0, &regs) == (Dwarf_Unsigned) regs.get(6) + 16);
+	attrs_of(sub).set(DW_AT_frame_base, location(DW_OP_breg7, 8));
+	assert(sub->get_compiled_frame_base()->eval(0, &regs) == (Dwarf_Unsigned) regs.get(7) + 8);
+	attrs_of(sub).erase(DW_AT_frame_base);
+	attrs_of(sub).insert(make_pair(DW_AT_frame_base, location(DW_OP_breg5, 0)));
+	assert(sub->get_compiled_frame_base()->eval(0, &regs) == (Dwarf_Unsigned) regs.get(5));
+	cout << "Compiled frame base follows edits" << endl;
+
+	return 0;
+}
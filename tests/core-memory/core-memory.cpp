@@ -0,0 +1,165 @@
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <elf.h>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/memory.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Addr;
+
+/* Write a small ELF core by hand, whose PT_LOAD segments leave gaps within
+ * a page, meet across a page boundary, stop short of their p_memsz, and
+ * (the last) run off the end of the file. Then check that core_file_memory
+ * gives us exactly the bytes the file has, and refuses everything else. */
+
+struct load
+{
+	Dwarf_Addr vaddr;
+	Dwarf_Unsigned filesz;
+	Dwarf_Unsigned memsz;
+};
+static const load loads[] = {
+	{ 0x10000, 0x100, 0x100 },
+	/* a gap of 0x100 bytes, in the same page */
+	{ 0x10200, 0x100, 0x100 },
+	/* touching the previous one, and running into the next page */
+	{ 0x10300, 0x1000, 0x1000 },
+	/* a mapping the kernel dumped only the start of */
+	{ 0x20000, 0x100, 0x1000 },
+	/* truncated: the file ends 0x80 bytes in */
+	{ 0x30000, 0x1000, 0x1000 }
+};
+static const unsigned nloads = sizeof loads / sizeof loads[0];
+static const off_t data_offset = 0x1000;
+static const off_t truncated_size = 0x80;
+
+static unsigned char byte_at(Dwarf_Addr addr) { return (addr * 7) ^ (addr >> 8); }
+
+static bool host_is_big_endian()
+{
+	const uint16_t one = 1;
+	return *reinterpret_cast<const unsigned char *>(&one) == 0;
+}
+
+template <typename Ehdr, typename Phdr>
+static void write_core(int fd, unsigned char elf_class)
+{
+	Ehdr ehdr;
+	memset(&ehdr, 0, sizeof ehdr);
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = elf_class;
+	ehdr.e_ident[EI_DATA] = host_is_big_endian() ? ELFDATA2MSB : ELFDATA2LSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_type = ET_CORE;
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_ehsize = sizeof ehdr;
+	ehdr.e_phoff = sizeof ehdr;
+	ehdr.e_phentsize = sizeof (Phdr);
+	ehdr.e_phnum = nloads;
+	ssize_t n = pwrite(fd, &ehdr, sizeof ehdr, 0);
+	assert(n == sizeof ehdr);
+	off_t offset = data_offset;
+	for (unsigned i = 0; i < nloads; ++i)
+	{
+		Phdr phdr;
+		memset(&phdr, 0, sizeof phdr);
+		phdr.p_type = PT_LOAD;
+		phdr.p_offset = offset;
+		phdr.p_vaddr = loads[i].vaddr;
+		phdr.p_filesz = loads[i].filesz;
+		phdr.p_memsz = loads[i].memsz;
+		phdr.p_flags = PF_R | PF_W;
+		n = pwrite(fd, &phdr, sizeof phdr, sizeof ehdr + i * sizeof phdr);
+		assert(n == sizeof phdr);
+		bool last = (i == nloads - 1);
+		std::vector<unsigned char> contents(last ? truncated_size : loads[i].filesz);
+		for (unsigned k = 0; k < contents.size(); ++k) contents[k] = byte_at(loads[i].vaddr + k);
+		n = pwrite(fd, contents.data(), contents.size(), offset);
+		assert(n == (ssize_t) contents.size());
+		offset += loads[i].filesz;
+	}
+	int ret = ftruncate(fd, offset - loads[nloads - 1].filesz + truncated_size);
+	assert(ret == 0);
+}
+
+static bool readable(expr::core_file_memory& mem, Dwarf_Addr addr, unsigned nbytes)
+{
+	unsigned char buf[sizeof (Dwarf_Unsigned)];
+	try { mem.read_bytes(addr, buf, nbytes); }
+	catch (lib::No_entry) { return false; }
+	for (unsigned k = 0; k < nbytes; ++k) assert(buf[k] == byte_at(addr + k));
+	/* read() must agree, in the host's byte order, which is the core's. */
+	Dwarf_Unsigned expected = 0;
+	memcpy(&expected, buf, nbytes);
+	if (host_is_big_endian()) expected >>= 8 * (sizeof expected - nbytes);
+	assert(mem.read(addr, nbytes) == expected);
+	return true;
+}
+
+static void check(expr::core_file_memory& mem, const char *what, Dwarf_Addr addr,
+	unsigned nbytes, bool expected)
+{
+	bool got = readable(mem, addr, nbytes);
+	cout << what << " (" << nbytes << " bytes at 0x" << std::hex << addr << std::dec << "): "
+		<< (got ? "readable" : "unavailable") << endl;
+	assert(got == expected);
+}
+
+template <typename Ehdr, typename Phdr>
+static void test(unsigned char elf_class, unsigned addr_size)
+{
+	char path[] = "/tmp/core-memory.XXXXXX";
+	int fd = mkstemp(path);
+	assert(fd != -1);
+	write_core<Ehdr, Phdr>(fd, elf_class);
+	close(fd);
+	expr::core_file_memory mem(path);
+	unlink(path);
+	assert(mem.address_size() == addr_size);
+
+	check(mem, "start of first segment", 0x10000, 8, true);
+	check(mem, "end of first segment", 0x100f8, 8, true);
+	check(mem, "running into the gap", 0x100fc, 8, false);
+	check(mem, "in the gap", 0x10100, 1, false);
+	check(mem, "end of the gap", 0x101ff, 1, false);
+	check(mem, "from the gap into a segment", 0x101fc, 8, false);
+	check(mem, "after the gap", 0x10200, 1, true);
+	check(mem, "across touching segments", 0x102fc, 8, true);
+	check(mem, "across a page boundary", 0x10ffc, 8, true);
+	check(mem, "end of the touching segment", 0x112f8, 8, true);
+	check(mem, "past the touching segment", 0x112fc, 8, false);
+	check(mem, "dumped part", 0x20000, 8, true);
+	check(mem, "past the dumped part", 0x200fc, 8, false);
+	check(mem, "undumped part", 0x20800, 1, false);
+	check(mem, "truncated segment, before the end of file", 0x30078, 8, true);
+	check(mem, "truncated segment, past the end of file", 0x3007c, 8, false);
+	check(mem, "no segment", 0x50000, 1, false);
+	/* Everything again, now that the pages are cached. */
+	assert(mem.npages_fetched() == mem.npages_cached());
+	size_t nfetched = mem.npages_fetched();
+	bool again = readable(mem, 0x10000, 8) && !readable(mem, 0x100fc, 8) && readable(mem, 0x102fc, 8);
+	assert(again);
+	assert(mem.npages_fetched() == nfetched);
+}
+
+int main(int argc, char **argv)
+{
+	test<Elf64_Ehdr, Elf64_Phdr>(ELFCLASS64, 8);
+	test<Elf32_Ehdr, Elf32_Phdr>(ELFCLASS32, 4);
+
+	/* We are not a core file. */
+	bool threw = false;
+	try { expr::core_file_memory mem(argv[0]); }
+	catch (lib::No_entry) { threw = true; }
+	assert(threw);
+
+	cout << "Core file memory has exactly the bytes the core file has" << endl;
+	return 0;
+}
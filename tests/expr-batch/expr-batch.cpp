@@ -0,0 +1,146 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <initializer_list>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+#include "../expr-fixture.hpp"
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Signed;
+using dwarf::lib::Dwarf_Addr;
+
+/* compiled_expr::eval_batch must give the same answers as calling eval()
+ * once per frame, whether it runs the expression a column at a time (the
+ * straight-line arithmetic subset) or falls back to frame by frame, and
+ * must throw the same kind of exception when some frame does. We use more
+ * frames than eval_batch's chunk size, and register values including the
+ * extremes, so that the wrapping and shifting cases are exercised. */
+
+static const unsigned NREGS = 48;
+static const size_t NFRAMES = 300;
+
+struct column_regs : public expr::regs
+{
+	const expr::regs_columns *p_cols;
+	size_t k;
+	Dwarf_Signed get(int regnum)
+	{
+		const Dwarf_Signed *col = p_cols->column(regnum);
+		if (!col) throw lib::No_entry();
+		return col[k];
+	}
+};
+enum outcome { OK, NOT_SUPPORTED, NO_ENTRY };
+
+static std::vector<std::vector<Dwarf_Signed> > reg_values(NREGS, std::vector<Dwarf_Signed>(NFRAMES));
+static std::vector<const Dwarf_Signed *> reg_ptrs;
+static std::vector<Dwarf_Signed> frame_bases(NFRAMES);
+static std::vector<Dwarf_Unsigned> object_bases(NFRAMES);
+
+static void check(const char *what, std::initializer_list<unsigned char> bytes, bool with_object)
+{
+	expr::compiled_expr c(decode(bytes));
+	expr::regs_columns cols = { reg_ptrs.data(), NREGS };
+	fake_memory mem;
+
+	/* Frame by frame. */
+	std::vector<Dwarf_Unsigned> expected(NFRAMES);
+	outcome first_failure = OK;
+	for (size_t k = 0; k < NFRAMES && first_failure == OK; ++k)
+	{
+		column_regs regs;
+		regs.p_cols = &cols;
+		regs.k = k;
+		try
+		{
+			expected[k] = c.eval(&regs, frame_bases[k],
+				with_object ? object_bases[k] : spec::opt<Dwarf_Unsigned>(), &mem);
+		}
+		catch (expr::Not_supported) { first_failure = NOT_SUPPORTED; }
+		catch (lib::No_entry) { first_failure = NO_ENTRY; }
+	}
+
+	/* All at once. */
+	std::vector<Dwarf_Unsigned> got(NFRAMES);
+	outcome batch = OK;
+	try
+	{
+		c.eval_batch(NFRAMES, got.data(), &cols, frame_bases.data(),
+			with_object ? object_bases.data() : nullptr, &mem);
+	}
+	catch (expr::Not_supported) { batch = NOT_SUPPORTED; }
+	catch (lib::No_entry) { batch = NO_ENTRY; }
+
+	cout << what << ": " << (batch == OK ? "agrees" : "throws, as it should") << endl;
+	assert(batch == first_failure);
+	if (batch == OK) assert(got == expected);
+}
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+	p_root = &root;
+
+	const Dwarf_Signed extremes[] = { 0, 1, -1, 63, 64, 65, 200,
+		(Dwarf_Signed) 0x8000000000000000ull, 0x7fffffffffffffffll };
+	const unsigned nextremes = sizeof extremes / sizeof extremes[0];
+	Dwarf_Unsigned x = 0x9e3779b97f4a7c15ull;
+	for (unsigned r = 0; r < NREGS; ++r)
+	{
+		for (size_t k = 0; k < NFRAMES; ++k)
+		{
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			reg_values[r][k] = (k % 7 == 0) ? extremes[(r + k) % nextremes] : (Dwarf_Signed) x;
+		}
+		reg_ptrs.push_back(reg_values[r].data());
+	}
+	for (size_t k = 0; k < NFRAMES; ++k)
+	{
+		frame_bases[k] = (k % 11 == 0) ? extremes[k % nextremes] : 0x7ffd0000 + 16 * k;
+		object_bases[k] = 0x600000 + 8 * k;
+	}
+
+	/* The arithmetic subset, run a column at a time. */
+	check("fbreg", { DW_OP_fbreg, 0x78 }, false);
+	check("fbreg extreme", { DW_OP_fbreg, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x7f }, false);
+	check("breg plus", { DW_OP_breg6, 0x10, DW_OP_breg5, 0x00, DW_OP_plus }, false);
+	check("bregx minus mul", { DW_OP_bregx, 40, 0x7f, DW_OP_breg3, 0x01, DW_OP_minus, DW_OP_lit3,
+		DW_OP_mul }, false);
+	check("shl by register", { DW_OP_breg1, 0x00, DW_OP_breg2, 0x00, DW_OP_shl }, false);
+	check("shr by register", { DW_OP_breg1, 0x00, DW_OP_breg2, 0x00, DW_OP_shr }, false);
+	check("shra by register", { DW_OP_breg1, 0x00, DW_OP_breg2, 0x00, DW_OP_shra }, false);
+	check("shra by 70", { DW_OP_breg7, 0x00, DW_OP_const1u, 70, DW_OP_shra }, false);
+	check("neg", { DW_OP_breg4, 0x00, DW_OP_neg }, false);
+	check("abs", { DW_OP_breg4, 0x00, DW_OP_abs }, false);
+	check("not and or xor", { DW_OP_breg1, 0x00, DW_OP_not, DW_OP_breg2, 0x00, DW_OP_and,
+		DW_OP_breg3, 0x00, DW_OP_or, DW_OP_breg4, 0x00, DW_OP_xor }, false);
+	check("comparisons", { DW_OP_breg1, 0x00, DW_OP_breg2, 0x00, DW_OP_lt,
+		DW_OP_breg3, 0x00, DW_OP_breg4, 0x00, DW_OP_ge, DW_OP_plus,
+		DW_OP_breg5, 0x00, DW_OP_breg5, 0x00, DW_OP_eq, DW_OP_plus }, false);
+	check("stack ops", { DW_OP_breg1, 0x00, DW_OP_breg2, 0x00, DW_OP_breg3, 0x00, DW_OP_rot,
+		DW_OP_over, DW_OP_pick, 0x02, DW_OP_swap, DW_OP_drop, DW_OP_minus, DW_OP_dup, DW_OP_xor,
+		DW_OP_plus, DW_OP_plus }, false);
+	check("regs as values", { DW_OP_reg3, DW_OP_regx, 47, DW_OP_plus, DW_OP_stack_value }, false);
+	check("object-relative", { DW_OP_plus_uconst, 0x08 }, true);
+	check("object-relative arithmetic", { DW_OP_breg2, 0x00, DW_OP_lit7, DW_OP_and, DW_OP_plus }, true);
+
+	/* Things that make it fall back to frame by frame. */
+	check("div", { DW_OP_breg1, 0x00, DW_OP_lit3, DW_OP_div }, false);
+	check("div by register", { DW_OP_breg1, 0x00, DW_OP_breg2, 0x00, DW_OP_div }, false);
+	check("mod", { DW_OP_breg1, 0x00, DW_OP_lit7, DW_OP_mod }, false);
+	check("bra", { DW_OP_breg1, 0x00, DW_OP_lit1, DW_OP_and, DW_OP_bra, 0x01, 0x00, DW_OP_lit5,
+		DW_OP_lit7 }, false);
+	check("deref", { DW_OP_fbreg, 0x70, DW_OP_deref }, false);
+	check("register we don't have", { DW_OP_bregx, 50, 0x00 }, false);
+	check("stack underflow", { DW_OP_breg1, 0x00, DW_OP_plus }, false);
+
+	cout << "eval_batch agrees with eval() in every frame" << endl;
+	return 0;
+}
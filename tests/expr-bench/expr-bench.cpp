@@ -0,0 +1,137 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+#include <dwarfpp/expr.hpp>
+#include "../expr-fixture.hpp"
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Signed;
+using dwarf::lib::Dwarf_Addr;
+
+/* Measure how many location expressions per second we evaluate, over
+ * all the DW_AT_location and DW_AT_frame_base expressions in a binary
+ * (by default ourselves), so the mix of DW_OPs is a real one. Registers
+ * and memory are made up, but deterministic. If a minimum rate (exprs
+ * per second, for the plain evaluator) is given as a second argument,
+ * we fail if we don't reach it. */
+
+template <typename Func>
+static double exprs_per_second(size_t nexprs, Func f)
+{
+	/* Keep going for at least a fifth of a second, so the clock's
+	 * resolution doesn't matter. */
+	auto start = std::chrono::steady_clock::now();
+	size_t nrounds = 0;
+	double secs;
+	do
+	{
+		f();
+		++nrounds;
+		secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while (secs < 0.2);
+	return nrounds * nexprs / secs;
+}
+
+int main(int argc, char **argv)
+{
+	const char *filename = (argc > 1) ? argv[1] : argv[0];
+	cout << "Opening " << filename << "..." << endl;
+	std::ifstream in(filename);
+	core::root_die root(fileno(in));
+
+	std::vector<encap::loc_expr> exprs;
+	for (auto i = root.begin(); i != root.end(); ++i)
+	{
+		lib::Dwarf_Half attrs[] = { DW_AT_location, DW_AT_frame_base };
+		for (unsigned j = 0; j < sizeof attrs / sizeof attrs[0]; ++j)
+		{
+			if (!i.has_attribute_here(attrs[j])) continue;
+			core::Attribute a(dynamic_cast<core::Die&>(i.get_handle()), attrs[j]);
+			encap::attribute_value val(a, dynamic_cast<core::Die&>(i.get_handle()), root);
+			if (!val.is_loclist()) continue;
+			auto loclist = val.get_loclist();
+			for (auto i_expr = loclist.begin(); i_expr != loclist.end(); ++i_expr)
+			{
+				if (i_expr->size() > 0) exprs.push_back(*i_expr);
+			}
+		}
+	}
+
+	/* Keep only those we can evaluate in our made-up context, so that
+	 * the timed loops measure evaluation, not exception handling. */
+	fake_regs regs;
+	fake_memory mem;
+	const Dwarf_Signed frame_base = 0x7ffd0000;
+	std::vector<encap::loc_expr> usable;
+	std::map<int, unsigned> op_counts;
+	for (auto i_expr = exprs.begin(); i_expr != exprs.end(); ++i_expr)
+	{
+		try
+		{
+			expr::evaluator(i_expr->data(), i_expr->data() + i_expr->size(),
+				spec::DEFAULT_DWARF_SPEC, &regs, frame_base, {}, &mem).tos(true);
+		}
+		catch (lib::No_entry) { continue; }
+		catch (expr::Not_supported) { continue; }
+		usable.push_back(*i_expr);
+		for (auto i_op = i_expr->begin(); i_op != i_expr->end(); ++i_op)
+		{
+			++op_counts[i_op->lr_atom];
+		}
+	}
+	cout << "Found " << exprs.size() << " expressions, of which "
+		<< usable.size() << " are usable" << endl;
+	if (usable.size() == 0) return 0;
+	for (auto i_op = op_counts.begin(); i_op != op_counts.end(); ++i_op)
+	{
+		const char *name = spec::DEFAULT_DWARF_SPEC.op_lookup(i_op->first);
+		cout << "\t" << (name ? name : "(unknown)") << ": " << i_op->second << endl;
+	}
+
+	std::vector<expr::compiled_expr> compiled;
+	for (auto i_expr = usable.begin(); i_expr != usable.end(); ++i_expr)
+	{
+		compiled.push_back(expr::compiled_expr(*i_expr));
+	}
+
+	/* Accumulate the results so the loops can't be optimised away. */
+	Dwarf_Unsigned sink = 0;
+	double evaluator_rate = exprs_per_second(usable.size(), [&]() {
+		for (auto i_expr = usable.begin(); i_expr != usable.end(); ++i_expr)
+		{
+			sink += expr::evaluator(i_expr->data(), i_expr->data() + i_expr->size(),
+				spec::DEFAULT_DWARF_SPEC, &regs, frame_base, {}, &mem).tos(true);
+		}
+	});
+	double symbolic_rate = exprs_per_second(usable.size(), [&]() {
+		for (auto i_expr = usable.begin(); i_expr != usable.end(); ++i_expr)
+		{
+			sink += expr::symbolic_eval(*i_expr).offset;
+		}
+	});
+	double compiled_rate = exprs_per_second(compiled.size(), [&]() {
+		for (auto i_c = compiled.begin(); i_c != compiled.end(); ++i_c)
+		{
+			sink += i_c->eval(&regs, frame_base, spec::opt<Dwarf_Unsigned>(), &mem);
+		}
+	});
+	cout << "evaluator: " << (unsigned long) evaluator_rate << " exprs/s" << endl;
+	cout << "symbolic_eval: " << (unsigned long) symbolic_rate << " exprs/s" << endl;
+	cout << "compiled_expr: " << (unsigned long) compiled_rate << " exprs/s" << endl;
+	cout << "(checksum 0x" << std::hex << sink << std::dec << ")" << endl;
+
+	if (argc > 2 && evaluator_rate < std::strtod(argv[2], nullptr))
+	{
+		cout << "Below the minimum of " << argv[2] << " exprs/s" << endl;
+		return 1;
+	}
+	return 0;
+}
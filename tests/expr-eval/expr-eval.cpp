@@ -0,0 +1,128 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <initializer_list>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+#include "../expr-fixture.hpp"
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Signed;
+using dwarf::lib::Dwarf_Addr;
+
+/* Evaluate some hand-encoded expressions, decoded by libdwarf so that the
+ * branch offsets are real ones, and check the evaluator's answers. */
+
+enum outcome { OK, NOT_SUPPORTED, NO_ENTRY };
+static outcome eval(std::initializer_list<unsigned char> bytes, Dwarf_Unsigned *out,
+	bool with_frame_base = true)
+{
+	encap::loc_expr e = decode(bytes);
+	fake_regs regs;
+	fake_memory mem;
+	try
+	{
+		*out = expr::evaluator(e.data(), e.data() + e.size(), spec::DEFAULT_DWARF_SPEC,
+			&regs, with_frame_base ? spec::opt<Dwarf_Signed>(0x7ffd0000) : spec::opt<Dwarf_Signed>(),
+			{}, &mem).tos(true);
+	}
+	catch (expr::Not_supported) { return NOT_SUPPORTED; }
+	catch (lib::No_entry) { return NO_ENTRY; }
+	return OK;
+}
+static void expect(const char *what, std::initializer_list<unsigned char> bytes, Dwarf_Unsigned expected)
+{
+	Dwarf_Unsigned got = 0;
+	outcome o = eval(bytes, &got);
+	cout << what << ": ";
+	if (o == OK) cout << "0x" << std::hex << got << std::dec << endl;
+	else cout << "threw" << endl;
+	assert(o == OK && got == expected);
+}
+static void expect_throw(const char *what, std::initializer_list<unsigned char> bytes, outcome expected,
+	bool with_frame_base = true)
+{
+	Dwarf_Unsigned got = 0;
+	outcome o = eval(bytes, &got, with_frame_base);
+	cout << what << ": " << (o == OK ? "no exception" : "threw") << endl;
+	assert(o == expected);
+}
+
+static const Dwarf_Unsigned INT64_MIN_BITS = 0x8000000000000000ull;
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+	p_root = &root;
+
+	/* Control flow. */
+	expect("skip forward", { DW_OP_lit1, DW_OP_skip, 0x01, 0x00, DW_OP_lit2, DW_OP_lit3, DW_OP_plus }, 4);
+	expect("bra not taken", { DW_OP_lit9, DW_OP_lit0, DW_OP_bra, 0x01, 0x00, DW_OP_lit5, DW_OP_lit7,
+		DW_OP_plus }, 12);
+	expect("bra taken", { DW_OP_lit9, DW_OP_lit1, DW_OP_bra, 0x01, 0x00, DW_OP_lit5, DW_OP_lit7,
+		DW_OP_plus }, 16);
+	/* Sum 5 + 4 + ... + 1, keeping (sum, n) on the stack, branching
+	 * backwards from offset 9 (next instruction at 12) to offset 2. */
+	expect("bra backwards", { DW_OP_lit0, DW_OP_lit5,
+		DW_OP_dup, DW_OP_rot, DW_OP_plus, DW_OP_swap, DW_OP_lit1, DW_OP_minus, DW_OP_dup,
+		DW_OP_bra, 0xf6, 0xff, DW_OP_drop }, 15);
+	expect_throw("skip backwards forever", { DW_OP_skip, 0xfd, 0xff }, NOT_SUPPORTED);
+	expect_throw("skip to before the start", { DW_OP_lit1, DW_OP_skip, 0xf0, 0xff }, NOT_SUPPORTED);
+
+	/* Stack manipulation. */
+	expect("pick", { DW_OP_lit1, DW_OP_lit2, DW_OP_lit3, DW_OP_pick, 0x02 }, 1);
+	expect("pick 0", { DW_OP_lit1, DW_OP_lit2, DW_OP_lit3, DW_OP_pick, 0x00 }, 3);
+	expect_throw("pick too deep", { DW_OP_lit1, DW_OP_pick, 0x01 }, NOT_SUPPORTED);
+	expect("over", { DW_OP_lit1, DW_OP_lit2, DW_OP_over }, 1);
+	expect("rot, top", { DW_OP_lit1, DW_OP_lit2, DW_OP_lit3, DW_OP_rot }, 2);
+	expect("rot, second", { DW_OP_lit1, DW_OP_lit2, DW_OP_lit3, DW_OP_rot, DW_OP_drop }, 1);
+	expect("rot, third", { DW_OP_lit1, DW_OP_lit2, DW_OP_lit3, DW_OP_rot, DW_OP_drop, DW_OP_drop }, 3);
+
+	/* Division is signed, modulus unsigned. */
+	expect("-7 div 2", { DW_OP_consts, 0x79, DW_OP_lit2, DW_OP_div }, (Dwarf_Unsigned) -3);
+	expect("7 div -2", { DW_OP_lit7, DW_OP_consts, 0x7e, DW_OP_div }, (Dwarf_Unsigned) -3);
+	expect("-7 mod 2", { DW_OP_consts, 0x79, DW_OP_lit2, DW_OP_mod }, ((Dwarf_Unsigned) -7) % 2);
+	expect("-8 mod 3", { DW_OP_consts, 0x78, DW_OP_lit3, DW_OP_mod }, ((Dwarf_Unsigned) -8) % 3);
+	expect("INT64_MIN div -1", { DW_OP_const8u, 0, 0, 0, 0, 0, 0, 0, 0x80,
+		DW_OP_consts, 0x7f, DW_OP_div }, INT64_MIN_BITS);
+	expect_throw("div by zero", { DW_OP_lit1, DW_OP_lit0, DW_OP_div }, NOT_SUPPORTED);
+	expect_throw("mod by zero", { DW_OP_lit1, DW_OP_lit0, DW_OP_mod }, NOT_SUPPORTED);
+
+	/* Negation and shifts wrap, and don't run into undefined behaviour. */
+	expect("neg INT64_MIN", { DW_OP_const8u, 0, 0, 0, 0, 0, 0, 0, 0x80, DW_OP_neg }, INT64_MIN_BITS);
+	expect("abs INT64_MIN", { DW_OP_const8u, 0, 0, 0, 0, 0, 0, 0, 0x80, DW_OP_abs }, INT64_MIN_BITS);
+	expect("abs -5", { DW_OP_consts, 0x7b, DW_OP_abs }, 5);
+	expect("1 shl 63", { DW_OP_lit1, DW_OP_const1u, 63, DW_OP_shl }, INT64_MIN_BITS);
+	expect("1 shl 64", { DW_OP_lit1, DW_OP_const1u, 64, DW_OP_shl }, 0);
+	expect("-1 shr 64", { DW_OP_consts, 0x7f, DW_OP_const1u, 64, DW_OP_shr }, 0);
+	expect("-1 shr 60", { DW_OP_consts, 0x7f, DW_OP_const1u, 60, DW_OP_shr }, 0xf);
+	expect("-2 shra 200", { DW_OP_consts, 0x7e, DW_OP_const1u, 200, DW_OP_shra }, (Dwarf_Unsigned) -1);
+	expect("2 shra 200", { DW_OP_lit2, DW_OP_const1u, 200, DW_OP_shra }, 0);
+	expect("fbreg wraps", { DW_OP_fbreg, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x7f },
+		(Dwarf_Unsigned) 0x7ffd0000 + INT64_MIN_BITS);
+	/* Without a frame base, these are unavailable, just as register-based
+	 * ones are without registers. */
+	expect_throw("fbreg, no frame base", { DW_OP_fbreg, 0x08 }, NO_ENTRY, false);
+	expect_throw("call_frame_cfa, no frame base", { DW_OP_call_frame_cfa }, NO_ENTRY, false);
+
+	/* Entry values. */
+	expect("entry value of reg5", { /* DW_OP_GNU_entry_value */ 0xf3, 0x01, DW_OP_reg5 }, 0x1005);
+	expect("entry value of regx 40", { /* DW_OP_GNU_entry_value */ 0xf3, 0x02, DW_OP_regx, 40 }, 0x1000 + 40);
+	expect_throw("entry value of breg5", { /* DW_OP_GNU_entry_value */ 0xf3, 0x02, DW_OP_breg5, 0x00 },
+		NOT_SUPPORTED);
+
+	/* Dereference sizes. */
+	expect("deref_size 4", { DW_OP_lit16, DW_OP_deref_size, 4 }, 0x5a5a5a4a);
+	expect("deref_size 8", { DW_OP_lit16, DW_OP_deref_size, 8 }, 0x5a5a5a5a5a5a5a4aull);
+	expect_throw("deref_size 0", { DW_OP_lit16, DW_OP_deref_size, 0 }, NOT_SUPPORTED);
+	expect_throw("deref_size 9", { DW_OP_lit16, DW_OP_deref_size, 9 }, NOT_SUPPORTED);
+
+	cout << "All expressions evaluated as expected" << endl;
+	return 0;
+}
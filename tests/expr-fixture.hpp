@@ -0,0 +1,54 @@
+#ifndef DWARFPP_TESTS_EXPR_FIXTURE_HPP_
+#define DWARFPP_TESTS_EXPR_FIXTURE_HPP_
+
+#include <vector>
+#include <initializer_list>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+
+/* What the expression tests share: made-up registers and memory, and a way
+ * to decode hand-written expression bytes the way libdwarf would decode
+ * them from a .debug_info block, so that branch offsets are real ones. */
+
+struct fake_regs : public dwarf::expr::regs
+{
+	dwarf::lib::Dwarf_Signed get(int regnum) { return 0x7ffe0000 + 0x100 * regnum; }
+	dwarf::lib::Dwarf_Signed get_at_entry(int regnum) { return 0x1000 + regnum; }
+};
+/* Every byte is a function of its address, and different in each byte of
+ * a word, so reads of different sizes give different answers. Addresses
+ * below unmapped_below are not there. */
+struct fake_memory : public dwarf::expr::memory
+{
+	dwarf::lib::Dwarf_Addr unmapped_below;
+	fake_memory(dwarf::lib::Dwarf_Addr unmapped_below = 0) : unmapped_below(unmapped_below) {}
+	dwarf::lib::Dwarf_Unsigned read(dwarf::lib::Dwarf_Addr addr, unsigned nbytes)
+	{
+		if (addr < unmapped_below) throw dwarf::lib::No_entry();
+		dwarf::lib::Dwarf_Unsigned val = addr ^ 0x5a5a5a5a5a5a5a5aull;
+		return nbytes < sizeof val ? val & (((dwarf::lib::Dwarf_Unsigned) 1 << (8 * nbytes)) - 1) : val;
+	}
+};
+
+/* libdwarf wants a Dwarf_Debug to decode into; any will do. */
+static dwarf::core::root_die *p_root;
+
+inline bool try_decode(const unsigned char *bytes, size_t len, dwarf::encap::loc_expr *out)
+{
+	auto h = dwarf::core::Locdesc::try_construct(p_root->get_dbg().raw_handle(),
+		const_cast<unsigned char *>(bytes), len);
+	if (!h) return false;
+	dwarf::core::Locdesc ld(std::move(h));
+	*out = dwarf::encap::loc_expr(*ld.raw_handle());
+	return true;
+}
+inline dwarf::encap::loc_expr decode(std::initializer_list<unsigned char> bytes)
+{
+	std::vector<unsigned char> v(bytes);
+	dwarf::encap::loc_expr e;
+	bool decoded = try_decode(v.data(), v.size(), &e);
+	assert(decoded);
+	return e;
+}
+
+#endif
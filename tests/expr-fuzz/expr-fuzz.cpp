@@ -0,0 +1,107 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+#include "../expr-fixture.hpp"
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Signed;
+using dwarf::lib::Dwarf_Addr;
+
+/* Feed arbitrary bytes, as a DWARF expression block, through libdwarf's
+ * decoder (dwarf_loclist_from_expr, via Locdesc::try_construct) and then
+ * everything of ours that consumes the result: loc_expr, the evaluator,
+ * symbolic_eval, eval_pieces, compiled_expr and compiled_loclist. Throwing
+ * No_entry or Not_supported is fine; anything else, or a crash, is a bug.
+ *
+ * Built with -DDWARFPP_LIBFUZZER and -fsanitize=fuzzer, together with the
+ * library sources so that they are instrumented too (see fuzz-% in
+ * ../Makefile), this is a libFuzzer target. Otherwise we supply a main()
+ * which feeds it windows of the files named on the command line, so that
+ * the usual test run gives it a quick workout on our own binary. */
+
+template <typename Func>
+static void tolerate(Func f)
+{
+	try { f(); }
+	catch (lib::No_entry) {}
+	catch (expr::Not_supported) {}
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	std::ifstream *p_in = new std::ifstream((*argv)[0]); // leaked, as is the root
+	p_root = new core::root_die(fileno(*p_in));
+	return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	encap::loc_expr e;
+	if (!try_decode(data, size, &e)) return 0; // libdwarf rejected it, which is its right
+
+	fake_regs regs;
+	fake_memory mem(4096);
+	const Dwarf_Signed frame_base = 0x7ffd0000;
+	const Dwarf_Addr object_address = 0x600000;
+
+	tolerate([&]() { expr::symbolic_eval(e); });
+	tolerate([&]() { expr::symbolic_eval(e, true); });
+	tolerate([&]() {
+		expr::eval_pieces(e.data(), e.data() + e.size(), spec::DEFAULT_DWARF_SPEC,
+			&regs, frame_base, &mem, object_address);
+	});
+	tolerate([&]() {
+		expr::evaluator(e.data(), e.data() + e.size(), spec::DEFAULT_DWARF_SPEC,
+			&regs, frame_base, {}, &mem, object_address).tos(true);
+	});
+	tolerate([&]() {
+		expr::compiled_expr(e).eval(&regs, frame_base, object_address, &mem);
+	});
+
+	/* Also as a two-entry loclist. */
+	encap::loc_expr e1 = e, e2 = e;
+	e1.lopc = 0x1000; e1.hipc = 0x2000;
+	e2.lopc = 0x2000; e2.hipc = 0x3000;
+	encap::loclist l(std::vector<encap::loc_expr>({ e1, e2 }));
+	tolerate([&]() {
+		expr::evaluator(l, 0x2800, spec::DEFAULT_DWARF_SPEC, &regs, frame_base,
+			{}, &mem, object_address).tos(true);
+	});
+	tolerate([&]() {
+		expr::compiled_loclist(l).eval(0x1800, &regs, frame_base, object_address, &mem);
+	});
+	return 0;
+}
+
+#ifndef DWARFPP_LIBFUZZER
+int main(int argc, char **argv)
+{
+	LLVMFuzzerInitialize(&argc, &argv);
+	for (int i = 1; i < argc; ++i)
+	{
+		cout << "Feeding windows of " << argv[i] << "..." << endl;
+		std::ifstream in(argv[i], std::ios::binary);
+		std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>());
+		/* Start a window at each of the first 64kB, taking the length
+		 * from its first byte. */
+		size_t limit = std::min(bytes.size(), (size_t) 65536);
+		for (size_t k = 0; k < limit; ++k)
+		{
+			size_t len = std::min((size_t) (bytes[k] % 32) + 1, bytes.size() - k);
+			LLVMFuzzerTestOneInput(&bytes[k], len);
+		}
+		cout << "Fed " << limit << " inputs" << endl;
+	}
+	return 0;
+}
+#endif
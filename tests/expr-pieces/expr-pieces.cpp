@@ -0,0 +1,155 @@
+#include <iostream>
+#include <cstring>
+#include <vector>
+#include <initializer_list>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+#include "../expr-fixture.hpp"
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::core;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Signed;
+using dwarf::lib::Dwarf_Addr;
+
+/* eval_pieces must give the right kind, size and value for each piece of
+ * a composite location, whether it folds symbolically or has to be
+ * evaluated. We build the instructions directly, since libdwarf would
+ * decode the implicit pointer's reference at a size that depends on the
+ * DWARF version. Then file_relative_intervals, which uses eval_pieces,
+ * must place byte-aligned bit pieces correctly and refuse the rest. */
+
+static encap::expr_instr op(Dwarf_Unsigned atom, Dwarf_Unsigned number = 0, Dwarf_Unsigned number2 = 0)
+{
+	encap::expr_instr i;
+	memset(&i, 0, sizeof i);
+	i.lr_atom = atom;
+	i.lr_number = number;
+	i.lr_number2 = number2;
+	return i;
+}
+static encap::loc_expr instrs(std::initializer_list<encap::expr_instr> l)
+{
+	std::vector<encap::expr_instr> v(l);
+	/* No branches here, so any increasing offsets will do. */
+	for (unsigned k = 0; k < v.size(); ++k) v[k].lr_offset = k;
+	return encap::loc_expr(v);
+}
+
+typedef expr::location_piece piece;
+static const Dwarf_Signed frame_base = 0x7ffd0000;
+
+static expr::composite_location check(const char *what, const encap::loc_expr& e,
+	std::initializer_list<piece> expected, bool with_regs = true)
+{
+	fake_regs regs;
+	expr::composite_location got = expr::eval_pieces(e.data(), e.data() + e.size(),
+		spec::DEFAULT_DWARF_SPEC, with_regs ? &regs : nullptr, frame_base);
+	cout << what << ": " << got.size() << " pieces" << endl;
+	assert(got.size() == expected.size());
+	auto i_exp = expected.begin();
+	for (auto i = got.begin(); i != got.end(); ++i, ++i_exp)
+	{
+		cout << "\tkind " << i->kind << ", " << i->bit_size << " bits at bit offset "
+			<< i->bit_offset << ", 0x" << std::hex << i->value << std::dec << endl;
+		assert(i->kind == i_exp->kind);
+		assert(i->bit_size == i_exp->bit_size);
+		assert(i->bit_offset == i_exp->bit_offset);
+		if (i->kind != piece::EMPTY) assert(i->value == i_exp->value);
+		if (i->kind == piece::IMPLICIT_POINTER) assert(i->pointer_offset == i_exp->pointer_offset);
+	}
+	return got;
+}
+
+static in_memory_abstract_die::attribute_map& attrs_of(const iterator_base& i)
+{
+	return dynamic_cast<in_memory_abstract_die&>(i.dereference()).attrs();
+}
+
+int main(int argc, char **argv)
+{
+	fake_regs regs;
+	const unsigned char implicit_bytes[] = { 0x78, 0x56, 0x34, 0x12 };
+
+	check("registers", instrs({ op(DW_OP_reg3), op(DW_OP_piece, 4), op(DW_OP_regx, 40), op(DW_OP_piece, 4) }),
+		{ { piece::REGISTER, 32, 0, 3, 0 }, { piece::REGISTER, 32, 0, 40, 0 } });
+	/* We say which register, so need no register values to do it. */
+	check("registers, no values", instrs({ op(DW_OP_reg3), op(DW_OP_piece, 4) }),
+		{ { piece::REGISTER, 32, 0, 3, 0 } }, false);
+	check("values", instrs({ op(DW_OP_lit5), op(DW_OP_stack_value), op(DW_OP_piece, 2),
+			op(DW_OP_breg5, 1), op(DW_OP_stack_value), op(DW_OP_piece, 8),
+			op(DW_OP_implicit_value, sizeof implicit_bytes, (Dwarf_Unsigned) implicit_bytes),
+			op(DW_OP_piece, 4) }),
+		{ { piece::VALUE, 16, 0, 5, 0 },
+		  { piece::VALUE, 64, 0, (Dwarf_Unsigned) regs.get(5) + 1, 0 },
+		  { piece::VALUE, 32, 0, 0x12345678, 0 } });
+	check("implicit pointers", instrs({ op(/* DW_OP_GNU_implicit_pointer */ 0xf2, 0x1234, (Dwarf_Unsigned) -8),
+			op(DW_OP_piece, 8), op(/* DW_OP_implicit_pointer */ 0xa0, 0x5678, 16), op(DW_OP_piece, 8) }),
+		{ { piece::IMPLICIT_POINTER, 64, 0, 0x1234, -8 }, { piece::IMPLICIT_POINTER, 64, 0, 0x5678, 16 } });
+	check("empty pieces", instrs({ op(DW_OP_piece, 4), op(DW_OP_reg0), op(DW_OP_piece, 4), op(DW_OP_piece, 8) }),
+		{ { piece::EMPTY, 32, 0, 0, 0 }, { piece::REGISTER, 32, 0, 0, 0 }, { piece::EMPTY, 64, 0, 0, 0 } });
+	check("addresses", instrs({ op(DW_OP_addr, 0x601000), op(DW_OP_piece, 4), op(DW_OP_fbreg, (Dwarf_Unsigned) -16),
+			op(DW_OP_piece, 4) }),
+		{ { piece::ADDRESS, 32, 0, 0x601000, 0 }, { piece::ADDRESS, 32, 0, (Dwarf_Unsigned) frame_base - 16, 0 } });
+	check("bit pieces", instrs({ op(DW_OP_reg1), op(DW_OP_bit_piece, 3, 0), op(DW_OP_reg2), op(DW_OP_bit_piece, 13, 3),
+			op(DW_OP_addr, 0x602000), op(DW_OP_bit_piece, 16, 8) }),
+		{ { piece::REGISTER, 3, 0, 1, 0 }, { piece::REGISTER, 13, 3, 2, 0 }, { piece::ADDRESS, 16, 8, 0x602000, 0 } });
+	/* Without pieces, there is one piece of unknown size. */
+	check("whole register", instrs({ op(DW_OP_reg4) }), { { piece::REGISTER, 0, 0, 4, 0 } });
+	check("whole value", instrs({ op(DW_OP_lit7), op(DW_OP_stack_value) }), { { piece::VALUE, 0, 0, 7, 0 } });
+	check("no location", instrs({}), { { piece::EMPTY, 0, 0, 0, 0 } });
+
+	/* The evaluator gives the same pieces, having run to the first. */
+	encap::loc_expr mixed = instrs({ op(DW_OP_breg6, 8), op(DW_OP_piece, 4), op(DW_OP_reg7), op(DW_OP_piece, 4),
+		op(DW_OP_piece, 2), op(DW_OP_lit9), op(DW_OP_stack_value), op(DW_OP_piece, 2) });
+	expr::composite_location c = check("mixed", mixed, { { piece::ADDRESS, 32, 0, (Dwarf_Unsigned) regs.get(6) + 8, 0 },
+		{ piece::REGISTER, 32, 0, 7, 0 }, { piece::EMPTY, 16, 0, 0, 0 }, { piece::VALUE, 16, 0, 9, 0 } });
+	expr::composite_location from_evaluator = expr::evaluator(mixed.data(), mixed.data() + mixed.size(),
+		spec::DEFAULT_DWARF_SPEC, &regs, frame_base, {}).pieces();
+	assert(from_evaluator.size() == c.size());
+	for (unsigned k = 0; k < c.size(); ++k)
+	{
+		assert(from_evaluator[k].kind == c[k].kind && from_evaluator[k].value == c[k].value
+			&& from_evaluator[k].bit_size == c[k].bit_size);
+	}
+	/* An initial stack is the first piece's, not the later ones'. */
+	encap::loc_expr relative = instrs({ op(DW_OP_plus_uconst, 8), op(DW_OP_piece, 4),
+		op(DW_OP_lit0), op(DW_OP_plus_uconst, 16), op(DW_OP_piece, 4) });
+	from_evaluator = expr::evaluator(relative.data(), relative.data() + relative.size(),
+		spec::DEFAULT_DWARF_SPEC, &regs, frame_base, { 0x5000 }).pieces();
+	assert(from_evaluator.size() == 2);
+	assert(from_evaluator[0].kind == piece::ADDRESS && from_evaluator[0].value == 0x5008);
+	assert(from_evaluator[1].kind == piece::ADDRESS && from_evaluator[1].value == 16);
+	assert(expr::eval_pieces(relative.data(), relative.data() + relative.size(),
+		spec::DEFAULT_DWARF_SPEC, &regs, frame_base, nullptr, opt<Dwarf_Addr>(),
+		expr::operand_stack({ 0x5000 }))[0].value == 0x5008);
+
+	/* Static variables' intervals, from the pieces. */
+	in_memory_root_die r;
+	auto cu = r.get_or_create_synthetic_cu();
+	iterator_df<with_static_location_die> v = r.make_new(cu, DW_TAG_variable);
+	attrs_of(v).insert(make_pair(DW_AT_byte_size, encap::attribute_value((Dwarf_Unsigned) 4)));
+	attrs_of(v).insert(make_pair(DW_AT_location, encap::attribute_value(encap::loclist(
+		instrs({ op(DW_OP_addr, 0x601000), op(DW_OP_piece, 2), op(DW_OP_addr, 0x602000), op(DW_OP_bit_piece, 16, 8) })))));
+	auto intervals = v->file_relative_intervals(r, nullptr, nullptr);
+	assert(intervals.iterative_size() == 2);
+	assert(intervals.find(0x600fff) == intervals.end());
+	assert(intervals.find(0x601000)->second == 2 && intervals.find(0x601001)->second == 2);
+	assert(intervals.find(0x601002) == intervals.end());
+	assert(intervals.find(0x602000) == intervals.end());
+	assert(intervals.find(0x602001)->second == 4 && intervals.find(0x602002)->second == 4);
+	assert(intervals.find(0x602003) == intervals.end());
+	cout << "Byte-aligned bit piece placed at its byte offset" << endl;
+
+	attrs_of(v).set(DW_AT_location, encap::attribute_value(encap::loclist(
+		instrs({ op(DW_OP_addr, 0x601000), op(DW_OP_piece, 2), op(DW_OP_addr, 0x602000), op(DW_OP_bit_piece, 12, 0),
+			op(DW_OP_addr, 0x603000), op(DW_OP_bit_piece, 4, 4) }))));
+	intervals = v->file_relative_intervals(r, nullptr, nullptr);
+	assert(intervals.iterative_size() == 0);
+	cout << "Bit pieces not on byte boundaries give no intervals" << endl;
+
+	cout << "All pieces as expected" << endl;
+	return 0;
+}
@@ -1,5 +1,7 @@
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <iterator>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -35,6 +37,40 @@ void print_in_readelf_style(std::ostream& s, const encap::frame_instrlist& instr
 int elf_machine;
 lib::Dwarf_Debug dbg;
 
+static bool has_payload(const FrameSection::register_def& d)
+{
+	switch (d.k)
+	{
+		case FrameSection::register_def::SAVED_AT_OFFSET_FROM_CFA:
+		case FrameSection::register_def::VAL_IS_OFFSET_FROM_CFA:
+		case FrameSection::register_def::REGISTER:
+		case FrameSection::register_def::SAVED_AT_EXPR:
+		case FrameSection::register_def::VAL_OF_EXPR:
+			return true;
+		default: return false;
+	}
+}
+/* register_def's equality as it used to be: payload-less rules never compared
+ * equal. (UNDEFINED compared a member that nothing ever set, so might have
+ * gone either way; we count it as unequal, like the others.) */
+static bool old_style_equal(const FrameSection::register_def& d1, const FrameSection::register_def& d2)
+{
+	return has_payload(d1) && d1 == d2;
+}
+static bool old_style_rows_equal(const FrameSection::row_defs& r1, const FrameSection::row_defs& r2)
+{
+	if (r1.size() != r2.size()) return false;
+	for (auto i1 = r1.begin(), i2 = r2.begin(); i1 != r1.end(); ++i1, ++i2)
+	{
+		if (i1->first != i2->first || !old_style_equal(i1->second, i2->second)) return false;
+	}
+	return true;
+}
+static bool new_style_rows_equal(const FrameSection::row_defs& r1, const FrameSection::row_defs& r2)
+{
+	return r1 == r2;
+}
+
 int main(int argc, char **argv)
 {
 	cout << "Opening " << argv[1] << "..." << endl;
@@ -84,7 +120,107 @@ int main(int argc, char **argv)
 	int status = pclose(pipein);
 	assert(status == 0);
 	cout << "Output compares identical to readelf's -- success!" << endl;
-	
+
+	// check that the compiled table agrees with decode() on the CFA, row by row
+	auto& compiled = fs.get_compiled_table();
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		auto result = i_fde->decode();
+		for (auto i_row = result.rows.begin(); i_row != result.rows.end(); ++i_row)
+		{
+			auto p_row = compiled.row_for_pc(i_row->first.lower());
+			assert(p_row);
+			map<int, FrameSection::register_def> m(i_row->second.begin(), i_row->second.end());
+			auto found_cfa = m.find(DW_FRAME_CFA_COL3);
+			if (found_cfa == m.end()) continue;
+			assert(found_cfa->second.k == p_row->cfa.get_kind());
+			if (found_cfa->second.k == FrameSection::register_def::REGISTER)
+			{
+				assert(found_cfa->second.register_plus_offset_r().first == p_row->cfa.reg);
+				assert(found_cfa->second.register_plus_offset_r().second == p_row->cfa.offset_or_expr);
+			}
+		}
+	}
+	cout << "Compiled unwind table agrees with decoded FDEs -- success!" << endl;
+
+	// check that stopping early gives the same row as decoding everything
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		auto result = i_fde->decode();
+		for (auto i_row = result.rows.begin(); i_row != result.rows.end(); ++i_row)
+		{
+			auto partial = i_fde->decode(i_row->first.lower());
+			auto found = partial.rows.find(i_row->first.lower());
+			assert(found != partial.rows.end());
+			assert(found->second == i_row->second);
+			// we shouldn't have decoded any further rows
+			assert(std::prev(partial.rows.end()) == found);
+		}
+	}
+	cout << "Early-stopping decode agrees with full decode -- success!" << endl;
+
+	/* Diff the row boundaries we get now that payload-less rules (undefined,
+	 * same value, ...) compare equal, against those we got when they didn't.
+	 * Early-stopping decode gives us each unjoined row: its upper bound is
+	 * where the next row's instructions begin. From those we can join rows
+	 * under either notion of equality. Joining under the current one should
+	 * give exactly decode()'s rows, and we should only ever have lost
+	 * boundaries between rows that differ in a payload-less rule alone. */
+	unsigned raw_count = 0, old_count = 0, new_count = 0;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		auto result = i_fde->decode();
+		if (result.rows.size() == 0) continue;
+		std::vector<std::pair<boost::icl::discrete_interval<Dwarf_Addr>, FrameSection::row_defs> > raw_rows;
+		for (Dwarf_Addr pc = result.rows.begin()->first.lower();
+			pc < std::prev(result.rows.end())->first.upper(); )
+		{
+			auto partial = i_fde->decode(pc);
+			auto last = std::prev(partial.rows.end());
+			assert(last->first.upper() > pc);
+			raw_rows.push_back(make_pair(
+				boost::icl::interval<Dwarf_Addr>::right_open(pc, last->first.upper()),
+				last->second));
+			pc = last->first.upper();
+		}
+		raw_count += raw_rows.size();
+		
+		auto count_joined = [&raw_rows](bool (*eq)(const FrameSection::row_defs&, const FrameSection::row_defs&)) {
+			unsigned n = 0;
+			for (unsigned i = 0; i < raw_rows.size(); ++i)
+			{
+				if (i == 0 || !eq(raw_rows[i-1].second, raw_rows[i].second)) ++n;
+			}
+			return n;
+		};
+		unsigned n_old = count_joined(&old_style_rows_equal);
+		unsigned n_new = count_joined(&new_style_rows_equal);
+		assert(n_new == result.rows.iterative_size());
+		assert(n_new <= n_old);
+		old_count += n_old;
+		new_count += n_new;
+		
+		/* Each boundary we've lost must be between rows that are
+		 * the same but for payload-less rules. */
+		for (unsigned i = 1; i < raw_rows.size(); ++i)
+		{
+			if (old_style_rows_equal(raw_rows[i-1].second, raw_rows[i].second)) continue;
+			if (!new_style_rows_equal(raw_rows[i-1].second, raw_rows[i].second)) continue;
+			auto i_prev = raw_rows[i-1].second.begin();
+			for (auto i_def = raw_rows[i].second.begin(); i_def != raw_rows[i].second.end(); ++i_def, ++i_prev)
+			{
+				if (!old_style_equal(i_prev->second, i_def->second))
+				{
+					assert(!has_payload(i_def->second));
+				}
+			}
+		}
+	}
+	cout << "Rows before joining: " << raw_count
+		<< "; joined with payload-less rules unequal: " << old_count
+		<< "; joined with them equal (as decode() does): " << new_count << endl;
+	cout << "Row boundaries differ only where payload-less rules are involved -- success!" << endl;
+
 	return 0;
 }
 
@@ -139,7 +275,7 @@ void print_in_readelf_style(std::ostream& s, const FrameSection::instrs_results&
 	
 	auto visit_columns = [all_columns, ra_rule_number, &s](
 		 visitor_function visit, 
-		 optional<const set< pair<int, FrameSection::register_def> > &> opt_i_row
+		 optional<const FrameSection::row_defs &> opt_i_row
 		) {
 		
 		auto get_column = [&opt_i_row](int col) {
@@ -177,7 +313,7 @@ void print_in_readelf_style(std::ostream& s, const FrameSection::instrs_results&
 		else s << setw(5) << dwarf_regnames_for_elf_machine(elf_machine)[col] << ' ';
 	};
 	
-	visit_columns(column_header_visitor, /* nullptr */ optional<const set<pair<int, FrameSection::register_def> > &>());
+	visit_columns(column_header_visitor, /* nullptr */ optional<const FrameSection::row_defs &>());
 	s << endl;
 	
 	visitor_function print_row_column_visitor = [all_columns, ra_rule_number, &s]
@@ -0,0 +1,78 @@
+#include <fstream>
+#include <sstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+
+/* expand_all() must give the same rows whatever the number of threads,
+ * with debug output on or off, and the same as decoding each FDE by
+ * itself. */
+
+static bool same_expansion(const FrameSection::expanded_section& e1,
+	const FrameSection::expanded_section& e2)
+{
+	return e1.row_lopc == e2.row_lopc
+		&& e1.row_hipc == e2.row_hipc
+		&& e1.row_fde_idx == e2.row_fde_idx
+		&& e1.row_first_col == e2.row_first_col
+		&& e1.col_regnum == e2.col_regnum
+		&& e1.col_def == e2.col_def
+		&& e1.fde_first_row == e2.fde_first_row;
+}
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+	FrameSection fs(root.get_dbg(), true);
+
+	auto serial = fs.expand_all(1);
+	auto parallel = fs.expand_all(4);
+	assert(same_expansion(serial, parallel));
+	cout << "Expanded " << serial.nrows() << " rows, the same on 1 and 4 threads" << endl;
+
+	/* Debug output mustn't stop us using threads, or change the answer. */
+	std::ostringstream trace;
+	std::streambuf *saved_cerr = std::cerr.rdbuf(trace.rdbuf());
+	unsigned saved_debug_level = core::debug_level;
+	core::debug_level = 1;
+	auto traced = fs.expand_all(4);
+	core::debug_level = saved_debug_level;
+	std::cerr.rdbuf(saved_cerr);
+	assert(same_expansion(serial, traced));
+	assert(trace.str().find("Interpreting instrlist") != string::npos);
+	cout << "The same again on 4 threads with " << trace.str().size()
+		<< " bytes of debug output" << endl;
+
+	unsigned j = 0;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde, ++j)
+	{
+		auto decoded = i_fde->decode();
+		unsigned k = serial.fde_first_row.at(j);
+		unsigned k_end = serial.fde_first_row.at(j + 1);
+		for (auto i_row = decoded.rows.begin(); i_row != decoded.rows.end(); ++i_row, ++k)
+		{
+			assert(k < k_end);
+			assert(serial.row_fde_idx[k] == j);
+			assert(serial.row_lopc[k] == i_row->first.lower());
+			assert(serial.row_hipc[k] == i_row->first.upper());
+			unsigned col = serial.row_first_col[k];
+			assert(serial.row_first_col[k + 1] - col == i_row->second.size());
+			for (auto i_def = i_row->second.begin(); i_def != i_row->second.end(); ++i_def, ++col)
+			{
+				assert(serial.col_regnum[col] == i_def->first);
+				assert(serial.col_def[col] == i_def->second);
+			}
+		}
+		assert(k == k_end);
+	}
+	cout << "All " << j << " FDEs agree with decode()" << endl;
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include <fstream>
+#include <deque>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::core;
+using dwarf::lib::Dwarf_Addr;
+using dwarf::lib::Dwarf_Off;
+using dwarf::lib::Dwarf_Signed;
+
+/* spans_addr_in_frame_locals_or_args answers mostly from the cached frame
+ * layout. Check that it gives the same answers as asking each local and
+ * parameter in turn, breadth-first, as it used to. We're built with
+ * strict DWARF 2 (see ../Makefile), so our frame bases are register-based
+ * location lists, not DW_OP_call_frame_cfa, and our made-up registers
+ * are enough to compute them. */
+
+struct fake_regs : public expr::regs
+{
+	Dwarf_Signed get(int regnum) { return 0x7ffe0000 + 0x100 * regnum; }
+};
+
+static opt<std::pair<Dwarf_Off, Dwarf_Off> >
+first_spanning(root_die& r, iterator_df<subprogram_die> i_sub, Dwarf_Addr absolute_addr,
+	Dwarf_Signed frame_base, Dwarf_Addr ip, expr::regs *p_regs)
+{
+	std::deque<iterator_base> queue;
+	auto children = i_sub.children_here();
+	for (auto i_c = children.first; i_c != children.second; ++i_c) queue.push_back(i_c);
+	while (!queue.empty())
+	{
+		iterator_base i = queue.front();
+		queue.pop_front();
+		auto p_dyn = dynamic_cast<with_dynamic_location_die *>(&i.dereference());
+		if (p_dyn || i.tag_here() == DW_TAG_lexical_block)
+		{
+			auto children = i.children_here();
+			for (auto i_c = children.first; i_c != children.second; ++i_c) queue.push_back(i_c);
+		}
+		if (!p_dyn || p_dyn->location_requires_object_base()) continue;
+		opt<Dwarf_Off> result;
+		try { result = p_dyn->spans_addr(absolute_addr, frame_base, r, ip, p_regs); }
+		catch (lib::No_entry) {}
+		catch (expr::Not_supported) {}
+		if (result) return std::make_pair(*result, i.offset_here());
+	}
+	return opt<std::pair<Dwarf_Off, Dwarf_Off> >();
+}
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	root_die root(fileno(in));
+	fake_regs regs;
+
+	unsigned nsubprograms = 0, nqueries = 0, nfound = 0;
+	Dwarf_Off first_sub_off = 0;
+	std::shared_ptr<const frame_layout> p_first_layout;
+	std::shared_ptr<const expr::compiled_loclist> p_first_frame_base;
+	for (auto i = root.begin(); i != root.end(); ++i)
+	{
+		if (!i.is_a<subprogram_die>()) continue;
+		iterator_df<subprogram_die> i_sub = i.as_a<subprogram_die>();
+		if (!i_sub->get_frame_base()) continue;
+		iterator_df<compile_unit_die> i_cu = root.cu_pos(i.enclosing_cu_offset_here());
+		if (!i_cu->get_low_pc()) continue;
+		auto intervals = i_sub->file_relative_intervals(root, nullptr, nullptr);
+		if (intervals.begin() == intervals.end()) continue;
+		++nsubprograms;
+		if (!p_first_layout)
+		{
+			first_sub_off = i.offset_here();
+			p_first_layout = i_sub->get_frame_layout();
+			p_first_frame_base = i_sub->get_compiled_frame_base();
+		}
+		for (auto i_int = intervals.begin(); i_int != intervals.end(); ++i_int)
+		{
+			Dwarf_Addr ips[] = { i_int->first.lower(),
+				i_int->first.lower() + (i_int->first.upper() - i_int->first.lower()) / 2,
+				i_int->first.upper() - 1 };
+			for (unsigned k = 0; k < sizeof ips / sizeof ips[0]; ++k)
+			{
+				Dwarf_Signed frame_base;
+				try { i_sub->spans_addr_in_frame_locals_or_args(0, root, ips[k], &frame_base, &regs); }
+				catch (lib::No_entry) { continue; }
+				catch (expr::Not_supported) { continue; }
+				/* Probe every byte of a window around the frame base. */
+				for (Dwarf_Signed off = -160; off < 32; ++off)
+				{
+					Dwarf_Addr addr = frame_base + off;
+					opt<std::pair<Dwarf_Off, iterator_df<with_dynamic_location_die> > > fast;
+					/* Those locals it has to evaluate may not let it, and it
+					 * doesn't catch; then there's nothing to compare. */
+					try { fast = i_sub->spans_addr_in_frame_locals_or_args(addr, root, ips[k],
+						nullptr, &regs); }
+					catch (lib::No_entry) { continue; }
+					catch (expr::Not_supported) { continue; }
+					auto slow = first_spanning(root, i_sub, addr, frame_base, ips[k], &regs);
+					++nqueries;
+					assert(!fast == !slow);
+					if (!fast) continue;
+					++nfound;
+					assert(fast->first == slow->first);
+					assert(fast->second.offset_here() == slow->second);
+				}
+			}
+		}
+	}
+	cout << "Checked " << nqueries << " addresses in " << nsubprograms
+		<< " subprograms, of which " << nfound << " are in a local or parameter" << endl;
+	assert(nsubprograms > 0 && nfound > 0);
+
+	/* Subprograms' payloads aren't sticky, so that one has gone by now;
+	 * what we compiled from it is still cached in the root. */
+	iterator_df<subprogram_die> i_again = root.pos(first_sub_off);
+	assert(i_again->get_frame_layout() == p_first_layout);
+	assert(i_again->get_compiled_frame_base() == p_first_frame_base);
+	cout << "Frame layout and frame base outlived the subprogram's payload" << endl;
+	return 0;
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+
+/* root_dies opened on the same file share one FrameSection, however many
+ * threads ask for it at once, and the section outlives the root_die whose
+ * libdwarf handle it was built on. */
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << " several times..." << endl;
+	const unsigned nroots = 8;
+	std::vector<std::unique_ptr<std::ifstream> > ins;
+	std::vector<std::unique_ptr<core::root_die> > roots;
+	for (unsigned i = 0; i < nroots; ++i)
+	{
+		ins.push_back(std::unique_ptr<std::ifstream>(new std::ifstream(argv[0])));
+		roots.push_back(std::unique_ptr<core::root_die>(new core::root_die(fileno(*ins.back()))));
+	}
+
+	/* Everyone asks at once, twice each, and builds the compiled table. */
+	std::vector<std::shared_ptr<FrameSection> > got(2 * nroots);
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < 2 * nroots; ++i)
+	{
+		threads.push_back(std::thread([&roots, &got, i]() {
+			got[i] = roots[i % nroots]->frame_section_ptr();
+			got[i]->get_compiled_table();
+		}));
+	}
+	for (auto i_t = threads.begin(); i_t != threads.end(); ++i_t) i_t->join();
+	for (unsigned i = 1; i < got.size(); ++i) assert(got[i] == got[0]);
+	size_t nrows = got[0]->get_compiled_table().nrows();
+	assert(nrows > 0);
+	cout << "All " << got.size() << " lookups got the same section, with "
+		<< nrows << " compiled rows" << endl;
+
+	/* Drop every root_die; the section keeps its libdwarf handle alive. */
+	std::shared_ptr<FrameSection> p_fs = got[0];
+	got.clear();
+	roots.clear();
+	size_t nfdes = 0;
+	for (auto i_fde = p_fs->fde_begin(); i_fde != p_fs->fde_end(); ++i_fde)
+	{
+		i_fde->decode();
+		++nfdes;
+	}
+	assert(nfdes > 0);
+	assert(p_fs->get_compiled_table().nrows() == nrows);
+	cout << "Decoded " << nfdes << " FDEs after the root_dies had gone" << endl;
+
+	/* While it lives, a new root_die gets it; once it's gone, a fresh one. */
+	std::ifstream in(argv[0]);
+	{
+		core::root_die r(fileno(in));
+		assert(r.frame_section_ptr() == p_fs);
+	}
+	FrameSection *p_old = p_fs.get();
+	p_fs.reset();
+	core::root_die r(fileno(in));
+	std::shared_ptr<FrameSection> p_fresh = r.frame_section_ptr();
+	assert(p_fresh->get_compiled_table().nrows() == nrows);
+	cout << "A fresh section " << (p_fresh.get() == p_old ? "(at the same address) " : "")
+		<< "once the old one had gone" << endl;
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Addr;
+
+/* compiled_loclist's lookups must pick the same entry as the evaluator's
+ * linear search through the loclist, i.e. the first in the list that
+ * covers the vaddr, including when entries overlap (some of them widely)
+ * and when base address selection entries rebase them. Each entry's
+ * expression pushes its position in the list, so we can tell which one
+ * was picked. */
+
+static Dwarf_Unsigned x = 0x9e3779b97f4a7c15ull;
+static Dwarf_Unsigned next_random(Dwarf_Unsigned bound)
+{
+	x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	return x % bound;
+}
+
+static encap::loclist random_loclist(std::vector<Dwarf_Addr>& interesting)
+{
+	std::vector<encap::loc_expr> exprs;
+	unsigned n = 1 + next_random(40);
+	Dwarf_Addr base = 0;
+	for (unsigned i = 0; i < n; ++i)
+	{
+		if (next_random(8) == 0)
+		{
+			// base address selection entry
+			encap::loc_expr sel;
+			sel.lopc = 0xffffffffffffffffULL;
+			sel.hipc = base = next_random(0x10000);
+			exprs.push_back(sel);
+			continue;
+		}
+		Dwarf_Unsigned ops[] = { DW_OP_constu, i };
+		Dwarf_Addr lopc, hipc;
+		switch (next_random(16))
+		{
+			case 0: lopc = 0; hipc = 0; break;                 // all vaddrs
+			case 1: lopc = 4 + next_random(0x1000); hipc = lopc - next_random(4); break; // empty or backwards
+			case 2:
+			case 3: lopc = next_random(0x1000); hipc = lopc + next_random(0x8000); break; // wide
+			default: lopc = next_random(0x1000); hipc = lopc + 1 + next_random(0x100); break;
+		}
+		exprs.push_back(encap::loc_expr(ops, lopc, hipc));
+		if (lopc < hipc)
+		{
+			interesting.push_back(base + lopc);
+			interesting.push_back(base + hipc);
+			if (base + lopc > 0) interesting.push_back(base + lopc - 1);
+			if (base + hipc > 0) interesting.push_back(base + hipc - 1);
+		}
+	}
+	return encap::loclist(exprs);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned nlists = 0, nlookups = 0, nfound = 0;
+	for (unsigned round = 0; round < 2000; ++round)
+	{
+		std::vector<Dwarf_Addr> vaddrs;
+		encap::loclist l = random_loclist(vaddrs);
+		for (unsigned k = 0; k < 64; ++k) vaddrs.push_back(next_random(0x20000));
+		std::sort(vaddrs.begin(), vaddrs.end());
+		expr::compiled_loclist c(l);
+		++nlists;
+
+		/* The entries must be sorted and disjoint. */
+		for (unsigned i = 1; i < c.entries.size(); ++i)
+		{
+			assert(c.entries[i - 1].lopc < c.entries[i - 1].hipc);
+			assert(c.entries[i - 1].hipc <= c.entries[i].lopc);
+		}
+
+		std::vector<const expr::compiled_expr *> batch(vaddrs.size());
+		c.exprs_for_vaddrs(vaddrs.data(), vaddrs.size(), batch.data());
+		for (unsigned k = 0; k < vaddrs.size(); ++k)
+		{
+			bool linear_found = true;
+			Dwarf_Unsigned linear;
+			try { linear = expr::evaluator(l, vaddrs[k]).tos(); }
+			catch (lib::No_entry) { linear_found = false; }
+			const expr::compiled_expr *p_e = c.expr_for_vaddr(vaddrs[k]);
+			++nlookups;
+			assert(!!p_e == linear_found);
+			assert(batch[k] == p_e);
+			if (!p_e) continue;
+			++nfound;
+			assert(p_e->eval() == linear);
+			assert(c.eval(vaddrs[k]) == linear);
+		}
+	}
+	/* The evaluator copies the entry it picks, so may outlive the loclist. */
+	std::unique_ptr<expr::evaluator> p_ev;
+	{
+		Dwarf_Unsigned ops[] = { DW_OP_constu, 7 };
+		encap::loclist l(encap::loc_expr(ops, 0x100, 0x200));
+		p_ev.reset(new expr::evaluator(l, 0x180));
+	}
+	assert(p_ev->finished());
+	assert(p_ev->tos() == 7);
+	expr::composite_location pieces = p_ev->pieces();
+	assert(pieces.size() == 1 && pieces[0].value == 7);
+	cout << "Looked up " << nlookups << " vaddrs in " << nlists << " loclists ("
+		<< nfound << " covered); all agree with the evaluator" << endl;
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <cassert>
+#include <unistd.h>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+#include <dwarfpp/memory.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::lib::Dwarf_Addr;
+
+long a_global = 0x1122334455667788L;
+long *a_pointer = &a_global;
+
+int main(int argc, char **argv)
+{
+	/* Read ourselves through /proc/self/mem. */
+	expr::fd_memory mem(expr::fd_memory::path_for_pid(getpid()));
+	assert(mem.read((Dwarf_Addr) &a_global, sizeof a_global) == (Dwarf_Unsigned) a_global);
+	assert(mem.read((Dwarf_Addr) &a_global, 2) == ((Dwarf_Unsigned) a_global & 0xffff));
+	/* Our address size, whether we're told it or ask. */
+	assert(mem.address_size() == sizeof (void*));
+	assert(expr::fd_memory::address_size_for_pid(getpid()) == sizeof (void*));
+	expr::fd_memory mem4(expr::fd_memory::path_for_pid(getpid()), 4);
+	assert(mem4.address_size() == 4);
+
+	/* DW_OP_deref should follow the pointer. */
+	Dwarf_Unsigned ops[] = { DW_OP_addr, (Dwarf_Unsigned) &a_pointer, DW_OP_deref };
+	encap::loc_expr e(ops, 0, 0);
+	Dwarf_Unsigned result = expr::evaluator(e.data(), e.data() + e.size(),
+		spec::DEFAULT_DWARF_SPEC, 0, spec::opt<lib::Dwarf_Signed>(), {}, &mem).tos();
+	cout << "Dereferenced 0x" << std::hex << (Dwarf_Addr) &a_pointer
+		<< " to get 0x" << result << std::dec << endl;
+	assert(result == (Dwarf_Addr) &a_global);
+
+	/* Both globals are in .data, so very likely on the same page, which
+	 * we should have fetched only once. */
+	cout << "Fetched " << mem.npages_fetched() << " page(s)" << endl;
+	if ((((Dwarf_Addr) &a_global) ^ ((Dwarf_Addr) &a_pointer)) < expr::page_cached_memory::CACHE_PAGE_SIZE)
+	{
+		assert(mem.npages_fetched() == 1);
+	}
+
+	/* The zero page is never mapped. */
+	try
+	{
+		mem.read(0, sizeof (Dwarf_Addr));
+		assert(false);
+	} catch (lib::No_entry) {}
+
+	return 0;
+}
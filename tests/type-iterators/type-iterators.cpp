@@ -1,4 +1,6 @@
 #include <fstream>
+#include <cstddef>
+#include <map>
 #include <fileno.hpp>
 #include <dwarfpp/lib.hpp>
 #include <srk31/algorithm.hpp>
@@ -16,6 +18,12 @@ struct blah
 	struct inner i1;
 	struct inner i2;
 } blah1;
+struct bits
+{
+	unsigned a:4;
+	unsigned b:12;
+	unsigned char c;
+} bits1;
 
 int main(int argc, char **argv)
 {
@@ -59,6 +67,21 @@ int main(int argc, char **argv)
 	}
 	std::cerr << "==================================================" << std::endl;
 	assert(seen_via_walk_type == seen_via_type_iterator);
+
+	/* The allocation-free walker should see the same sequence, twice over
+	 * (the second time reusing its storage). */
+	type_walker walker;
+	for (unsigned n = 0; n < 2; ++n)
+	{
+		std::vector<pair<Dwarf_Off, Dwarf_Off> > seen_via_walker;
+		walker.walk(type_iter_die.as_a<type_die>(), iterator_base::END,
+			[&seen_via_walker](const iterator_df<type_die>& t, const iterator_df<program_element_die>& reason) {
+				seen_via_walker.push_back(make_pair(t.offset_here(), reason ? reason.offset_here() : (Dwarf_Off)-1));
+				return true;
+			}
+		);
+		assert(seen_via_walker == seen_via_walk_type);
+	}
 	
 	/* Now test the type_edge_iterator_df. */
 	auto blah_die = cu.named_child("blah"); assert(blah_die);
@@ -79,6 +102,60 @@ int main(int argc, char **argv)
 	}
 	assert(saw_inner == 2);
 	assert(saw_int == 1);
+
+	/* blah reaches inner twice, and int through it. Walking with
+	 * visit_once, we should see each of them exactly once; without, we
+	 * see inner once per member. */
+	auto inner_off = cu.named_child("inner").offset_here();
+	auto int_off = cu.named_child("int").offset_here();
+	std::map<Dwarf_Off, unsigned> times_seen[2];
+	for (bool visit_once : { false, true })
+	{
+		auto& seen = times_seen[visit_once];
+		type_walker(visit_once).walk(blah_die.as_a<type_die>(), iterator_base::END,
+			[&seen](const iterator_df<type_die>& t, const iterator_df<program_element_die>& reason) {
+				++seen[t.offset_here()];
+				return true;
+			}
+		);
+	}
+	assert(times_seen[false][inner_off] == 2);
+	assert(times_seen[true][inner_off] == 1);
+	assert(times_seen[true][int_off] == 1);
+	assert(times_seen[true].size() == times_seen[false].size());
+	for (auto i_seen = times_seen[true].begin(); i_seen != times_seen[true].end(); ++i_seen)
+	{
+		assert(i_seen->second == 1);
+		assert(times_seen[false].find(i_seen->first) != times_seen[false].end());
+	}
+
+	/* Check the flattened layout of blah: i1, i1.x, i2, i2.x. */
+	auto p_layout = blah_die.as_a<with_data_members_die>()->layout_table();
+	auto& layout = *p_layout;
+	assert(layout.size() == 4);
+	auto found = layout.innermost_at(sizeof (int) + 1);
+	assert(found);
+	assert(found->byte_offset == sizeof (int));
+	assert(found->nesting == 1);
+	assert(layout[found->parent_idx].nesting == 0);
+	assert(!layout.innermost_at(sizeof blah1));
+	// the root keeps it, however we get to blah
+	assert(cu.named_child("blah").as_a<with_data_members_die>()->layout_table() == p_layout);
+
+	/* A DWARF4-style bitfield covers only the bytes holding its bits, so
+	 * b mustn't hide c, even though b's storage type spans it. */
+	auto bits_die = cu.named_child("bits"); assert(bits_die);
+	auto p_bits_layout = bits_die.as_a<with_data_members_die>()->layout_table();
+	auto& bits_layout = *p_bits_layout;
+	auto found_b = bits_layout.first_starting_at(0);
+	while (found_b != bits_layout.end() && found_b->bit_size != 12) ++found_b;
+	assert(found_b != bits_layout.end());
+	if (found_b->data_bit_offset)
+	{
+		auto found_c = bits_layout.innermost_at(offsetof(struct bits, c));
+		assert(found_c);
+		assert(found_c->member_off == bits_die.named_child("c").offset_here());
+	}
 	
 	/* Now test the type_iterator_outgoing_edges. */
 	type_iterator_outgoing_edges i_outgoing(cu.named_child("int").as_a<type_die>());
@@ -0,0 +1,139 @@
+#include <fstream>
+#include <vector>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+
+using std::cerr;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::core;
+
+/* Edit the type graph of some in-memory DIEs, and check that the SCCs
+ * we maintain incrementally are the same as we'd compute from scratch. */
+
+static in_memory_abstract_die::attribute_map& attrs_of(const iterator_base& i)
+{
+	return dynamic_cast<in_memory_abstract_die&>(i.dereference()).attrs();
+}
+static encap::attribute_value ref_to(root_die& r, const iterator_base& target,
+	const iterator_base& referencer)
+{
+	return encap::attribute_value(encap::attribute_value::weak_ref(r,
+		target.offset_here(), true, referencer.offset_here(), DW_AT_type));
+}
+
+static void check_against_scratch(const std::vector<iterator_df<type_die> >& types)
+{
+	std::vector<opt<type_scc_t> > incremental;
+	for (auto i_t = types.begin(); i_t != types.end(); ++i_t)
+	{
+		incremental.push_back((*i_t)->get_scc());
+	}
+	for (auto i_t = types.begin(); i_t != types.end(); ++i_t)
+	{
+		(*i_t)->opt_cached_scc = boost::optional<std::shared_ptr<type_scc_t> >();
+	}
+	for (unsigned i = 0; i < types.size(); ++i)
+	{
+		opt<type_scc_t> scratch = types[i]->get_scc();
+		assert(!incremental[i] == !scratch);
+		if (scratch)
+		{
+			assert(*incremental[i] == *scratch);
+			assert(incremental[i]->edges_summary.val == scratch->edges_summary.val);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	in_memory_root_die root;
+	auto cu = root.get_or_create_synthetic_cu();
+
+	/* struct s { struct s *next; }, but built up one edge at a time. */
+	iterator_df<type_die> s = root.make_new(cu, DW_TAG_structure_type);
+	attrs_of(s).insert(make_pair(DW_AT_name, encap::attribute_value("s")));
+	attrs_of(s).insert(make_pair(DW_AT_byte_size, encap::attribute_value((lib::Dwarf_Unsigned) 8)));
+	iterator_df<type_die> p = root.make_new(cu, DW_TAG_pointer_type);
+	attrs_of(p).insert(make_pair(DW_AT_byte_size, encap::attribute_value((lib::Dwarf_Unsigned) 8)));
+	iterator_df<type_die> i = root.make_new(cu, DW_TAG_base_type);
+	attrs_of(i).insert(make_pair(DW_AT_name, encap::attribute_value("int")));
+	attrs_of(i).insert(make_pair(DW_AT_byte_size, encap::attribute_value((lib::Dwarf_Unsigned) 4)));
+	attrs_of(i).insert(make_pair(DW_AT_encoding, encap::attribute_value((lib::Dwarf_Unsigned) DW_ATE_signed)));
+	iterator_base m = root.make_new(s, DW_TAG_member);
+	attrs_of(m).insert(make_pair(DW_AT_name, encap::attribute_value("next")));
+	attrs_of(m).insert(make_pair(DW_AT_data_member_location, encap::attribute_value((lib::Dwarf_Unsigned) 0)));
+	std::vector<iterator_df<type_die> > types = { s, p, i };
+	check_against_scratch(types);
+	assert(!s->get_scc());
+
+	cerr << "* adding the edges of a cycle" << endl;
+	attrs_of(m).insert(make_pair(DW_AT_type, ref_to(root, p, m)));
+	check_against_scratch(types);
+	assert(!s->get_scc());
+	attrs_of(p).insert(make_pair(DW_AT_type, ref_to(root, s, p)));
+	check_against_scratch(types);
+	assert(s->get_scc() && s->get_scc()->size() == 2);
+
+	cerr << "* overwriting an edge, breaking the cycle" << endl;
+	attrs_of(p).set(DW_AT_type, ref_to(root, i, p));
+	check_against_scratch(types);
+	assert(!s->get_scc());
+
+	cerr << "* overwriting it back" << endl;
+	attrs_of(p).set(DW_AT_type, ref_to(root, s, p));
+	check_against_scratch(types);
+	assert(s->get_scc() && s->get_scc()->size() == 2);
+
+	cerr << "* erasing an edge" << endl;
+	attrs_of(m).erase(DW_AT_type);
+	check_against_scratch(types);
+	assert(!s->get_scc());
+
+	/* Edges against the order we created the types in, then cycles
+	 * closed, split and closed again further along. */
+	cerr << "* building a chain backwards" << endl;
+	std::vector<iterator_df<type_die> > chain;
+	for (unsigned k = 0; k < 6; ++k)
+	{
+		chain.push_back(root.make_new(cu, DW_TAG_pointer_type));
+		attrs_of(chain.back()).insert(make_pair(DW_AT_byte_size, encap::attribute_value((lib::Dwarf_Unsigned) 8)));
+	}
+	for (unsigned k = chain.size() - 1; k > 0; --k)
+	{
+		attrs_of(chain[k]).insert(make_pair(DW_AT_type, ref_to(root, chain[k - 1], chain[k])));
+		check_against_scratch(chain);
+	}
+	cerr << "* closing a cycle of four" << endl;
+	attrs_of(chain[0]).insert(make_pair(DW_AT_type, ref_to(root, chain[3], chain[0])));
+	check_against_scratch(chain);
+	assert(chain[0]->get_scc() && chain[0]->get_scc()->size() == 4);
+	assert(!chain[4]->get_scc());
+	cerr << "* breaking it" << endl;
+	attrs_of(chain[2]).erase(DW_AT_type);
+	check_against_scratch(chain);
+	assert(!chain[0]->get_scc());
+	cerr << "* closing another, overlapping it" << endl;
+	attrs_of(chain[2]).insert(make_pair(DW_AT_type, ref_to(root, chain[5], chain[2])));
+	check_against_scratch(chain);
+	assert(chain[5]->get_scc() && chain[5]->get_scc()->size() == 4);
+	assert(!chain[0]->get_scc() && !chain[1]->get_scc());
+
+	/* The library's own DIEs, like the synthetic CU, don't throw away
+	 * what we've cached about the types we already have. */
+	cerr << "* synthesising a CU" << endl;
+	in_memory_root_die r2;
+	iterator_base cu2 = r2.make_new(r2.begin(), DW_TAG_compile_unit);
+	attrs_of(cu2).insert(make_pair(DW_AT_language, encap::attribute_value((lib::Dwarf_Unsigned) DW_LANG_C)));
+	iterator_df<type_die> i2 = r2.make_new(cu2, DW_TAG_base_type);
+	attrs_of(i2).insert(make_pair(DW_AT_name, encap::attribute_value("int")));
+	attrs_of(i2).insert(make_pair(DW_AT_byte_size, encap::attribute_value((lib::Dwarf_Unsigned) 4)));
+	attrs_of(i2).insert(make_pair(DW_AT_encoding, encap::attribute_value((lib::Dwarf_Unsigned) DW_ATE_signed)));
+	abstract_name_for_type(i2);
+	assert(r2.cached_abstract_name(i2.offset_here()));
+	r2.get_or_create_synthetic_cu();
+	assert(r2.cached_abstract_name(i2.offset_here()));
+
+	return 0;
+}
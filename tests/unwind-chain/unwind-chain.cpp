@@ -0,0 +1,110 @@
+#include <fstream>
+#include <vector>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+#include <dwarfpp/regs.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::lib::Dwarf_Addr;
+using dwarf::lib::Dwarf_Signed;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::core::FrameSection;
+using dwarf::core::unwinder;
+using dwarf::core::unwound_regs;
+
+/* Unwind our own stack, through a call chain whose return addresses we
+ * record as we go, and check that the unwinder finds the same ones, with
+ * the CFA increasing. We need real register values for the innermost
+ * frame, so this is x86-64 only; and we look our PCs up in the file's
+ * CFI as they are, so we're built non-PIE (see ../Makefile). */
+
+#if defined(__x86_64__)
+static core::FrameSection *p_fs;
+static Dwarf_Addr ra_into_middle, ra_into_outer, ra_into_main;
+static std::vector<unwinder::frame> frames, frames_batch;
+static Dwarf_Addr stepped_caller_pc, stepped_cfa;
+
+struct innermost_regs : public expr::regs
+{
+	Dwarf_Signed rsp, rbp;
+	Dwarf_Signed get(int regnum)
+	{
+		switch (regnum)
+		{
+			case 7: return rsp;
+			case 6: return rbp;
+			default: throw lib::No_entry();
+		}
+	}
+};
+
+__attribute__((noinline)) static int innermost(int arg)
+{
+	ra_into_middle = (Dwarf_Addr) __builtin_return_address(0);
+	innermost_regs regs;
+	Dwarf_Addr pc;
+	__asm__ volatile ("lea 0(%%rip), %0\n\tmov %%rsp, %1\n\tmov %%rbp, %2"
+		: "=r"(pc), "=r"(regs.rsp), "=r"(regs.rbp));
+	unwinder u(*p_fs, [](Dwarf_Addr addr, Dwarf_Unsigned *out) {
+		*out = *reinterpret_cast<Dwarf_Unsigned *>(addr);
+		return true;
+	});
+	frames = u.unwind(pc, regs, 4);
+	unwound_regs caller;
+	if (!u.step(pc, true, regs, caller, &stepped_caller_pc, &stepped_cfa)) stepped_caller_pc = 0;
+	std::vector<unwinder::sample> samples(2, unwinder::sample { pc, &regs });
+	auto batch = u.unwind_batch(samples, 4);
+	assert(batch.size() == 2);
+	assert(batch[0].size() == batch[1].size());
+	frames_batch = batch[1];
+	return arg + 1;
+}
+__attribute__((noinline)) static int middle(int arg)
+{
+	ra_into_outer = (Dwarf_Addr) __builtin_return_address(0);
+	return innermost(arg) + 1; // not a tail call
+}
+__attribute__((noinline)) static int outer(int arg)
+{
+	ra_into_main = (Dwarf_Addr) __builtin_return_address(0);
+	return middle(arg) + 1;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+#if defined(__x86_64__)
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+	FrameSection fs(root.get_dbg(), true);
+	p_fs = &fs;
+
+	int ret = outer(0);
+	assert(ret == 3);
+
+	assert(frames.size() == 4);
+	assert(frames[1].pc == ra_into_middle);
+	assert(frames[2].pc == ra_into_outer);
+	assert(frames[3].pc == ra_into_main);
+	for (unsigned i = 1; i < frames.size(); ++i)
+	{
+		cout << "Frame " << i << ": pc 0x" << std::hex << frames[i].pc
+			<< ", CFA 0x" << frames[i].cfa << std::dec << endl;
+		assert(frames[i].cfa > frames[i - 1].cfa);
+	}
+	assert(stepped_caller_pc == ra_into_middle);
+	assert(stepped_cfa == frames[0].cfa);
+	assert(frames_batch.size() == frames.size());
+	for (unsigned i = 0; i < frames.size(); ++i)
+	{
+		assert(frames_batch[i].pc == frames[i].pc && frames_batch[i].cfa == frames[i].cfa);
+	}
+#else
+	cout << "Not on x86-64, so nothing to do" << endl;
+#endif
+	return 0;
+}